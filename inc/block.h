@@ -4,6 +4,7 @@
 #include "champsim.h"
 #include "instruction.h"
 #include "set.h"
+#include "hash_table.h"
 
 // CACHE BLOCK
 class BLOCK {
@@ -73,7 +74,8 @@ class PACKET {
             translated,
             fetched,
             prefetched,
-            drc_tag_read;
+            drc_tag_read,
+            clean_victim; // writeback of an unmodified block into an exclusive cache
 
     int fill_level, 
         pf_origin_level,
@@ -126,6 +128,7 @@ class PACKET {
         fetched = 0;
         prefetched = 0;
         drc_tag_read = 0;
+        clean_victim = 0;
 
         returned = 0;
         asid[0] = UINT8_MAX;
@@ -169,6 +172,11 @@ class PACKET {
     };
 };
 
+// what check_queue() matches a packet on, fixed when the queue is built
+#define QUEUE_INDEX_NONE      0 // never searched, e.g. the MSHR (it has its own index) and PROCESSED
+#define QUEUE_INDEX_ADDRESS   1
+#define QUEUE_INDEX_FULL_ADDR 2 // L1D write queue
+
 // packet queue
 class PACKET_QUEUE {
   public:
@@ -177,7 +185,11 @@ class PACKET_QUEUE {
 
     uint8_t  is_RQ, 
              is_WQ,
-             write_mode;
+             write_mode,
+             index_type;
+
+    // slot of every queued packet by its address (or full_addr), so check_queue() does not walk the queue
+    HASH_TABLE index;
 
     uint32_t cpu, 
              head, 
@@ -202,10 +214,12 @@ class PACKET_QUEUE {
     PACKET *entry, processed_packet[2*MAX_READ_PER_CYCLE];
 
     // constructor
-    PACKET_QUEUE(string v1, uint32_t v2) : NAME(v1), SIZE(v2) {
+    PACKET_QUEUE(string v1, uint32_t v2, uint8_t v3) : NAME(v1), SIZE(v2) {
         is_RQ = 0;
         is_WQ = 0;
         write_mode = 0;
+        index_type = v3;
+        resize_index();
 
         cpu = 0; 
         head = 0;
@@ -234,6 +248,7 @@ class PACKET_QUEUE {
     PACKET_QUEUE() {
         is_RQ = 0;
         is_WQ = 0;
+        index_type = QUEUE_INDEX_ADDRESS;
 
         cpu = 0; 
         head = 0;
@@ -267,14 +282,19 @@ class PACKET_QUEUE {
     // functions
     int check_queue(PACKET* packet);
     void add_queue(PACKET* packet),
-         remove_queue(PACKET* packet);
+         remove_queue(PACKET* packet),
+         resize(uint32_t size),
+         add_index(uint32_t slot),
+         resize_index(),
+         swap(PACKET_QUEUE &other);
+    uint64_t index_key(PACKET *packet);
 };
 
 // reorder buffer
 class CORE_BUFFER {
   public:
     const string NAME;
-    const uint32_t SIZE;
+    uint32_t SIZE;
     uint32_t cpu, 
              head, 
              tail,
@@ -322,6 +342,8 @@ class CORE_BUFFER {
     ~CORE_BUFFER() {
         delete[] entry;
     };
+
+    void resize(uint32_t size);
 };
 
 // load/store queue 
@@ -2,6 +2,9 @@
 #define CACHE_H
 
 #include "memory_class.h"
+#include "hash_table.h"
+
+#include <queue>
 
 // zmz modify
 #include "mosaic_cache.h"
@@ -18,6 +21,16 @@ extern uint32_t PAGE_TABLE_LATENCY, SWAP_LATENCY;
 #define IS_L1D  4
 #define IS_L2C  5
 #define IS_LLC  6
+#define NUM_CACHE_TYPES 7
+
+// INCLUSION POLICY (L2C and LLC)
+#define INCLUSION_NINE 0      // non-inclusive non-exclusive, lines stay where they were filled
+#define INCLUSION_INCLUSIVE 1 // an eviction back-invalidates the line in every cache above
+#define INCLUSION_EXCLUSIVE 2 // filled only by the victims of the caches above, a hit hands the line up
+
+// LLC SLICE HASH
+#define SLICE_HASH_MODULO 0 // low bits of the line address, a slice holds every N-th set
+#define SLICE_HASH_XOR 1    // all bits of the line address folded onto the slice bits
 
 // INSTRUCTION TLB
 #define ITLB_SET 16
@@ -82,17 +95,63 @@ extern uint32_t PAGE_TABLE_LATENCY, SWAP_LATENCY;
 #define LLC_MSHR_SIZE NUM_CPUS*64
 #define LLC_LATENCY 35  // 4/5 (L1I or L1D) + 10 + 20 = 34/35 cycles
 
+// queues of an LLC slice while another slice runs, see CACHE::select_slice()
+class CACHE_SLICE {
+  public:
+    PACKET_QUEUE WQ, RQ, PQ, MSHR;
+    HASH_TABLE mshr_table;
+    priority_queue <uint32_t, vector<uint32_t>, greater<uint32_t> > mshr_free;
+
+    CACHE_SLICE(string v1, uint32_t v2, uint32_t v3, uint32_t v4, uint32_t v5)
+        : WQ{v1 + "_WQ", v2, QUEUE_INDEX_ADDRESS}, RQ{v1 + "_RQ", v3, QUEUE_INDEX_ADDRESS},
+          PQ{v1 + "_PQ", v4, QUEUE_INDEX_ADDRESS}, MSHR{v1 + "_MSHR", v5, QUEUE_INDEX_NONE} {
+
+        for (uint32_t i=0; i<v5; i++)
+            mshr_free.push(i);
+    };
+
+    // nothing queued and no fill ready, so CACHE::operate() can leave it parked
+    bool idle() {
+        return (WQ.occupancy == 0) && (RQ.occupancy == 0) && (PQ.occupancy == 0) && (MSHR.next_fill_index == MSHR.SIZE);
+    };
+};
+
 class CACHE : public MEMORY {
   public:
     uint32_t cpu;
     const string NAME;
-    const uint32_t NUM_SET, NUM_WAY, NUM_LINE, WQ_SIZE, RQ_SIZE, PQ_SIZE, MSHR_SIZE;
+    uint32_t NUM_SET, NUM_WAY, NUM_LINE, WQ_SIZE, RQ_SIZE, PQ_SIZE, MSHR_SIZE; // configure() can change them before the simulation starts
     uint32_t LATENCY;
-    BLOCK **block;
+    BLOCK **block; // block[set] points into block_arena
+    BLOCK *block_arena; // all sets back to back, block_stride ways apart
+    uint32_t num_allocated_way, // ways per set in use, resize_way() can change it
+             block_stride; // ways per set in block_arena, at least num_allocated_way
+
+    // copy of block[set][way].tag/valid laid out for find_way()
+    // the tags of a set sit next to each other, tag_stride apart, and valid_mask has one bit per way
+    // fill_cache() and invalidate_entry() keep it in sync, which limits a cache to 64 ways
+    uint64_t *tag_store, *valid_mask;
+    uint32_t tag_stride;
     int fill_level;
     uint32_t MAX_READ, MAX_FILL;
     uint32_t reads_available_this_cycle;
     uint8_t cache_type;
+    uint8_t inclusion, // INCLUSION_*, set by -config
+            clean_writeback; // the lower level is exclusive, so clean victims are written back too
+    uint64_t back_invalidated; // lines dropped because an inclusive lower level evicted them
+
+    // zmz modify
+    // dirty lines a Mosaic reconfig would write back, per lower WQ: queue id -> an address that goes there, line count
+    map<uint32_t, pair<uint64_t, int> > mosaic_writeback_queue;
+    // free ways a migrate dry run already gave to a line, per set and core window
+    map<uint64_t, int> mosaic_reserved;
+
+    // LLC slices ([LLC] slices in -config), each with its own RQ/WQ/PQ/MSHR and MAX_READ/MAX_FILL ports
+    // the blocks are shared, a slice only adds queues and ports. the queues of active_slice are the ones
+    // in RQ/WQ/PQ/MSHR, which is slice 0 unless a function that works on another slice is running
+    uint32_t num_slices, active_slice;
+    uint8_t slice_hash;
+    CACHE_SLICE **slice; // the parked queues, slice[0] is not used
 
     // prefetch stats
     uint64_t pf_requested,
@@ -102,11 +161,16 @@ class CACHE : public MEMORY {
              pf_fill;
 
     // queues
-    PACKET_QUEUE WQ{NAME + "_WQ", WQ_SIZE}, // write queue
-                 RQ{NAME + "_RQ", RQ_SIZE}, // read queue
-                 PQ{NAME + "_PQ", PQ_SIZE}, // prefetch queue
-                 MSHR{NAME + "_MSHR", MSHR_SIZE}, // MSHR
-                 PROCESSED{NAME + "_PROCESSED", ROB_SIZE}; // processed queue
+    PACKET_QUEUE WQ{NAME + "_WQ", WQ_SIZE, (NAME == "L1D") ? (uint8_t)QUEUE_INDEX_FULL_ADDR : (uint8_t)QUEUE_INDEX_ADDRESS}, // write queue
+                 RQ{NAME + "_RQ", RQ_SIZE, QUEUE_INDEX_ADDRESS}, // read queue
+                 PQ{NAME + "_PQ", PQ_SIZE, QUEUE_INDEX_ADDRESS}, // prefetch queue
+                 MSHR{NAME + "_MSHR", MSHR_SIZE, QUEUE_INDEX_NONE}, // MSHR
+                 PROCESSED{NAME + "_PROCESSED", ROB_SIZE, QUEUE_INDEX_NONE}; // processed queue
+
+    // MSHR slot of every outstanding address, and the free slots lowest first like the old scan
+    // kept in sync by add_mshr() and remove_mshr(), so a lookup does not walk the whole MSHR
+    HASH_TABLE mshr_table;
+    priority_queue <uint32_t, vector<uint32_t>, greater<uint32_t> > mshr_free;
 
     uint64_t sim_access[NUM_CPUS][NUM_TYPES],
              sim_hit[NUM_CPUS][NUM_TYPES],
@@ -116,6 +180,10 @@ class CACHE : public MEMORY {
              roi_miss[NUM_CPUS][NUM_TYPES];
 
     uint64_t total_miss_latency;
+
+    // miss latency from add_mshr() to the fill, per core and access type
+    LATENCY_HISTOGRAM sim_latency[NUM_CPUS][NUM_TYPES],
+                      roi_latency[NUM_CPUS][NUM_TYPES];
     
     // constructor
     CACHE(string v1, uint32_t v2, int v3, uint32_t v4, uint32_t v5, uint32_t v6, uint32_t v7, uint32_t v8) 
@@ -123,15 +191,17 @@ class CACHE : public MEMORY {
 
         LATENCY = 0;
 
-        // cache block
-        block = new BLOCK* [NUM_SET];
-        for (uint32_t i=0; i<NUM_SET; i++) {
-            block[i] = new BLOCK[NUM_WAY]; 
+        for (uint32_t i=0; i<MSHR_SIZE; i++)
+            mshr_free.push(i);
 
-            for (uint32_t j=0; j<NUM_WAY; j++) {
-                block[i][j].lru = j;
-            }
-        }
+        // cache block
+        num_allocated_way = NUM_WAY;
+        block = NULL;
+        block_arena = NULL;
+        allocate_blocks(NUM_WAY);
+        tag_store = NULL;
+        valid_mask = NULL;
+        build_tag_store();
 
         for (uint32_t i=0; i<NUM_CPUS; i++) {
             upper_level_icache[i] = NULL;
@@ -154,6 +224,13 @@ class CACHE : public MEMORY {
         fill_level = -1;
         MAX_READ = 1;
         MAX_FILL = 1;
+        inclusion = INCLUSION_NINE;
+        clean_writeback = 0;
+        back_invalidated = 0;
+        num_slices = 1;
+        active_slice = 0;
+        slice_hash = SLICE_HASH_MODULO;
+        slice = NULL;
 
         pf_requested = 0;
         pf_issued = 0;
@@ -164,9 +241,13 @@ class CACHE : public MEMORY {
 
     // destructor
     ~CACHE() {
-        for (uint32_t i=0; i<NUM_SET; i++)
-            delete[] block[i];
+        delete[] block_arena;
         delete[] block;
+        delete[] tag_store;
+        delete[] valid_mask;
+        for (uint32_t i=1; i<num_slices; i++)
+            delete slice[i];
+        delete[] slice;
     };
 
     // functions
@@ -179,9 +260,28 @@ class CACHE : public MEMORY {
          increment_WQ_FULL(uint64_t address);
 
     uint32_t get_occupancy(uint8_t queue_type, uint64_t address),
-             get_size(uint8_t queue_type, uint64_t address);
+             get_size(uint8_t queue_type, uint64_t address),
+             get_queue_id(uint8_t queue_type, uint64_t address);
+
+    uint64_t get_next_event_cycle();
+
+    void functional_access(PACKET *packet);
+
+    void checkpoint(),
+         configure(uint32_t sets, uint32_t ways, uint32_t wq_size, uint32_t rq_size, uint32_t pq_size, uint32_t mshr_size);
+
+    void configure_slices(uint32_t slices, uint8_t hash),
+         select_slice(uint32_t s),
+         swap_slice(uint32_t s);
+    uint32_t get_slice(uint64_t address) const;
+    const PACKET_QUEUE *get_slice_queue(uint8_t queue_type, uint32_t s) const;
+
+    void allocate_blocks(uint32_t ways),
+         build_tag_store(),
+         update_tag_store(uint32_t set, uint32_t way);
 
-    int  check_hit(PACKET *packet),
+    int  find_way(uint32_t set, uint64_t tag, uint32_t start, uint32_t end),
+         check_hit(PACKET *packet),
          invalidate_entry(uint64_t inval_addr),
          check_mshr(PACKET *packet),
          prefetch_line(uint64_t ip, uint64_t base_addr, uint64_t pf_addr, int prefetch_fill_level, uint32_t prefetch_metadata),
@@ -193,6 +293,7 @@ class CACHE : public MEMORY {
          handle_prefetch();
 
     void add_mshr(PACKET *packet),
+         remove_mshr(uint32_t mshr_index),
          update_fill_cycle(),
          llc_initialize_replacement(),
          update_replacement_state(uint32_t cpu, uint32_t set, uint32_t way, uint64_t full_addr, uint64_t ip, uint64_t victim_addr, uint32_t type, uint8_t hit),
@@ -212,7 +313,11 @@ class CACHE : public MEMORY {
          //prefetcher_final_stats(),
          l1d_prefetcher_final_stats(),
          l2c_prefetcher_final_stats(),
-         llc_prefetcher_final_stats();
+         llc_prefetcher_final_stats(),
+         l1d_prefetcher_checkpoint(),
+         l2c_prefetcher_checkpoint(),
+         llc_prefetcher_checkpoint(),
+         llc_replacement_checkpoint();
     void (*l1i_prefetcher_cache_operate)(uint32_t, uint64_t, uint8_t, uint8_t);
     void (*l1i_prefetcher_cache_fill)(uint32_t, uint64_t, uint32_t, uint32_t, uint8_t, uint64_t);
 
@@ -227,11 +332,38 @@ class CACHE : public MEMORY {
              llc_find_victim(uint32_t cpu, uint64_t instr_id, uint32_t set, const BLOCK *current_set, uint64_t ip, uint64_t full_addr, uint32_t type),
              lru_victim(uint32_t cpu, uint64_t instr_id, uint32_t set, const BLOCK *current_set, uint64_t ip, uint64_t full_addr, uint32_t type);
 
+    uint8_t back_invalidate(uint64_t address),
+            invalidate_line(uint64_t address);
+
     // zmz modify
     void resize_way(int new_way_num);
+    void mosaic_cache_get_window(int window_cpu, int *start_pos, int *end_pos);
     int mosaic_cache_get_writeback_count(int way_num);
-    bool mosaic_cache_can_writeback(int writeback_count);
+    void mosaic_cache_count_writeback_line(BLOCK *line);
+    bool mosaic_cache_can_writeback();
     void mosaic_cache_issue_writeback(int way_id);
+    void mosaic_cache_writeback_line(uint32_t set, uint32_t way);
+    bool mosaic_cache_drain_way(int way_id, CACHE **receiver, int *budget, bool settle);
+    int mosaic_cache_migrate_way(int way_id, CACHE **receiver, uint8_t dry_run, int *dirty_left);
+    bool mosaic_cache_can_move_to(CACHE *target);
+    bool mosaic_cache_take_line(BLOCK *line, uint8_t dry_run);
+};
+
+// selects a slice for as long as it is in scope, then puts back the one that was active
+class SLICE_SCOPE {
+  public:
+    CACHE *cache;
+    uint32_t prior;
+
+    SLICE_SCOPE(CACHE *v1, uint32_t v2) : cache(v1), prior(v1->active_slice) {
+        if (v2 != prior)
+            cache->select_slice(v2);
+    };
+
+    ~SLICE_SCOPE() {
+        if (cache->active_slice != prior)
+            cache->select_slice(prior);
+    };
 };
 
 #endif
@@ -79,7 +79,11 @@ extern uint8_t warmup_complete[NUM_CPUS],
                all_simulation_complete,
                MAX_INSTR_DESTINATIONS,
                knob_cloudsuite,
-               knob_low_bandwidth;
+               knob_low_bandwidth,
+               knob_cycle_skipping,
+               knob_trace_prefetch,
+               knob_functional_warmup,
+               functional_warmup;
 
 extern uint64_t current_core_cycle[NUM_CPUS], 
                 stall_cycle[NUM_CPUS], 
@@ -88,7 +92,6 @@ extern uint64_t current_core_cycle[NUM_CPUS],
                 drc_blocks;
 
 extern queue <uint64_t> page_queue;
-extern map <uint64_t, uint64_t> page_table, inverse_table, recent_page, unique_cl[NUM_CPUS];
 extern uint64_t previous_ppage, num_adjacent_page, num_cl[NUM_CPUS], allocated_pages, num_page[NUM_CPUS], minor_fault[NUM_CPUS], major_fault[NUM_CPUS];
 
 void print_stats();
@@ -114,5 +117,6 @@ class RANDOM {
         return dist(engine);
     };
 };
+extern RANDOM champsim_rand;
 extern uint64_t champsim_seed;
 #endif
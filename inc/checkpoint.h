@@ -0,0 +1,39 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "champsim.h"
+#include "page_table.h"
+
+#include <vector>
+
+// warmed-up state checkpoint (-save_checkpoint / -load_checkpoint)
+// the file is a list of named sections, every structure saves and restores itself through
+// checkpoint_data() and friends, so the same function covers both directions
+// a section that is missing or has another size (e.g. a different prefetcher is compiled in)
+// is skipped on restore and that structure simply starts cold
+#define CHECKPOINT_MAGIC   "CHAMPCKP"
+#define CHECKPOINT_VERSION 1
+
+class checkpoint_header {
+  public:
+    char magic[8];
+    uint32_t version,
+             num_cpus;
+    uint64_t num_sections;
+};
+
+// set while a checkpoint is being loaded
+extern uint8_t checkpoint_restore;
+
+void save_checkpoint(const char *name),
+     load_checkpoint(const char *name);
+
+// these return -1 when the section was skipped on restore
+int checkpoint_data(string key, void *data, size_t size),
+    checkpoint_buffer(string key, vector<uint8_t> &buffer),
+    checkpoint_table(string key, HASH_TABLE &table);
+
+// on restore, whether the checkpoint has this section at all (older checkpoints lack the newer ones)
+uint8_t checkpoint_has(string key);
+
+#endif
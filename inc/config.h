@@ -0,0 +1,51 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "champsim.h"
+#include "cache.h"
+
+// runtime configuration (-config FILE)
+// an INI file with one section per structure, e.g.
+//
+//   [L2C]
+//   sets = 2048
+//   latency = 14
+//
+//   [core]
+//   fetch_width = 8
+//
+//   [DRAM]
+//   rq_size = 48
+//   tCAS = 13.75
+//
+//   [LLC]
+//   inclusion = inclusive
+//   slices = 8
+//   slice_hash = xor
+//
+//   [NOC]
+//   topology = mesh
+//   hop_latency = 2
+//
+// sections: ITLB DTLB STLB L1I L1D L2C LLC core DRAM NOC, '#' or ';' starts a comment
+// inclusion (L2C and LLC only) is nine (the default), inclusive or exclusive, see INCLUSION_* in cache.h
+// slices (LLC only, a power of two) splits the LLC queues, MSHR and read ports, slice_hash is modulo or xor
+// NOC topology is none (the default, the L2C talks to the LLC directly), ring or mesh, the other keys are
+// hop_latency (cycles), link_width (bytes per cycle) and link_queue (packets per link), see interconnect.h
+// anything left out keeps the compile-time default from cache.h, ooo_cpu.cc and dram_controller.cc
+// ROB/LQ/SQ sizes and the DRAM channels/ranks/banks size arrays all over the code, they stay in champsim.h
+class CACHE_CONFIG {
+  public:
+    uint32_t sets, ways, wq_size, rq_size, pq_size, mshr_size, latency;
+    uint8_t inclusion;
+    uint32_t slices;
+    uint8_t slice_hash;
+};
+
+// indexed by cache_type (IS_ITLB ... IS_LLC)
+extern CACHE_CONFIG cache_config[NUM_CACHE_TYPES];
+
+void load_config(const char *name),
+     apply_config();
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef CORE_PORT_H
+#define CORE_PORT_H
+
+#include "memory_class.h"
+
+#include <deque>
+
+// parallel simulation (-sim_threads)
+// every core and its private caches run on a host thread of their own, so the L2C cannot
+// call into the shared LLC directly. it talks to its port instead, which keeps the requests
+// of the current quantum until the uncore hands them to the LLC in issue order
+class PORT_REQUEST {
+  public:
+    PACKET packet;
+    uint64_t cycle;     // core cycle the request was sent at
+    uint8_t queue_type; // 1: RQ, 2: WQ, 3: PQ, as in get_occupancy()
+};
+
+class CORE_PORT : public MEMORY {
+  public:
+    uint32_t cpu;
+    deque <PORT_REQUEST> outbox;
+    uint32_t pending[4]; // outbox entries per queue type
+    deque <uint64_t> wq_full; // addresses that found the LLC WQ full, counted at the next delivery
+
+    CORE_PORT() {
+        cpu = 0;
+        lower_level = NULL;
+        for (uint32_t i=0; i<4; i++)
+            pending[i] = 0;
+    };
+
+    // functions
+    int  add_rq(PACKET *packet),
+         add_wq(PACKET *packet),
+         add_pq(PACKET *packet);
+    void return_data(PACKET *packet),
+         operate(),
+         increment_WQ_FULL(uint64_t address),
+         functional_access(PACKET *packet);
+    uint32_t get_occupancy(uint8_t queue_type, uint64_t address),
+             get_size(uint8_t queue_type, uint64_t address),
+             get_queue_id(uint8_t queue_type, uint64_t address);
+    uint64_t get_next_event_cycle();
+
+    void queue_request(PACKET *packet, uint8_t queue_type);
+    int  deliver(uint64_t cycle);
+};
+
+extern CORE_PORT core_port[NUM_CPUS];
+
+// hands every request sent up to this cycle to the LLC, oldest first across all ports
+void deliver_core_ports(uint64_t cycle);
+
+#endif
@@ -5,12 +5,11 @@
 
 // DRAM configuration
 #define DRAM_CHANNEL_WIDTH 8 // 8B
-#define DRAM_WQ_SIZE 64
-#define DRAM_RQ_SIZE 64
 
-#define tRP_DRAM_NANOSECONDS  12.5
-#define tRCD_DRAM_NANOSECONDS 12.5
-#define tCAS_DRAM_NANOSECONDS 12.5
+// queue sizes, data rate and timings are set at runtime (-config), the defaults are in dram_controller.cc
+// channels, ranks and banks stay in champsim.h, they size the bank arrays below
+extern uint32_t DRAM_WQ_SIZE, DRAM_RQ_SIZE, DRAM_DATA_RATE;
+extern double tRP_DRAM_NANOSECONDS, tRCD_DRAM_NANOSECONDS, tCAS_DRAM_NANOSECONDS;
 
 // the data bus must wait this amount of time when switching between reads and writes, and vice versa
 #define DRAM_DBUS_TURN_AROUND_TIME ((15*CPU_FREQ)/2000) // 7.5 ns 
@@ -33,6 +32,10 @@ class MEMORY_CONTROLLER : public MEMORY {
     uint32_t processed_writes, scheduled_reads[DRAM_CHANNELS], scheduled_writes[DRAM_CHANNELS];
     int fill_level;
 
+    // latency from the RQ/WQ insert to the data transfer, per core and access type
+    LATENCY_HISTOGRAM sim_latency[NUM_CPUS][NUM_TYPES],
+                      roi_latency[NUM_CPUS][NUM_TYPES];
+
     BANK_REQUEST bank_request[DRAM_CHANNELS][DRAM_RANKS][DRAM_BANKS];
 
     // queues
@@ -62,10 +65,12 @@ class MEMORY_CONTROLLER : public MEMORY {
             WQ[i].NAME = "DRAM_WQ" + to_string(i);
             WQ[i].SIZE = DRAM_WQ_SIZE;
             WQ[i].entry = new PACKET [DRAM_WQ_SIZE];
+            WQ[i].resize_index();
 
             RQ[i].NAME = "DRAM_RQ" + to_string(i);
             RQ[i].SIZE = DRAM_RQ_SIZE;
             RQ[i].entry = new PACKET [DRAM_RQ_SIZE];
+            RQ[i].resize_index();
         }
 
         fill_level = FILL_DRAM;
@@ -86,7 +91,14 @@ class MEMORY_CONTROLLER : public MEMORY {
          increment_WQ_FULL(uint64_t address);
 
     uint32_t get_occupancy(uint8_t queue_type, uint64_t address),
-             get_size(uint8_t queue_type, uint64_t address);
+             get_size(uint8_t queue_type, uint64_t address),
+             get_queue_id(uint8_t queue_type, uint64_t address);
+
+    uint64_t get_next_event_cycle();
+
+    void functional_access(PACKET *packet);
+
+    void checkpoint();
 
     void schedule(PACKET_QUEUE *queue), process(PACKET_QUEUE *queue),
          update_schedule_cycle(PACKET_QUEUE *queue),
@@ -0,0 +1,33 @@
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include "champsim.h"
+
+#include <vector>
+
+// open-addressing (linear probing) hash table from a 64-bit key to a 64-bit value
+// keys and values live in flat arrays that only grow, so lookups do not chase pointers
+// and inserts do not allocate a node each
+#define HASH_TABLE_MIN_SIZE 1024
+
+class HASH_TABLE {
+  public:
+    vector <uint64_t> keys, values;
+    vector <uint8_t> valid;
+    uint64_t occupancy, mask;
+
+    HASH_TABLE() {
+        resize(HASH_TABLE_MIN_SIZE);
+    };
+
+    // find() returns NULL when the key is not there
+    uint64_t *find(uint64_t key),
+             *insert(uint64_t key, uint64_t value);
+    void erase(uint64_t key),
+         clear(),
+         resize(uint64_t size),
+         swap(HASH_TABLE &other);
+    uint64_t size() { return occupancy; };
+};
+
+#endif
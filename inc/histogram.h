@@ -0,0 +1,29 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "champsim.h"
+
+// log-bucketed latency histogram
+// latencies below 8 cycles get a bucket each, every power of two above is split into 8 buckets,
+// so a percentile is exact for short latencies and within 12.5% for long ones
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS (64*HISTOGRAM_SUB_BUCKETS)
+
+class LATENCY_HISTOGRAM {
+  public:
+    uint64_t count,
+             bucket[HISTOGRAM_BUCKETS];
+
+    LATENCY_HISTOGRAM() {
+        clear();
+    };
+
+    void clear(),
+         add(uint64_t latency);
+
+    // highest latency in the bucket that holds the given fraction (0.5 for p50) of the samples
+    uint64_t percentile(double fraction);
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef INTERCONNECT_H
+#define INTERCONNECT_H
+
+#include "cache.h"
+
+#include <deque>
+
+// on-chip network between the L2Cs and the LLC ([NOC] in -config)
+// there is one node per core or LLC slice, whichever there are more of. core i and slice s sit on
+// nodes spread evenly over them, a ring routes the short way round, a mesh routes X first, then Y
+// every directed link moves one packet at a time, a packet takes one flit for its header plus
+// BLOCK_SIZE/link_width flits if it carries a block, and needs hop_latency cycles per hop on top
+// each link has a queue of link_queue packets per class, requests and responses never wait behind
+// each other, so a full LLC RQ cannot keep the data it returns from getting out
+// the last hop of every route is the port of the node itself, which hands the packet to the LLC or L2C
+#define NOC_NONE 0
+#define NOC_RING 1
+#define NOC_MESH 2
+
+#define NOC_REQUEST  0
+#define NOC_RESPONSE 1
+#define NOC_CLASSES  2
+
+extern uint8_t NOC_TOPOLOGY;
+extern uint32_t NOC_HOP_LATENCY, NOC_LINK_WIDTH, NOC_LINK_QUEUE;
+
+class NOC_PACKET {
+  public:
+    PACKET packet;
+    uint64_t ready_cycle, // cycle the packet can take its next hop
+             inject_cycle;
+    uint32_t dest,
+             flits,
+             hops;
+    uint8_t queue_type; // 1: RQ, 2: WQ, 3: PQ, as in get_occupancy(), 0: data returned to an L2C
+};
+
+class NOC_LINK {
+  public:
+    deque <NOC_PACKET> queue[NOC_CLASSES];
+    uint32_t node;      // node it leads to, the node itself for the ejection port
+    uint64_t busy_cycle; // free again from this cycle on
+
+    // stats
+    uint64_t packets, flits, stall;
+
+    NOC_LINK() {
+        node = 0;
+        busy_cycle = 0;
+
+        packets = 0;
+        flits = 0;
+        stall = 0;
+    };
+};
+
+class INTERCONNECT;
+
+// what the L2C of one core sees as its lower level and the LLC as its upper level
+class NOC_PORT : public MEMORY {
+  public:
+    uint32_t cpu;
+    INTERCONNECT *noc;
+
+    NOC_PORT() {
+        cpu = 0;
+        noc = NULL;
+        lower_level = NULL;
+        for (uint32_t i=0; i<NUM_CPUS; i++) {
+            upper_level_icache[i] = NULL;
+            upper_level_dcache[i] = NULL;
+        }
+    };
+
+    // functions
+    int  add_rq(PACKET *packet),
+         add_wq(PACKET *packet),
+         add_pq(PACKET *packet);
+    void return_data(PACKET *packet),
+         operate(),
+         increment_WQ_FULL(uint64_t address),
+         functional_access(PACKET *packet);
+    uint32_t get_occupancy(uint8_t queue_type, uint64_t address),
+             get_size(uint8_t queue_type, uint64_t address),
+             get_queue_id(uint8_t queue_type, uint64_t address);
+    uint64_t get_next_event_cycle();
+    uint8_t invalidate_line(uint64_t address);
+};
+
+class INTERCONNECT {
+  public:
+    uint8_t topology;
+    uint32_t num_nodes,
+             rows, columns, // mesh only, nodes past num_nodes only route
+             num_ports, // per node, the last one is the ejection port
+             hop_latency,
+             link_width,
+             link_queue;
+    vector <NOC_LINK> link;
+    CACHE *llc;
+    NOC_PORT port[NUM_CPUS];
+    uint64_t in_flight;
+
+    // stats
+    uint64_t packets[NOC_CLASSES], flits[NOC_CLASSES], hops[NOC_CLASSES], total_latency[NOC_CLASSES];
+
+    INTERCONNECT() {
+        topology = NOC_NONE;
+        num_nodes = 1;
+        rows = 1;
+        columns = 1;
+        num_ports = 1;
+        hop_latency = 1;
+        link_width = BLOCK_SIZE;
+        link_queue = 1;
+        llc = NULL;
+        in_flight = 0;
+
+        reset_stats();
+    };
+
+    // functions
+    void configure(uint8_t v1, uint32_t v2, uint32_t v3, uint32_t v4, CACHE *v5),
+         operate(),
+         reset_stats();
+    uint64_t get_next_event_cycle();
+
+    uint32_t core_node(uint32_t cpu),
+             slice_node(uint64_t address),
+             next_link(uint32_t node, uint32_t dest);
+    int  inject(NOC_PACKET *packet, uint32_t node, uint8_t noc_class);
+    NOC_LINK *first_link(uint32_t cpu, uint64_t address);
+    uint8_t deliver(NOC_PACKET *packet);
+};
+
+#endif
@@ -27,6 +27,10 @@
 
 #define BAD_MAX 7
 
+// prefetches one trigger may queue up (lookahead depth), fixed at compile time
+// an L2C MSHR size set with -config does not change it
+#define L2_PF_DEPTH L2C_MSHR_SIZE
+
 class SIGNATURE_TABLE {
   public:
 
@@ -12,12 +12,26 @@
 #define LPM_ACCESS_END 1
 #define LPM_ACCESS_END_EXTEND 2
 
+// hit/miss accesses in flight, or the change in them at some cycle
 struct cycle_stat_t 
 {
 	int hit_count;
 	int miss_count;
 };
 
+// the LPM of one level is computed online: the accesses in flight change only at the cycles in pending,
+// the cycles up to counted_cycle are already sorted into pure hit, pure miss and mixed cycles
+// it holds one entry per access still in flight, however long the window is
+struct level_stat_t
+{
+	struct cycle_stat_t in_flight; // at counted_cycle
+	map<uint64_t, struct cycle_stat_t> pending;
+	uint64_t counted_cycle;
+	uint64_t pure_hit;
+	uint64_t pure_miss;
+	uint64_t mix;
+};
+
 class LPM
 {
 public:
@@ -36,6 +50,7 @@ public:
 	void set_cycle_count(int new_cycle_count){cout<<"cycle count="<<new_cycle_count; cycle_count = new_cycle_count;};
 	void set_last_inst_num(int inst_num){last_inst_num = inst_num;};
 	void set_window_width(uint64_t new_window_width);
+	void set_print_detail(bool new_print_detail){print_detail = new_print_detail;};
 
 private:
 	int cache_level_count; 
@@ -59,7 +74,11 @@ private:
 	uint64_t window_start_cycle;
 	uint64_t window_width;
 
-	struct cycle_stat_t** cycle_stat; 
+	bool print_detail; // print the cycle counts on every update_lpmr()
+
+	struct level_stat_t* level_stat;
+
+	void advance(int cache_level, uint64_t cycle); // classify the cycles before cycle
 
 	void _destroy_lpm(); // WARNING: THIS FUNCTION WILL DELETE ALL DATA IN LPM.
 };
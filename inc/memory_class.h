@@ -3,6 +3,8 @@
 
 #include "champsim.h"
 #include "block.h"
+#include "checkpoint.h"
+#include "histogram.h"
 
 // CACHE ACCESS TYPE
 #define LOAD      0
@@ -23,7 +25,7 @@ class MEMORY {
     MEMORY *upper_level_icache[NUM_CPUS], *upper_level_dcache[NUM_CPUS], *lower_level, *extra_interface;
 
     // empty queues
-    PACKET_QUEUE WQ{"EMPTY", 1}, RQ{"EMPTY", 1}, PQ{"EMPTY", 1}, MSHR{"EMPTY", 1};
+    PACKET_QUEUE WQ{"EMPTY", 1, QUEUE_INDEX_NONE}, RQ{"EMPTY", 1, QUEUE_INDEX_NONE}, PQ{"EMPTY", 1, QUEUE_INDEX_NONE}, MSHR{"EMPTY", 1, QUEUE_INDEX_NONE};
 
     // functions
     virtual int  add_rq(PACKET *packet) = 0;
@@ -34,6 +36,13 @@ class MEMORY {
     virtual void increment_WQ_FULL(uint64_t address) = 0;
     virtual uint32_t get_occupancy(uint8_t queue_type, uint64_t address) = 0;
     virtual uint32_t get_size(uint8_t queue_type, uint64_t address) = 0;
+    // which queue of queue_type address goes to, get_occupancy() and get_size() are the ones of that queue
+    virtual uint32_t get_queue_id(uint8_t queue_type, uint64_t address) { return 0; };
+    virtual uint64_t get_next_event_cycle() = 0; // earliest cycle operate() may change any state
+    virtual void functional_access(PACKET *packet) = 0; // untimed access used by the functional warmup
+
+    // an inclusive level below evicted address: drop it here and above, return whether a copy was dirty
+    virtual uint8_t invalidate_line(uint64_t address) { return 0; };
 
     // stats
     uint64_t ACCESS[NUM_TYPES], HIT[NUM_TYPES], MISS[NUM_TYPES], MSHR_MERGED[NUM_TYPES], STALL[NUM_TYPES];
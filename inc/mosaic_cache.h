@@ -7,18 +7,27 @@
 // 		2-2 set_writeback_mode()
 // 		2-3 set_delta()
 // 		2-4 set_check_period()
-// 		2-5 set_mosaic_cache_info() (you can only reset adaptive info with set_adaptive())
-// 		2-6 init_mosaic_cache()
+// 		2-5 set_partition_mode()
+// 		2-6 set_drain_rate()
+// 		2-7 set_mosaic_cache_info() (you can only reset adaptive info with set_adaptive())
+// 		2-8 init_mosaic_cache()
 // STEP 3: get information for host simulator initilization with get_max_way_num()
 // STEP 4: register cache accesses during the runtime, using access_reg()
 // STEP 5: dynamic way information for each cache access by using get_current_way_num(), 
-// 		   get_current_way_start_pos() or get_current_way_end_pos().
+// 		   get_current_way_start_pos() or get_current_way_end_pos(). every core has its own
+// 		   way window, the getters without a core give the ways any core uses.
 // STEP 6: Periodically check the mode of mosaic cache
 // 	 	6-1 For motivation mode, periodically output the lpmr by using get_lpmr(); 
 // 	 	6-2 For other modes, check if the mosaic cache needs reconfig by using need_check(), if the 
-// 	 		return is true, use reconfig(). As the return of reconfig() is true, issue writebacks 
-// 	 		according to the return of get_writeback_mode(), and then register the writebacks with
-// 	 		add_writeback().
+// 	 		return is true, update the lpmr of every core with update_lpmr() and use reconfig().
+// 	 		As the return of reconfig() is true, issue writebacks for every core with a
+// 	 		get_last_operation() according to the return of get_writeback_mode(), and then
+// 	 		register the writebacks with add_writeback() (and the moved lines with add_migration()
+// 	 		in migrate mode), or undo the core with RollBack().
+// 	 	6-3 With a drain rate, a core whose ways are not clean is put off with Defer() instead,
+// 	 		the host writes back the ways get_pending_operation() gives away a few lines a cycle
+// 	 		and calls Commit() once they are clean, or CancelPending() if they are not by the
+// 	 		next check.
 // STEP 7: periodically check if the mosaic cache requires to forward the stat window with need_forward(),
 // 		   if the return is true, call forward_window()
 // STEP 8: output the statistics with print_statistics()
@@ -31,6 +40,7 @@
 
 #include "lpm.h"
 #include <iostream>
+#include <string>
 
 struct mosaic_cache_info_t
 {
@@ -59,6 +69,8 @@ public:
 	bool set_writeback_mode(int new_mode);
 	void set_delta(float new_delta);
 	void set_check_period(uint64_t new_check_period);
+	bool set_partition_mode(int new_mode);
+	bool set_drain_rate(int new_rate);
 
 	bool set_mosaic_cache_info(int cache_level, int way_num, int adaptive_way_num, int ratio, int reconfig_threshold, int latency);
 	bool set_adaptive(int cache_level, int new_adaptive_way_num, int reconfig_threshold);
@@ -67,10 +79,24 @@ public:
 	void forward_window(uint64_t current_cycle);
 	void set_last_inst_num(int core_id, uint64_t inst_num);
 
-	int get_last_operation(){return last_operation;};
+	int get_last_operation(int core_id){return last_operation[core_id];};
+	void clear_last_operation();
 	
-	bool RollBack();
-
+	bool RollBack(int core_id);
+
+	// drain engine, a pending reconfig has not given its ways away yet
+	bool Defer(int core_id);
+	bool Commit(int core_id);
+	void CancelPending(int core_id);
+	int get_pending_operation(int core_id){return pending_operation[core_id];};
+	bool has_pending();
+	int get_pending_way_start_pos(int core_id, int cache_level);
+	int get_pending_way_end_pos(int core_id, int cache_level);
+
+	int get_current_way_num(int core_id, int cache_level);
+	int get_current_way_start_pos(int core_id, int cache_level);
+	int get_current_way_end_pos(int core_id, int cache_level);
+	// the ways used by any core
 	int get_current_way_num(int cache_level);
 	int get_current_way_start_pos(int cache_level);
 	int get_current_way_end_pos(int cache_level);
@@ -78,11 +104,14 @@ public:
 	int get_max_way_num(int cache_level);
 	int get_writeback_mode(){return writeback_mode;};
 	int get_work_mode(){return work_mode;};
+	int get_partition_mode(){return partition_mode;};
+	int get_drain_rate(){return drain_rate;};
 	uint64_t get_last_check_cycle(){return last_check_cycle;};
 
-	int get_hit_latency(int cache_level_idx){return mosaic_cache_info[cache_level_idx].latency;};
+	int get_hit_latency(int cache_level_idx){return mosaic_cache_info[0][cache_level_idx].latency;};
 
 	bool need_check(uint64_t current_cycle);
+	uint64_t get_next_check_cycle();
 	bool need_forward(uint64_t current_cycle);
 
 	bool reconfig(uint64_t current_cycle); 
@@ -90,10 +119,13 @@ public:
 	bool access_reg(int core_id, int cache_level, uint64_t event_cycle, int type);
 	
 	float get_lpmr(int core_id, int cache_level, int inst_num, uint64_t current_cycle);
+	void update_lpmr(int core_id, int inst_num, uint64_t current_cycle);
 
 	// for statistics
 	void add_writeback(int core_id, int cache_level, int writeback_count);
+	void add_migration(int core_id, int cache_level, int migration_count);
 	void print_statistics();
+	std::string json_statistics(); // the same counters as one JSON object, for -json_stats
 
 private:
 	LPM* lpm_monitor;
@@ -106,9 +138,11 @@ private:
 
 	uint64_t last_check_cycle;
 
-	struct mosaic_cache_info_t *mosaic_cache_info;
+	struct mosaic_cache_info_t **mosaic_cache_info; // [core][cache level]
 	// for rollback
-	struct mosaic_cache_info_t *cache_info_snapshot;
+	struct mosaic_cache_info_t **cache_info_snapshot;
+	// the reconfigs waiting for their ways to be clean
+	struct mosaic_cache_info_t **pending_cache_info;
 
 	// mosaic cache configuration
 	
@@ -127,29 +161,44 @@ private:
 					// 4: for l1-l2-l3
 
 	int writeback_mode;	// 0: directly writeback, 1: non-writeback
+						// 2: migrate, the lines move to the level taking the ways, the rest is written back
+
+	int partition_mode;	// 0: all cores vote, and every core's ways move together
+						// 1: every core moves its own ways on its own lpmr, 
+						//    L1/L2 ways are private, L3 ways are a share of the LLC
+
+	int drain_rate;	// 0: the lower level takes all dirty lines at once, or the reconfig is rolled back
+					// n: the dirty lines are written back n a cycle, the ways move once they are clean
 
-	bool _reconfig_l1_to_l2();
-	bool _reconfig_l2_to_l1();
-	bool _reconfig_l2_to_l3();
-	bool _reconfig_l3_to_l2(); 
+	// the cores [first_core, last_core) have the same ways and reconfig together
+	bool _reconfig_cores(int first_core, int last_core);
+	bool _reconfig_l1_to_l2(int first_core, int last_core);
+	bool _reconfig_l2_to_l1(int first_core, int last_core);
+	bool _reconfig_l2_to_l3(int first_core, int last_core);
+	bool _reconfig_l3_to_l2(int first_core, int last_core); 
 
 	// for rollback
-	void _snapshot();
-	int last_operation;	// the last operation type
+	void _snapshot(int core_id);
+	int* last_operation;	// the last operation type of every core
 						// 0: none
 						// 1: l1 to l2
 						// 2: l2 to l1
 						// 3: l2 to l3
 						// 4: l3 to l2
+	int* pending_operation;	// the same for the pending reconfigs
 
 	// for statistics
 	int** _writeback_counter;
 	int _total_writeback_counter;
+	int** _migration_counter;
+	int _total_migration_counter;
 	int _l1_to_l2_counter;
 	int _l2_to_l3_counter;
 	int _l2_to_l1_counter;
 	int _l3_to_l2_counter;
 	int _total_reconfig_counter;
+	int _drained_reconfig_counter;
+	int _cancelled_reconfig_counter;
 };
 
 // Mosaic_Cache& Get_Instance()
@@ -2,6 +2,7 @@
 #define OOO_CPU_H
 
 #include "cache.h"
+#include "trace_reader.h"
 
 #ifdef CRC2_COMPILE
 #define STAT_PRINTING_PERIOD 1000000
@@ -13,14 +14,15 @@
 using namespace std;
 
 // CORE PROCESSOR
-#define FETCH_WIDTH 12
-#define DECODE_WIDTH 6
-#define EXEC_WIDTH 6
-#define LQ_WIDTH 42
-#define SQ_WIDTH 2
-#define RETIRE_WIDTH 4
-#define SCHEDULER_SIZE 128
-#define BRANCH_MISPREDICT_PENALTY 4
+// widths are set at runtime (-config), the defaults are in ooo_cpu.cc
+//#define FETCH_WIDTH 12
+//#define DECODE_WIDTH 6
+//#define EXEC_WIDTH 6
+//#define LQ_WIDTH 42
+//#define SQ_WIDTH 2
+//#define RETIRE_WIDTH 4
+//#define SCHEDULER_SIZE 128
+//#define BRANCH_MISPREDICT_PENALTY 4
 //#define SCHEDULING_LATENCY 0
 //#define EXEC_LATENCY 0
 //#define DECODE_LATENCY 2
@@ -28,6 +30,8 @@ using namespace std;
 #define STA_SIZE (ROB_SIZE*NUM_INSTR_DESTINATIONS_SPARC)
 
 extern uint32_t SCHEDULING_LATENCY, EXEC_LATENCY, DECODE_LATENCY;
+extern uint32_t FETCH_WIDTH, DECODE_WIDTH, EXEC_WIDTH, LQ_WIDTH, SQ_WIDTH, RETIRE_WIDTH,
+                SCHEDULER_SIZE, BRANCH_MISPREDICT_PENALTY;
 
 // cpu
 class O3_CPU {
@@ -35,20 +39,23 @@ class O3_CPU {
     uint32_t cpu;
 
     // trace
-    FILE *trace_file;
+    TRACE_READER trace_reader;
     char trace_string[1024];
-    char gunzip_command[1024];
 
     // instruction
     input_instr next_instr;
     input_instr current_instr;
     cloudsuite_instr current_cloudsuite_instr;
+    // functional warmup reads one cloudsuite record ahead for the branch target, the timed model takes it first
+    cloudsuite_instr next_cloudsuite_instr;
+    uint8_t cloudsuite_held;
     uint64_t instr_unique_id, completed_executions, 
              begin_sim_cycle, begin_sim_instr, 
              last_sim_cycle, last_sim_instr,
              finish_sim_cycle, finish_sim_instr,
              warmup_instructions, simulation_instructions, instrs_to_read_this_cycle, instrs_to_fetch_this_cycle,
-             next_print_instruction, num_retired;
+             next_print_instruction, num_retired,
+             last_functional_fetch;
     uint32_t inflight_reg_executions, inflight_mem_executions, num_searched;
     uint32_t next_ITLB_fetch;
 
@@ -96,9 +103,6 @@ class O3_CPU {
     O3_CPU() {
         cpu = 0;
 
-        // trace
-        trace_file = NULL;
-
         // instruction
         instr_unique_id = 0;
         completed_executions = 0;
@@ -115,6 +119,8 @@ class O3_CPU {
 
         next_print_instruction = STAT_PRINTING_PERIOD;
         num_retired = 0;
+        last_functional_fetch = 0;
+        cloudsuite_held = 0;
 
         inflight_reg_executions = 0;
         inflight_mem_executions = 0;
@@ -191,7 +197,8 @@ class O3_CPU {
          complete_instr_fetch(PACKET_QUEUE *queue, uint8_t is_it_tlb),
          complete_data_fetch(PACKET_QUEUE *queue, uint8_t is_it_tlb);
 
-    void initialize_core();
+    void initialize_core(),
+         operate();
     void add_load_queue(uint32_t rob_index, uint32_t data_index),
          add_store_queue(uint32_t rob_index, uint32_t data_index),
          execute_store(uint32_t rob_index, uint32_t sq_index, uint32_t data_index);
@@ -200,6 +207,13 @@ class O3_CPU {
     void operate_cache();
     void update_rob();
     void retire_rob();
+    uint64_t get_next_event_cycle();
+
+    // functional warmup
+    void functional_step(),
+         functional_data_access(ooo_model_instr *arch_instr, uint64_t virtual_address, uint8_t type);
+
+    void checkpoint();
 
     uint32_t  add_to_rob(ooo_model_instr *arch_instr),
               check_rob(uint64_t instr_id);
@@ -212,7 +226,8 @@ class O3_CPU {
     // branch predictor
     uint8_t predict_branch(uint64_t ip);
     void    initialize_branch_predictor(),
-            last_branch_result(uint64_t ip, uint8_t taken);
+            last_branch_result(uint64_t ip, uint8_t taken),
+            branch_predictor_checkpoint();
 
   // code prefetching
   void l1i_prefetcher_initialize();
@@ -221,6 +236,7 @@ class O3_CPU {
   void l1i_prefetcher_cycle_operate();
   void l1i_prefetcher_cache_fill(uint64_t v_addr, uint32_t set, uint32_t way, uint8_t prefetch, uint64_t evicted_v_addr);
   void l1i_prefetcher_final_stats();
+  void l1i_prefetcher_checkpoint();
   int prefetch_code_line(uint64_t pf_v_addr); 
 };
 
@@ -0,0 +1,28 @@
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+#include "hash_table.h"
+
+// a mapped physical page, frames are handed out in allocation order and reused on a swap
+class PAGE_FRAME {
+  public:
+    uint64_t vpage,
+             ppage;
+    uint8_t referenced; // set on every translation, cleared as the clock hand passes
+
+    PAGE_FRAME(uint64_t v, uint64_t p) {
+        vpage = v;
+        ppage = p;
+        referenced = 0;
+    };
+};
+
+// page_table maps a vpage to its index in page_frames, inverse_table a ppage to its vpage
+extern HASH_TABLE page_table, inverse_table, unique_cl[NUM_CPUS];
+extern vector <PAGE_FRAME> page_frames;
+extern uint64_t clock_hand;
+
+// clock (second chance) search for a page that was not used since the hand last passed it
+uint64_t find_victim_frame();
+
+#endif
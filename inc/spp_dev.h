@@ -14,6 +14,10 @@
 #define SPP_DP(x)
 #endif
 
+// Prefetch candidates of one trigger, lookahead included, fixed at compile time
+// an L2C MSHR size set with -config does not change it
+#define PF_QUEUE_SIZE L2C_MSHR_SIZE
+
 // Signature table parameters
 #define ST_SET 1
 #define ST_WAY 256
@@ -55,6 +59,7 @@ class SIGNATURE_TABLE {
              last_offset[ST_SET][ST_WAY],
              sig[ST_SET][ST_WAY],
              lru[ST_SET][ST_WAY];
+    uint32_t cpu; // whose GHR to use
 
     SIGNATURE_TABLE() {
         cout << "Initialize SIGNATURE TABLE" << endl;
@@ -71,6 +76,7 @@ class SIGNATURE_TABLE {
                 sig[set][way] = 0;
                 lru[set][way] = way;
             }
+        cpu = 0;
     };
 
     void read_and_update_sig(uint64_t page, uint32_t page_offset, uint32_t &last_sig, uint32_t &curr_sig, int32_t &delta);
@@ -81,6 +87,7 @@ class PATTERN_TABLE {
     int      delta[PT_SET][PT_WAY];
     uint32_t c_delta[PT_SET][PT_WAY],
              c_sig[PT_SET];
+    uint32_t cpu; // whose GHR to use
 
     PATTERN_TABLE() {
         cout << endl << "Initialize PATTERN TABLE" << endl;
@@ -97,6 +104,7 @@ class PATTERN_TABLE {
             }
             c_sig[set] = 0;
         }
+        cpu = 0;
     }
 
     void update_pattern(uint32_t last_sig, int curr_delta),
@@ -108,6 +116,7 @@ class PREFETCH_FILTER {
     uint64_t remainder_tag[FILTER_SET];
     bool     valid[FILTER_SET],  // Consider this as "prefetched"
              useful[FILTER_SET]; // Consider this as "used"
+    uint32_t cpu; // whose GHR to use
 
     PREFETCH_FILTER() {
         cout << endl << "Initialize PREFETCH FILTER" << endl;
@@ -118,6 +127,7 @@ class PREFETCH_FILTER {
             valid[set] = 0;
             useful[set] = 0;
         }
+        cpu = 0;
 
     }
 
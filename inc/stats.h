@@ -0,0 +1,24 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "champsim.h"
+
+// time series of the simulator counters (-stats_file FILE)
+// every -stats_interval cycles of CPU 0 (or retired instructions of all cores with -stats_instructions)
+// one CSV row is written with the cycle, the retired instructions and whether warmup is still running,
+// followed by every counter of the cores, caches, DRAM channels and the Mosaic way counts
+// counters hold the change since the previous row, the Mosaic way counts are the current value
+// the counters reset at the end of warmup start over from there, a last row covers the tail of the run
+extern uint64_t stats_interval;
+extern uint8_t stats_instructions;
+
+void open_stats(const char *name),
+     sample_stats(uint8_t force),
+     rebase_stats(),
+     close_stats();
+
+// end-of-run report as one JSON document (-json_stats FILE): config, per-core IPC, branch and ROI cache
+// counters with their latency percentiles, DRAM and Mosaic stats, a ratio with nothing to divide by is null
+void write_json_stats(const char *name);
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef TRACE_READER_H
+#define TRACE_READER_H
+
+#include "champsim.h"
+
+#include <zlib.h>
+#include <lzma.h>
+#ifdef ZSTD_TRACE
+#include <zstd.h>
+#endif
+
+#include <thread>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// in-process trace decompression
+// compressed input is read from the file in big chunks and decoded into a large
+// output buffer, instructions are then handed out from that buffer in batches
+#define TRACE_INPUT_SIZE  (1<<18)
+#define TRACE_OUTPUT_SIZE (1<<20)
+
+// with prefetch on, a producer thread decodes ahead into a ring of output blocks
+// one block is held by the reader, the rest can be filled in the background
+// an empty block marks the end of the trace, the producer then starts over from the top
+#define TRACE_PREFETCH_BLOCKS 8
+
+#define TRACE_FORMAT_NONE 0
+#define TRACE_FORMAT_GZIP 1
+#define TRACE_FORMAT_XZ   2
+#define TRACE_FORMAT_ZSTD 3
+#define TRACE_FORMAT_BIN  4
+
+// uncompressed .champsim.bin traces are mapped into memory as a whole
+// packed input_instr (or cloudsuite_instr) records follow right after the header
+#define TRACE_BIN_MAGIC   "CHAMPBIN"
+#define TRACE_BIN_VERSION 1
+
+class trace_bin_header {
+  public:
+    char magic[8];
+    uint32_t version,
+             record_size;
+    uint64_t instr_count;
+    uint8_t cloudsuite;
+    uint8_t reserved[39]; // 64 bytes, so the records stay aligned
+};
+
+// sidecar index (<trace>.idx) of a block-compressed trace
+// every block is an independent xz stream, so the trace still decodes as a whole
+// block i starts with instruction i*records_per_block at byte block_offset[i] of the trace
+#define TRACE_INDEX_MAGIC   "CHAMPIDX"
+#define TRACE_INDEX_VERSION 1
+
+class trace_index_header {
+  public:
+    char magic[8];
+    uint32_t version,
+             record_size;
+    uint64_t records_per_block,
+             num_blocks;
+};
+
+class TRACE_READER {
+  public:
+    char file_name[1024];
+    uint8_t format;
+
+    FILE *file;
+
+    // .champsim.bin only
+    trace_bin_header bin_header;
+    uint8_t *map_base;
+    size_t map_size;
+
+    // compressed bytes read from the file
+    uint8_t *in_buffer;
+    // decompressed bytes that have not been handed out yet live in read_buffer[out_head, out_tail)
+    // read_buffer is out_buffer, or the block currently held when prefetching
+    uint8_t *out_buffer, *read_buffer;
+    size_t out_head, out_tail;
+    // records handed out since the start of the trace file
+    uint64_t records_read;
+    uint8_t end_of_input, end_of_stream;
+    // gzip members decoded so far, anything but another member after one is trailing data
+    uint32_t gzip_members;
+
+    // background decoding (single producer, single consumer)
+    uint8_t prefetch, holding_block;
+    uint8_t *block_data[TRACE_PREFETCH_BLOCKS];
+    size_t block_size[TRACE_PREFETCH_BLOCKS];
+    atomic<uint32_t> block_head, block_tail;
+    atomic<bool> stop_producer;
+    thread producer;
+
+    z_stream gzip_stream;
+    lzma_stream xz_stream;
+#ifdef ZSTD_TRACE
+    ZSTD_DStream *zstd_stream;
+    ZSTD_inBuffer zstd_in;
+#endif
+
+    // constructor
+    TRACE_READER() {
+        file_name[0] = '\0';
+        format = TRACE_FORMAT_NONE;
+        file = NULL;
+
+        memset(&bin_header, 0, sizeof(bin_header));
+        map_base = NULL;
+        map_size = 0;
+
+        in_buffer = new uint8_t[TRACE_INPUT_SIZE];
+        out_buffer = new uint8_t[TRACE_OUTPUT_SIZE];
+        read_buffer = out_buffer;
+        out_head = 0;
+        out_tail = 0;
+        records_read = 0;
+        end_of_input = 0;
+        end_of_stream = 0;
+        gzip_members = 0;
+
+        prefetch = 0;
+        holding_block = 0;
+        for (uint32_t i=0; i<TRACE_PREFETCH_BLOCKS; i++) {
+            block_data[i] = NULL;
+            block_size[i] = 0;
+        }
+        block_head = 0;
+        block_tail = 0;
+        stop_producer = false;
+
+#ifdef ZSTD_TRACE
+        zstd_stream = NULL;
+#endif
+    };
+
+    // destructor
+    ~TRACE_READER() {
+        close();
+        delete[] in_buffer;
+        delete[] out_buffer;
+        for (uint32_t i=0; i<TRACE_PREFETCH_BLOCKS; i++)
+            delete[] block_data[i];
+    };
+
+    // functions
+    // open() returns -1 if the file cannot be opened or read, -2 if it is not a trace format we know
+    int open(const char *name),
+        rewind();
+
+    void close(),
+         start_prefetch(),
+         stop_prefetch();
+
+    // copies up to count whole records into buffer, returns the number of records copied
+    // 0 means the end of the trace has been reached
+    size_t read(void *buffer, size_t record_size, size_t count);
+
+    // positions the reader at record number instr, must be called before start_prefetch()
+    // uses the sidecar index when there is one, otherwise decodes and drops the prefix
+    // returns -1 if the trace is shorter than that
+    int seek(uint64_t instr, size_t record_size);
+
+  private:
+    uint8_t detect_format();
+    int map_file(),
+        find_block(uint64_t instr, size_t record_size, uint64_t *block_start, uint64_t *block_offset),
+        init_stream(),
+        restart_stream(),
+        next_block();
+    void end_stream(),
+         produce();
+    size_t decode(uint8_t *buffer, size_t size);
+};
+
+#endif
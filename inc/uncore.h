@@ -4,6 +4,7 @@
 #include "champsim.h"
 #include "cache.h"
 #include "dram_controller.h"
+#include "interconnect.h"
 //#include "drc_controller.h"
 
 //#define DRC_MSHR_SIZE 48
@@ -18,6 +19,9 @@ class UNCORE {
     // DRAM
     MEMORY_CONTROLLER DRAM{"DRAM"}; 
 
+    // network between the L2Cs and the LLC, only used with a [NOC] topology
+    INTERCONNECT NOC;
+
     UNCORE(); 
 };
 
@@ -29,3 +29,8 @@ void O3_CPU::l1i_prefetcher_final_stats()
 {
 
 }
+
+void O3_CPU::l1i_prefetcher_checkpoint()
+{
+
+}
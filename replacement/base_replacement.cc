@@ -21,29 +21,8 @@ uint32_t CACHE::lru_victim(uint32_t cpu, uint64_t instr_id, uint32_t set, const
 {
     // zmz modify (STEP 5)
     //Mosaic_Cache Mosaic_Cache_Monitor=Get_Instance();
-    int current_way_start_pos=0, current_way_end_pos=NUM_WAY;
-    if(Mosaic_Cache_Monitor.get_work_mode() != 0)
-    {
-        switch(cache_type)
-        {
-            case IS_L1D:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L1);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L1);
-                break;
-            case IS_L2C:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L2);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L2);
-                break;
-            case IS_LLC:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L3);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
-                break;
-            default:
-                current_way_start_pos = 0;
-                current_way_end_pos = NUM_WAY;
-                break;
-        }
-    }
+    int current_way_start_pos, current_way_end_pos;
+    mosaic_cache_get_window(cpu, &current_way_start_pos, &current_way_end_pos);
 
     //uint32_t way = 0;
     uint32_t way = current_way_start_pos;
@@ -84,6 +63,19 @@ uint32_t CACHE::lru_victim(uint32_t cpu, uint64_t instr_id, uint32_t set, const
         }
     }
 
+    // a core's ways of the LLC may not hold the LRU block of the set, take the least recent one they have
+    if ((int)way == current_way_end_pos)
+    {
+        int lru_way = current_way_start_pos;
+        for (int i=current_way_start_pos+1; i<current_way_end_pos; i++)
+        {
+            if (block[set][i].lru > block[set][lru_way].lru)
+                lru_way = i;
+        }
+        if (lru_way < current_way_end_pos)
+            way = lru_way;
+    }
+
     //if (way == NUM_WAY)
     if (way == current_way_end_pos)
     {
@@ -98,34 +90,13 @@ void CACHE::lru_update(uint32_t set, uint32_t way)
 {
     // zmz modify (STEP 5)
     //Mosaic_Cache Mosaic_Cache_Monitor=Get_Instance();
-    int current_way_start_pos=0, current_way_end_pos=NUM_WAY;
-    if(Mosaic_Cache_Monitor.get_work_mode() != 0)
-    {
-        switch(cache_type)
-        {
-            case IS_L1D:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L1);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L1);
-                break;
-            case IS_L2C:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L2);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L2);
-                break;
-            case IS_LLC:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L3);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
-                break;
-            default:
-                current_way_start_pos = 0;
-                current_way_end_pos = NUM_WAY;
-                break;
-        }
-    }
+    int current_way_start_pos, current_way_end_pos;
+    mosaic_cache_get_window(-1, &current_way_start_pos, &current_way_end_pos);
 
     // zmz modify
     // update lru replacement state
     //for (uint32_t i=0; i<NUM_WAY; i++) 
-    for (uint32_t i=current_way_start_pos; i<current_way_end_pos; i++)
+    for (int i=current_way_start_pos; i<current_way_end_pos; i++)
     {
         if (block[set][i].lru < block[set][way].lru) 
         {
@@ -51,3 +51,8 @@ void CACHE::llc_replacement_final_stats()
 {
 
 }
+
+void CACHE::llc_replacement_checkpoint()
+{
+    // LRU state lives in the blocks
+}
@@ -1,76 +1,57 @@
 #include "block.h"
 
+uint64_t PACKET_QUEUE::index_key(PACKET *packet)
+{
+    // stores to different words of a line stay separate in the L1D write queue
+    if (index_type == QUEUE_INDEX_FULL_ADDR)
+        return packet->full_addr;
+
+    return packet->address;
+}
+
+// call once entry[slot] holds the new packet
+void PACKET_QUEUE::add_index(uint32_t slot)
+{
+    if (index_type == QUEUE_INDEX_NONE)
+        return;
+
+#ifdef SANITY_CHECK
+    // the callers merge duplicates, so a key is never queued twice
+    if (index.find(index_key(&entry[slot])))
+        assert(0);
+#endif
+
+    index.insert(index_key(&entry[slot]), slot);
+}
+
+// twice the queue size keeps the probe sequences short without a table much larger than the queue
+void PACKET_QUEUE::resize_index()
+{
+    uint64_t size = 16;
+    while (size < 2*(uint64_t)SIZE)
+        size <<= 1;
+
+    index.clear();
+    index.resize(size);
+}
+
 int PACKET_QUEUE::check_queue(PACKET *packet)
 {
-    if ((head == tail) && occupancy == 0)
+#ifdef SANITY_CHECK
+    if (index_type == QUEUE_INDEX_NONE)
+        assert(0);
+#endif
+
+    uint64_t *slot = index.find(index_key(packet));
+    if (slot == NULL)
         return -1;
 
-    if (head < tail) {
-        for (uint32_t i=head; i<tail; i++) {
-            if (NAME == "L1D_WQ") {
-                if (entry[i].full_addr == packet->full_addr) {
-                    DP (if (warmup_complete[packet->cpu]) {
-                    cout << "[" << NAME << "] " << __func__ << " cpu: " << packet->cpu << " instr_id: " << packet->instr_id << " same address: " << hex << packet->address;
-                    cout << " full_addr: " << packet->full_addr << dec << " by instr_id: " << entry[i].instr_id << " index: " << i;
-                    cout << " cycle " << packet->event_cycle << endl; });
-                    return i;
-                }
-            }
-            else {
-                if (entry[i].address == packet->address) {
-                    DP (if (warmup_complete[packet->cpu]) {
-                    cout << "[" << NAME << "] " << __func__ << " cpu: " << packet->cpu << " instr_id: " << packet->instr_id << " same address: " << hex << packet->address;
-                    cout << " full_addr: " << packet->full_addr << dec << " by instr_id: " << entry[i].instr_id << " index: " << i;
-                    cout << " cycle " << packet->event_cycle << endl; });
-                    return i;
-                }
-            }
-        }
-    }
-    else {
-        for (uint32_t i=head; i<SIZE; i++) {
-            if (NAME == "L1D_WQ") {
-                if (entry[i].full_addr == packet->full_addr) {
-                    DP (if (warmup_complete[packet->cpu]) {
-                    cout << "[" << NAME << "] " << __func__ << " cpu: " << packet->cpu << " instr_id: " << packet->instr_id << " same address: " << hex << packet->address;
-                    cout << " full_addr: " << packet->full_addr << dec << " by instr_id: " << entry[i].instr_id << " index: " << i;
-                    cout << " cycle " << packet->event_cycle << endl; });
-                    return i;
-                }
-            }
-            else {
-                if (entry[i].address == packet->address) {
-                    DP (if (warmup_complete[packet->cpu]) {
-                    cout << "[" << NAME << "] " << __func__ << " cpu: " << packet->cpu << " instr_id: " << packet->instr_id << " same address: " << hex << packet->address;
-                    cout << " full_addr: " << packet->full_addr << dec << " by instr_id: " << entry[i].instr_id << " index: " << i;
-                    cout << " cycle " << packet->event_cycle << endl; });
-                    return i;
-                }
-            }
-        }
-        for (uint32_t i=0; i<tail; i++) {
-            if (NAME == "L1D_WQ") {
-                if (entry[i].full_addr == packet->full_addr) {
-                    DP (if (warmup_complete[packet->cpu]) {
-                    cout << "[" << NAME << "] " << __func__ << " cpu: " << packet->cpu << " instr_id: " << packet->instr_id << " same address: " << hex << packet->address;
-                    cout << " full_addr: " << packet->full_addr << dec << " by instr_id: " << entry[i].instr_id << " index: " << i;
-                    cout << " cycle " << packet->event_cycle << endl; });
-                    return i;
-                }
-            }
-            else {
-                if (entry[i].address == packet->address) {
-                    DP (if (warmup_complete[packet->cpu]) {
-                    cout << "[" << NAME << "] " << __func__ << " cpu: " << packet->cpu << " instr_id: " << packet->instr_id << " same address: " << hex << packet->address;
-                    cout << " full_addr: " << packet->full_addr << dec << " by instr_id: " << entry[i].instr_id << " index: " << i;
-                    cout << " cycle " << packet->event_cycle << endl; });
-                    return i;
-                }
-            }
-        }
-    }
-
-    return -1;
+    DP (if (warmup_complete[packet->cpu]) {
+    cout << "[" << NAME << "] " << __func__ << " cpu: " << packet->cpu << " instr_id: " << packet->instr_id << " same address: " << hex << packet->address;
+    cout << " full_addr: " << packet->full_addr << dec << " by instr_id: " << entry[*slot].instr_id << " index: " << *slot;
+    cout << " cycle " << packet->event_cycle << endl; });
+
+    return *slot;
 }
 
 void PACKET_QUEUE::add_queue(PACKET *packet)
@@ -82,6 +63,7 @@ void PACKET_QUEUE::add_queue(PACKET *packet)
 
     // add entry
     entry[tail] = *packet;
+    add_index(tail);
 
     DP ( if (warmup_complete[packet->cpu]) {
     cout << "[" << NAME << "] " << __func__ << " cpu: " << packet->cpu << " instr_id: " << packet->instr_id;
@@ -106,6 +88,9 @@ void PACKET_QUEUE::remove_queue(PACKET *packet)
     cout << " address: " << hex << packet->address << " full_addr: " << packet->full_addr << dec << " fill_level: " << packet->fill_level;
     cout << " head: " << head << " tail: " << tail << " occupancy: " << occupancy << " event_cycle: " << packet->event_cycle << endl; });
 
+    if (index_type != QUEUE_INDEX_NONE)
+        index.erase(index_key(packet));
+
     // reset entry
     PACKET empty_packet;
     *packet = empty_packet;
@@ -115,3 +100,64 @@ void PACKET_QUEUE::remove_queue(PACKET *packet)
     if (head >= SIZE)
         head = 0;
 }
+
+// only for empty queues, before the simulation starts (-config)
+void PACKET_QUEUE::resize(uint32_t size)
+{
+    delete[] entry;
+    SIZE = size;
+    entry = new PACKET[SIZE];
+    resize_index();
+
+    head = 0;
+    tail = 0;
+    occupancy = 0;
+}
+
+// exchanges the contents with another queue, the name and the DRAM scratch packets stay
+// the entry arrays do not move, so pointers into them survive (LLC slices, see CACHE::select_slice())
+void PACKET_QUEUE::swap(PACKET_QUEUE &other)
+{
+    std::swap(SIZE, other.SIZE);
+    std::swap(is_RQ, other.is_RQ);
+    std::swap(is_WQ, other.is_WQ);
+    std::swap(write_mode, other.write_mode);
+    std::swap(index_type, other.index_type);
+    index.swap(other.index);
+
+    std::swap(cpu, other.cpu);
+    std::swap(head, other.head);
+    std::swap(tail, other.tail);
+    std::swap(occupancy, other.occupancy);
+    std::swap(num_returned, other.num_returned);
+    std::swap(next_fill_index, other.next_fill_index);
+    std::swap(next_schedule_index, other.next_schedule_index);
+    std::swap(next_process_index, other.next_process_index);
+
+    std::swap(next_fill_cycle, other.next_fill_cycle);
+    std::swap(next_schedule_cycle, other.next_schedule_cycle);
+    std::swap(next_process_cycle, other.next_process_cycle);
+    std::swap(ACCESS, other.ACCESS);
+    std::swap(FORWARD, other.FORWARD);
+    std::swap(MERGED, other.MERGED);
+    std::swap(TO_CACHE, other.TO_CACHE);
+    std::swap(ROW_BUFFER_HIT, other.ROW_BUFFER_HIT);
+    std::swap(ROW_BUFFER_MISS, other.ROW_BUFFER_MISS);
+    std::swap(FULL, other.FULL);
+
+    std::swap(entry, other.entry);
+}
+
+void CORE_BUFFER::resize(uint32_t size)
+{
+    delete[] entry;
+    SIZE = size;
+    entry = new ooo_model_instr[SIZE];
+
+    head = 0;
+    tail = 0;
+    occupancy = 0;
+    last_read = SIZE-1;
+    last_fetch = SIZE-1;
+    last_scheduled = 0;
+}
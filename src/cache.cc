@@ -1,6 +1,10 @@
 #include "cache.h"
 #include "set.h"
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 uint64_t l2pf_access = 0;
 
 void CACHE::handle_fill()
@@ -19,9 +23,14 @@ void CACHE::handle_fill()
 
         uint32_t mshr_index = MSHR.next_fill_index;
 
+        // an exclusive cache only takes the victims of the caches above, a fill meant for them passes through
+        uint8_t bypass = (inclusion == INCLUSION_EXCLUSIVE) && (MSHR.entry[mshr_index].fill_level < fill_level);
+
         // find victim
         uint32_t set = get_set(MSHR.entry[mshr_index].address), way;
-        if (cache_type == IS_LLC) 
+        if (bypass)
+            way = NUM_WAY;
+        else if (cache_type == IS_LLC) 
         {
             way = llc_find_victim(fill_cpu, MSHR.entry[mshr_index].instr_id, set, block[set], MSHR.entry[mshr_index].ip, MSHR.entry[mshr_index].full_addr, MSHR.entry[mshr_index].type);
         }
@@ -29,8 +38,9 @@ void CACHE::handle_fill()
             way = find_victim(fill_cpu, MSHR.entry[mshr_index].instr_id, set, block[set], MSHR.entry[mshr_index].ip, MSHR.entry[mshr_index].full_addr, MSHR.entry[mshr_index].type);
 
 #ifdef LLC_BYPASS
-        if ((cache_type == IS_LLC) && (way == LLC_WAY)) 
+        if ((cache_type == IS_LLC) && (way == NUM_WAY) && (bypass == 0)) 
         { // this is a bypass that does not fill the LLC
+            bypass = 1;
 
             // update replacement policy
             if (cache_type == IS_LLC) 
@@ -40,7 +50,11 @@ void CACHE::handle_fill()
             }
             else
                 update_replacement_state(fill_cpu, set, way, MSHR.entry[mshr_index].full_addr, MSHR.entry[mshr_index].ip, 0, MSHR.entry[mshr_index].type, 0);
+        }
+#endif
 
+        if (bypass)
+        {
             // COLLECT STATS
             sim_miss[fill_cpu][MSHR.entry[mshr_index].type]++;
             sim_access[fill_cpu][MSHR.entry[mshr_index].type]++;
@@ -73,6 +87,8 @@ void CACHE::handle_fill()
             {
                 uint64_t current_miss_latency = (current_core_cycle[fill_cpu] - MSHR.entry[mshr_index].cycle_enqueued);
                 total_miss_latency += current_miss_latency;
+                if (MSHR.entry[mshr_index].type < NUM_TYPES)
+                    sim_latency[fill_cpu][MSHR.entry[mshr_index].type].add(current_miss_latency);
 
                 // zmz modify
                 int cache_level_idx;
@@ -105,19 +121,22 @@ void CACHE::handle_fill()
                 }
             }
 
-            MSHR.remove_queue(&MSHR.entry[mshr_index]);
+            remove_mshr(mshr_index);
             MSHR.num_returned--;
 
             update_fill_cycle();
 
             return; // return here, no need to process further in this function
         }
-#endif
 
         uint8_t  do_fill = 1;
 
+        // the victim leaves the caches above first, a dirty copy there makes it dirty here
+        if ((inclusion == INCLUSION_INCLUSIVE) && block[set][way].valid && back_invalidate(block[set][way].address))
+            block[set][way].dirty = 1;
+
         // is this dirty?
-        if (block[set][way].dirty) 
+        if (block[set][way].dirty || (clean_writeback && block[set][way].valid)) 
         {
             // check if the lower level WQ has enough room to keep this writeback request
             if (lower_level) 
@@ -146,6 +165,7 @@ void CACHE::handle_fill()
                     writeback_packet.instr_id = MSHR.entry[mshr_index].instr_id;
                     writeback_packet.ip = 0; // writeback does not have ip
                     writeback_packet.type = WRITEBACK;
+                    writeback_packet.clean_victim = (block[set][way].dirty == 0);
                     writeback_packet.event_cycle = current_core_cycle[fill_cpu];
                     lower_level->add_wq(&writeback_packet);
                 }
@@ -282,11 +302,13 @@ void CACHE::handle_fill()
                 }
 
                 total_miss_latency += current_miss_latency;
+                if (MSHR.entry[mshr_index].type < NUM_TYPES)
+                    sim_latency[fill_cpu][MSHR.entry[mshr_index].type].add(current_miss_latency);
             }
 
             
 
-            MSHR.remove_queue(&MSHR.entry[mshr_index]);
+            remove_mshr(mshr_index);
             MSHR.num_returned--;
 
             update_fill_cycle();
@@ -387,7 +409,8 @@ void CACHE::handle_writeback()
             sim_access[writeback_cpu][WQ.entry[index].type]++;
 
             // mark dirty
-            block[set][way].dirty = 1;
+            if (WQ.entry[index].clean_victim == 0)
+                block[set][way].dirty = 1;
 
             if (cache_type == IS_ITLB)
                 WQ.entry[index].instruction_pa = block[set][way].data;
@@ -549,7 +572,7 @@ void CACHE::handle_writeback()
                 }
 
 #ifdef LLC_BYPASS
-                if ((cache_type == IS_LLC) && (way == LLC_WAY)) 
+                if ((cache_type == IS_LLC) && (way == NUM_WAY)) 
                 {
                     cerr << "LLC bypassing for writebacks is not allowed!" << endl;
                     assert(0);
@@ -558,8 +581,12 @@ void CACHE::handle_writeback()
 
                 uint8_t  do_fill = 1;
 
+                // the victim leaves the caches above first, a dirty copy there makes it dirty here
+                if ((inclusion == INCLUSION_INCLUSIVE) && block[set][way].valid && back_invalidate(block[set][way].address))
+                    block[set][way].dirty = 1;
+
                 // is this dirty?
-                if (block[set][way].dirty) 
+                if (block[set][way].dirty || (clean_writeback && block[set][way].valid)) 
                 {
                     // check if the lower level WQ has enough room to keep this writeback request
                     if (lower_level) 
@@ -587,6 +614,7 @@ void CACHE::handle_writeback()
                             writeback_packet.instr_id = WQ.entry[index].instr_id;
                             writeback_packet.ip = 0;
                             writeback_packet.type = WRITEBACK;
+                            writeback_packet.clean_victim = (block[set][way].dirty == 0);
                             writeback_packet.event_cycle = current_core_cycle[writeback_cpu];
 
                             lower_level->add_wq(&writeback_packet);
@@ -633,7 +661,8 @@ void CACHE::handle_writeback()
                     fill_cache(set, way, &WQ.entry[index]);
 
                     // mark dirty
-                    block[set][way].dirty = 1; 
+                    if (WQ.entry[index].clean_victim == 0)
+                        block[set][way].dirty = 1; 
 
                     // check fill level
                     if (WQ.entry[index].fill_level < fill_level) 
@@ -842,6 +871,10 @@ void CACHE::handle_read()
                 }
                 block[set][way].used = 1;
 
+                // an exclusive cache hands the line up, a dirty one stays until it is written back
+                if ((inclusion == INCLUSION_EXCLUSIVE) && (RQ.entry[index].fill_level < fill_level) && (block[set][way].dirty == 0))
+                    invalidate_entry(block[set][way].address);
+
                 HIT[RQ.entry[index].type]++;
                 ACCESS[RQ.entry[index].type]++;
                 
@@ -885,6 +918,11 @@ void CACHE::handle_read()
                             }
                         }
                     }
+                    else if (lower_level && (lower_level->get_occupancy(1, RQ.entry[index].address) == lower_level->get_size(1, RQ.entry[index].address)))
+                    {
+                        // an LLC slice can have fewer RQ entries than the L2C has MSHRs
+                        miss_handled = 0;
+                    }
                     else
                     {
                         // add it to mshr (read miss)
@@ -1133,6 +1171,9 @@ void CACHE::handle_prefetch()
 		    }
                 }
 
+                if ((inclusion == INCLUSION_EXCLUSIVE) && (PQ.entry[index].fill_level < fill_level) && (block[set][way].dirty == 0))
+                    invalidate_entry(block[set][way].address);
+
                 HIT[PQ.entry[index].type]++;
                 ACCESS[PQ.entry[index].type]++;
                 
@@ -1284,13 +1325,315 @@ void CACHE::handle_prefetch()
 
 void CACHE::operate()
 {
-    handle_fill();
-    handle_writeback();
-    reads_available_this_cycle = MAX_READ;
-    handle_read();
+    // every slice has its own queues and ports
+    for (uint32_t i=0; i<num_slices; i++) {
+        if ((i != 0) && (active_slice == 0) && slice[i]->idle())
+            continue;
+
+        SLICE_SCOPE scope(this, i);
+
+        handle_fill();
+        handle_writeback();
+        reads_available_this_cycle = MAX_READ;
+        handle_read();
+
+        if (PQ.occupancy && (reads_available_this_cycle > 0))
+            handle_prefetch();
+    }
+}
+
+uint64_t CACHE::get_next_event_cycle()
+{
+    // operate() only touches the MSHR fill candidate and the queue heads,
+    // so nothing can happen here before the earliest of their event cycles
+    uint64_t next_cycle = UINT64_MAX;
+
+    for (uint32_t i=0; i<num_slices; i++) {
+        SLICE_SCOPE scope(this, i);
+
+        if ((MSHR.next_fill_index != MSHR_SIZE) && (MSHR.next_fill_cycle < next_cycle))
+            next_cycle = MSHR.next_fill_cycle;
+
+        if (WQ.occupancy && (WQ.entry[WQ.head].cpu != NUM_CPUS) && (WQ.entry[WQ.head].event_cycle < next_cycle))
+            next_cycle = WQ.entry[WQ.head].event_cycle;
+
+        if (RQ.occupancy && (RQ.entry[RQ.head].cpu != NUM_CPUS) && (RQ.entry[RQ.head].event_cycle < next_cycle))
+            next_cycle = RQ.entry[RQ.head].event_cycle;
+
+        if (PQ.occupancy && (PQ.entry[PQ.head].cpu != NUM_CPUS) && (PQ.entry[PQ.head].event_cycle < next_cycle))
+            next_cycle = PQ.entry[PQ.head].event_cycle;
+    }
+
+    return next_cycle;
+}
+
+void CACHE::functional_access(PACKET *packet)
+{
+    // untimed version of handle_read/handle_writeback/handle_prefetch for the functional warmup
+    // a miss is served by the lower levels right away and filled here without going through the MSHR
+    uint32_t set = get_set(packet->address),
+             access_cpu = packet->cpu,
+             prior_cpu = cpu;
+    uint8_t type = packet->type;
+    int hit_way = check_hit(packet);
+
+    // prefetchers only look at demand loads and at prefetches coming from an upper level
+    uint8_t train_prefetcher = (type == LOAD) || ((type == PREFETCH) && (packet->pf_origin_level < fill_level));
+
+    if (hit_way >= 0) {
+        uint32_t way = hit_way;
+        if ((cache_type == IS_ITLB) || (cache_type == IS_DTLB) || (cache_type == IS_STLB))
+            packet->data = block[set][way].data;
+        uint8_t hit_prefetch = block[set][way].prefetch;
+
+        if (cache_type == IS_LLC)
+            llc_update_replacement_state(access_cpu, set, way, block[set][way].full_addr, packet->ip, 0, type, 1);
+        else
+            update_replacement_state(access_cpu, set, way, block[set][way].full_addr, packet->ip, 0, type, 1);
+
+        // demand reads consume the prefetch bit, stores and writebacks dirty the block
+        if ((type == LOAD) || ((type == RFO) && (cache_type != IS_L1D))) {
+            if (block[set][way].prefetch) {
+                pf_useful++;
+                block[set][way].prefetch = 0;
+            }
+            block[set][way].used = 1;
+        }
+        if (((type == WRITEBACK) && (packet->clean_victim == 0)) || ((type == RFO) && (cache_type == IS_L1D)))
+            block[set][way].dirty = 1;
+
+        // an exclusive cache hands the line up
+        if ((inclusion == INCLUSION_EXCLUSIVE) && (packet->fill_level < fill_level) && (block[set][way].dirty == 0))
+            invalidate_entry(block[set][way].address);
+
+        // prefetches issued from here fill right away, so the block may be gone after this
+        if (train_prefetcher) {
+            if ((cache_type == IS_L1I) && (type == LOAD))
+                l1i_prefetcher_cache_operate(access_cpu, packet->ip, 1, hit_prefetch);
+            if (cache_type == IS_L1D)
+                l1d_prefetcher_operate(packet->full_addr, packet->ip, 1, type);
+            else if (cache_type == IS_L2C)
+                packet->pf_metadata = l2c_prefetcher_operate(packet->address<<LOG2_BLOCK_SIZE, packet->ip, 1, type, packet->pf_metadata);
+            else if (cache_type == IS_LLC) {
+                cpu = access_cpu;
+                packet->pf_metadata = llc_prefetcher_operate(packet->address<<LOG2_BLOCK_SIZE, packet->ip, 1, type, packet->pf_metadata);
+                cpu = prior_cpu;
+            }
+        }
+
+        return;
+    }
+
+    // writebacks allocate right away, everything else is read from below first
+    if (type != WRITEBACK) {
+        if (lower_level)
+            lower_level->functional_access(packet);
+        else if (cache_type == IS_STLB)
+            packet->data = va_to_pa(access_cpu, packet->instr_id, packet->full_addr, packet->address, 0) >> LOG2_PAGE_SIZE;
+    }
+
+    // prefetches meant for a lower level pass through without filling, and so does everything for the levels above an exclusive cache
+    uint8_t bypass = (inclusion == INCLUSION_EXCLUSIVE) && (packet->fill_level < fill_level);
+    if ((packet->fill_level <= fill_level) && (bypass == 0)) {
+        uint32_t way;
+        if (cache_type == IS_LLC)
+            way = llc_find_victim(access_cpu, packet->instr_id, set, block[set], packet->ip, packet->full_addr, type);
+        else
+            way = find_victim(access_cpu, packet->instr_id, set, block[set], packet->ip, packet->full_addr, type);
+
+#ifdef LLC_BYPASS
+        if ((cache_type == IS_LLC) && (way == NUM_WAY)) {
+            llc_update_replacement_state(access_cpu, set, way, packet->full_addr, packet->ip, 0, type, 0);
+            return;
+        }
+#endif
+
+        if ((inclusion == INCLUSION_INCLUSIVE) && block[set][way].valid && back_invalidate(block[set][way].address))
+            block[set][way].dirty = 1;
+
+        if ((block[set][way].dirty || (clean_writeback && block[set][way].valid)) && lower_level) {
+            PACKET writeback_packet;
+
+            writeback_packet.fill_level = fill_level << 1;
+            writeback_packet.cpu = access_cpu;
+            writeback_packet.address = block[set][way].address;
+            writeback_packet.full_addr = block[set][way].full_addr;
+            writeback_packet.data = block[set][way].data;
+            writeback_packet.instr_id = packet->instr_id;
+            writeback_packet.ip = 0; // writeback does not have ip
+            writeback_packet.type = WRITEBACK;
+            writeback_packet.clean_victim = (block[set][way].dirty == 0);
+            lower_level->functional_access(&writeback_packet);
+        }
+
+        uint8_t is_prefetch = (type == PREFETCH) ? 1 : 0;
+        if (cache_type == IS_L1I)
+            l1i_prefetcher_cache_fill(access_cpu, ((packet->ip)>>LOG2_BLOCK_SIZE)<<LOG2_BLOCK_SIZE, set, way, is_prefetch, ((block[set][way].ip)>>LOG2_BLOCK_SIZE)<<LOG2_BLOCK_SIZE);
+        if (cache_type == IS_L1D)
+            l1d_prefetcher_cache_fill(packet->full_addr, set, way, is_prefetch, block[set][way].address<<LOG2_BLOCK_SIZE, packet->pf_metadata);
+        if (cache_type == IS_L2C)
+            packet->pf_metadata = l2c_prefetcher_cache_fill(packet->address<<LOG2_BLOCK_SIZE, set, way, is_prefetch, block[set][way].address<<LOG2_BLOCK_SIZE, packet->pf_metadata);
+        if (cache_type == IS_LLC) {
+            cpu = access_cpu;
+            packet->pf_metadata = llc_prefetcher_cache_fill(packet->address<<LOG2_BLOCK_SIZE, set, way, is_prefetch, block[set][way].address<<LOG2_BLOCK_SIZE, packet->pf_metadata);
+            cpu = prior_cpu;
+        }
+
+        if (cache_type == IS_LLC)
+            llc_update_replacement_state(access_cpu, set, way, packet->full_addr, packet->ip, block[set][way].full_addr, type, 0);
+        else
+            update_replacement_state(access_cpu, set, way, packet->full_addr, packet->ip, block[set][way].full_addr, type, 0);
+
+        fill_cache(set, way, packet);
+
+        if (((type == WRITEBACK) && (packet->clean_victim == 0)) || ((type == RFO) && (cache_type == IS_L1D)))
+            block[set][way].dirty = 1;
+    }
+
+    if (train_prefetcher) {
+        if ((cache_type == IS_L1I) && (type == LOAD))
+            l1i_prefetcher_cache_operate(access_cpu, packet->ip, 0, 0);
+        if (cache_type == IS_L1D)
+            l1d_prefetcher_operate(packet->full_addr, packet->ip, 0, type);
+        else if (cache_type == IS_L2C)
+            packet->pf_metadata = l2c_prefetcher_operate(packet->address<<LOG2_BLOCK_SIZE, packet->ip, 0, type, packet->pf_metadata);
+        else if (cache_type == IS_LLC) {
+            cpu = access_cpu;
+            packet->pf_metadata = llc_prefetcher_operate(packet->address<<LOG2_BLOCK_SIZE, packet->ip, 0, type, packet->pf_metadata);
+            cpu = prior_cpu;
+        }
+    }
+}
+
+// new geometry from the -config file, the cache must still be empty
+void CACHE::configure(uint32_t sets, uint32_t ways, uint32_t wq_size, uint32_t rq_size, uint32_t pq_size, uint32_t mshr_size)
+{
+    NUM_SET = sets;
+    NUM_WAY = ways;
+    NUM_LINE = sets*ways;
+    num_allocated_way = NUM_WAY;
+    allocate_blocks(NUM_WAY);
+    build_tag_store();
+
+    WQ_SIZE = wq_size;
+    RQ_SIZE = rq_size;
+    PQ_SIZE = pq_size;
+    MSHR_SIZE = mshr_size;
+    WQ.resize(WQ_SIZE);
+    RQ.resize(RQ_SIZE);
+    PQ.resize(PQ_SIZE);
+    MSHR.resize(MSHR_SIZE);
+
+    mshr_table.clear();
+    mshr_free = priority_queue <uint32_t, vector<uint32_t>, greater<uint32_t> >();
+    for (uint32_t i=0; i<MSHR_SIZE; i++)
+        mshr_free.push(i);
+}
+
+// splits the queues (the -config sizes are for the whole LLC) and the read ports into slices
+// runs once the caches are wired up, before anything is queued
+void CACHE::configure_slices(uint32_t slices, uint8_t hash)
+{
+    num_slices = slices;
+    slice_hash = hash;
+
+    WQ_SIZE = (WQ_SIZE + slices - 1) / slices;
+    RQ_SIZE = (RQ_SIZE + slices - 1) / slices;
+    PQ_SIZE = (PQ_SIZE + slices - 1) / slices;
+    MSHR_SIZE = (MSHR_SIZE + slices - 1) / slices;
+    MAX_READ = (MAX_READ + slices - 1) / slices;
+
+    WQ.resize(WQ_SIZE);
+    RQ.resize(RQ_SIZE);
+    PQ.resize(PQ_SIZE);
+    MSHR.resize(MSHR_SIZE);
+    mshr_table.clear();
+    mshr_free = priority_queue <uint32_t, vector<uint32_t>, greater<uint32_t> >();
+    for (uint32_t i=0; i<MSHR_SIZE; i++)
+        mshr_free.push(i);
+
+    slice = new CACHE_SLICE* [num_slices];
+    slice[0] = NULL;
+    for (uint32_t i=1; i<num_slices; i++)
+        slice[i] = new CACHE_SLICE(NAME, WQ_SIZE, RQ_SIZE, PQ_SIZE, MSHR_SIZE);
+}
+
+uint32_t CACHE::get_slice(uint64_t address) const
+{
+    if (num_slices == 1)
+        return 0;
+
+    if (slice_hash == SLICE_HASH_XOR) {
+        uint64_t hash = 0;
+        for (; address; address >>= lg2(num_slices))
+            hash ^= address;
+        return hash & (num_slices - 1);
+    }
+
+    return address & (num_slices - 1);
+}
+
+// brings the queues of slice s into RQ/WQ/PQ/MSHR, slice 0 lives there whenever no other slice does
+void CACHE::select_slice(uint32_t s)
+{
+    if (active_slice != 0)
+        swap_slice(active_slice);
+    if (s != 0)
+        swap_slice(s);
 
-    if (PQ.occupancy && (reads_available_this_cycle > 0))
-        handle_prefetch();
+    active_slice = s;
+}
+
+void CACHE::swap_slice(uint32_t s)
+{
+    WQ.swap(slice[s]->WQ);
+    RQ.swap(slice[s]->RQ);
+    PQ.swap(slice[s]->PQ);
+    MSHR.swap(slice[s]->MSHR);
+    mshr_table.swap(slice[s]->mshr_table);
+    mshr_free.swap(slice[s]->mshr_free);
+}
+
+void CACHE::checkpoint()
+{
+    // per-core caches share their NAME across cores
+    string key = (cache_type == IS_LLC) ? NAME : "cpu" + to_string(cpu) + "." + NAME;
+
+    // the lru field doubles as the replacement state of the non-LLC caches
+    // a cache with a different geometry (e.g. another Mosaic way count) starts cold
+    // the set count tells apart a -config geometry with the same number of blocks
+    uint32_t sets = NUM_SET;
+    if ((checkpoint_restore == 0) || checkpoint_has(key + ".sets"))
+        checkpoint_data(key + ".sets", &sets, sizeof(sets));
+
+    if (sets != NUM_SET)
+        cout << "Checkpoint has " << sets << " sets for " << key << ".block, starting it cold" << endl;
+    else if (block_stride == num_allocated_way) {
+        // the arena holds exactly the ways in use, no need to pack them
+        if ((checkpoint_data(key + ".block", block_arena, NUM_SET*num_allocated_way*sizeof(BLOCK)) == 0) && checkpoint_restore)
+            build_tag_store();
+    }
+    else {
+        vector<BLOCK> blocks(NUM_SET * num_allocated_way);
+        if (checkpoint_restore == 0) {
+            for (uint32_t i=0; i<NUM_SET; i++)
+                memcpy(&blocks[i*num_allocated_way], block[i], num_allocated_way*sizeof(BLOCK));
+        }
+        if ((checkpoint_data(key + ".block", blocks.data(), blocks.size()*sizeof(BLOCK)) == 0) && checkpoint_restore) {
+            for (uint32_t i=0; i<NUM_SET; i++)
+                memcpy(block[i], &blocks[i*num_allocated_way], num_allocated_way*sizeof(BLOCK));
+            build_tag_store();
+        }
+    }
+
+    if (cache_type == IS_L1D)
+        l1d_prefetcher_checkpoint();
+    else if (cache_type == IS_L2C)
+        l2c_prefetcher_checkpoint();
+    else if (cache_type == IS_LLC) {
+        llc_prefetcher_checkpoint();
+        llc_replacement_checkpoint();
+    }
 }
 
 uint32_t CACHE::get_set(uint64_t address)
@@ -1302,42 +1645,107 @@ uint32_t CACHE::get_way(uint64_t address, uint32_t set)
 {
     // zmz modify (STEP 5)
     //Mosaic_Cache Mosaic_Cache_Monitor=Get_Instance();
-    int current_way_start_pos=0, current_way_end_pos=NUM_WAY;
-    if(Mosaic_Cache_Monitor.get_work_mode() != 0)
-    {
-        switch(cache_type)
-        {
-            case IS_L1D:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L1);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L1);
-                break;
-            case IS_L2C:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L2);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L2);
-                break;
-            case IS_LLC:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L3);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
-                break;
-            default:
-                current_way_start_pos = 0;
-                current_way_end_pos = NUM_WAY;
-                break;
-        }
-    }
+    int current_way_start_pos, current_way_end_pos;
+    mosaic_cache_get_window(-1, &current_way_start_pos, &current_way_end_pos);
 
-    //for (uint32_t way=0; way<NUM_WAY; way++) 
-    for(uint32_t way=current_way_start_pos; way<current_way_end_pos; way++)
-    {
-        if (block[set][way].valid && (block[set][way].tag == address)) 
-            return way;
-    }
+    int way = find_way(set, address, current_way_start_pos, current_way_end_pos);
+    if (way != -1)
+        return way;
 
     // zmz modify
     //return NUM_WAY;
     return current_way_end_pos;
 }
 
+// one arena for all sets instead of an array per set, every block starts invalid
+void CACHE::allocate_blocks(uint32_t ways)
+{
+    delete[] block_arena;
+    delete[] block;
+
+    block_stride = ways;
+    block_arena = new BLOCK[NUM_SET * block_stride];
+    block = new BLOCK* [NUM_SET];
+    for (uint32_t i=0; i<NUM_SET; i++) {
+        block[i] = &block_arena[i*block_stride];
+
+        for (uint32_t j=0; j<block_stride; j++) {
+            block[i][j].lru = j;
+        }
+    }
+}
+
+void CACHE::build_tag_store()
+{
+    delete[] tag_store;
+    delete[] valid_mask;
+
+    if (num_allocated_way > 64) {
+        cerr << "[" << NAME << "] " << __func__ << " at most 64 ways, not " << num_allocated_way << endl;
+        assert(0);
+    }
+
+    // padded to whole 256-bit vectors, find_way() reads past the last way
+    tag_stride = (num_allocated_way + 3) & ~3;
+    tag_store = new uint64_t[NUM_SET * tag_stride]();
+    valid_mask = new uint64_t[NUM_SET]();
+
+    for (uint32_t set=0; set<NUM_SET; set++) {
+        for (uint32_t way=0; way<num_allocated_way; way++)
+            update_tag_store(set, way);
+    }
+}
+
+void CACHE::update_tag_store(uint32_t set, uint32_t way)
+{
+    tag_store[set*tag_stride + way] = block[set][way].tag;
+    if (block[set][way].valid)
+        valid_mask[set] |= 1ULL << way;
+    else
+        valid_mask[set] &= ~(1ULL << way);
+}
+
+// lowest valid way in [start, end) holding tag, or -1
+// compares 4 (AVX2) or 2 (SSE2) tags at a time, build with -march=native or -mavx2 to get the wider one
+int CACHE::find_way(uint32_t set, uint64_t tag, uint32_t start, uint32_t end)
+{
+    if (end > num_allocated_way)
+        end = num_allocated_way;
+    if (start >= end)
+        return -1;
+
+    uint64_t *tags = &tag_store[set*tag_stride];
+    uint64_t match = 0;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi64x(tag);
+    for (uint32_t way = start & ~3; way<end; way+=4) {
+        __m256i equal = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) &tags[way]), key);
+        match |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(equal)) << way;
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi64x(tag);
+    for (uint32_t way = start & ~1; way<end; way+=2) {
+        // SSE2 has no 64-bit compare, both 32-bit halves have to match
+        __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) &tags[way]), key);
+        equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+        match |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(equal)) << way;
+    }
+#else
+    for (uint32_t way=start; way<end; way++) {
+        if (tags[way] == tag)
+            match |= 1ULL << way;
+    }
+#endif
+
+    match &= valid_mask[set];
+    match &= (end == 64) ? ~0ULL : ((1ULL << end) - 1);
+    match &= ~((1ULL << start) - 1);
+    if (match == 0)
+        return -1;
+
+    return __builtin_ctzll(match);
+}
+
 void CACHE::fill_cache(uint32_t set, uint32_t way, PACKET *packet)
 {
 #ifdef SANITY_CHECK
@@ -1380,6 +1788,7 @@ void CACHE::fill_cache(uint32_t set, uint32_t way, PACKET *packet)
     block[set][way].ip = packet->ip;
     block[set][way].cpu = packet->cpu;
     block[set][way].instr_id = packet->instr_id;
+    update_tag_store(set, way);
 
     DP ( if (warmup_complete[packet->cpu]) {
     cout << "[" << NAME << "] " << __func__ << " set: " << set << " way: " << way;
@@ -1402,48 +1811,22 @@ int CACHE::check_hit(PACKET *packet)
 
     // zmz modify (STEP 5)
     //Mosaic_Cache Mosaic_Cache_Monitor=Get_Instance();
-    int current_way_start_pos=0, current_way_end_pos=NUM_WAY;
-    if(Mosaic_Cache_Monitor.get_work_mode() != 0)
-    {
-        switch(cache_type)
-        {
-            case IS_L1D:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L1);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L1);
-                break;
-            case IS_L2C:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L2);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L2);
-                break;
-            case IS_LLC:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L3);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
-                break;
-            default:
-                current_way_start_pos = 0;
-                current_way_end_pos = NUM_WAY;
-                break;
-        }
-    }
+    int current_way_start_pos, current_way_end_pos;
+    mosaic_cache_get_window(-1, &current_way_start_pos, &current_way_end_pos);
 
     // hit
     // zmz modify
     //for (uint32_t way=0; way<NUM_WAY; way++)
-    for (uint32_t way=current_way_start_pos; way<current_way_end_pos; way++)
+    int way = find_way(set, packet->address, current_way_start_pos, current_way_end_pos);
+    if (way != -1)
     {
-        if (block[set][way].valid && (block[set][way].tag == packet->address)) 
-        {
+        match_way = way;
 
-            match_way = way;
-
-            DP ( if (warmup_complete[packet->cpu]) {
-            cout << "[" << NAME << "] " << __func__ << " instr_id: " << packet->instr_id << " type: " << +packet->type << hex << " addr: " << packet->address;
-            cout << " full_addr: " << packet->full_addr << " tag: " << block[set][way].tag << " data: " << block[set][way].data << dec;
-            cout << " set: " << set << " way: " << way << " lru: " << block[set][way].lru;
-            cout << " event: " << packet->event_cycle << " cycle: " << current_core_cycle[cpu] << endl; });
-
-            break;
-        }
+        DP ( if (warmup_complete[packet->cpu]) {
+        cout << "[" << NAME << "] " << __func__ << " instr_id: " << packet->instr_id << " type: " << +packet->type << hex << " addr: " << packet->address;
+        cout << " full_addr: " << packet->full_addr << " tag: " << block[set][way].tag << " data: " << block[set][way].data << dec;
+        cout << " set: " << set << " way: " << way << " lru: " << block[set][way].lru;
+        cout << " event: " << packet->event_cycle << " cycle: " << current_core_cycle[cpu] << endl; });
     }
 
     return match_way;
@@ -1462,56 +1845,69 @@ int CACHE::invalidate_entry(uint64_t inval_addr)
 
     // zmz modify (STEP 5)
     //Mosaic_Cache Mosaic_Cache_Monitor=Get_Instance();
-    int current_way_start_pos=0, current_way_end_pos=NUM_WAY;
-    if(Mosaic_Cache_Monitor.get_work_mode() != 0)
-    {
-        switch(cache_type)
-        {
-            case IS_L1D:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L1);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L1);
-                break;
-            case IS_L2C:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L2);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L2);
-                break;
-            case IS_LLC:
-                current_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L3);
-                current_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
-                break;
-            default:
-                current_way_start_pos = 0;
-                current_way_end_pos = NUM_WAY;
-                break;
-        }
-    }
+    int current_way_start_pos, current_way_end_pos;
+    mosaic_cache_get_window(-1, &current_way_start_pos, &current_way_end_pos);
 
     // invalidate
     // zmz modify
     //for (uint32_t way=0; way<NUM_WAY; way++)
-    for (uint32_t way=current_way_start_pos; way<current_way_end_pos; way++)
+    int way = find_way(set, inval_addr, current_way_start_pos, current_way_end_pos);
+    if (way != -1)
     {
-        if (block[set][way].valid && (block[set][way].tag == inval_addr)) 
-        {
+        block[set][way].valid = 0;
+        update_tag_store(set, way);
 
-            block[set][way].valid = 0;
+        match_way = way;
 
-            match_way = way;
+        DP ( if (warmup_complete[cpu]) {
+        cout << "[" << NAME << "] " << __func__ << " inval_addr: " << hex << inval_addr;  
+        cout << " tag: " << block[set][way].tag << " data: " << block[set][way].data << dec;
+        cout << " set: " << set << " way: " << way << " lru: " << block[set][way].lru << " cycle: " << current_core_cycle[cpu] << endl; });
+    }
 
-            DP ( if (warmup_complete[cpu]) {
-            cout << "[" << NAME << "] " << __func__ << " inval_addr: " << hex << inval_addr;  
-            cout << " tag: " << block[set][way].tag << " data: " << block[set][way].data << dec;
-            cout << " set: " << set << " way: " << way << " lru: " << block[set][way].lru << " cycle: " << current_core_cycle[cpu] << endl; });
+    return match_way;
+}
 
-            break;
+// drops address from every cache above, returns whether one of them held it dirty
+// the L1s have nothing above them
+uint8_t CACHE::back_invalidate(uint64_t address)
+{
+    uint8_t dirty = 0;
+
+    for (uint32_t i=0; i<NUM_CPUS; i++) {
+        MEMORY *upper[2] = {upper_level_icache[i], upper_level_dcache[i]};
+
+        for (uint32_t j=0; j<2; j++) {
+            // the LLC sees the L2C as both of its upper levels
+            if ((upper[j] == NULL) || ((j == 1) && (upper[1] == upper[0])))
+                continue;
+
+            dirty |= upper[j]->invalidate_line(address);
         }
     }
 
-    return match_way;
+    return dirty;
+}
+
+uint8_t CACHE::invalidate_line(uint64_t address)
+{
+    uint8_t dirty = back_invalidate(address);
+
+    int way = invalidate_entry(address);
+    if (way >= 0) {
+        uint32_t set = get_set(address);
+        dirty |= block[set][way].dirty;
+        block[set][way].dirty = 0;
+        back_invalidated++;
+    }
+
+    return dirty;
 }
 
 int CACHE::add_rq(PACKET *packet)
 {
+    SLICE_SCOPE scope(this, get_slice(packet->address));
+
     // check for the latest wirtebacks in the write queue
     int wq_index = WQ.check_queue(packet);
     if (wq_index != -1) {
@@ -1639,6 +2035,7 @@ int CACHE::add_rq(PACKET *packet)
 #endif
 
     RQ.entry[index] = *packet;
+    RQ.add_index(index);
 
     // ADD LATENCY
     if (RQ.entry[index].event_cycle < current_core_cycle[packet->cpu])
@@ -1668,6 +2065,8 @@ int CACHE::add_rq(PACKET *packet)
 
 int CACHE::add_wq(PACKET *packet)
 {
+    SLICE_SCOPE scope(this, get_slice(packet->address));
+
     // check for duplicates in the write queue
     int index = WQ.check_queue(packet);
     if (index != -1) {
@@ -1692,6 +2091,7 @@ int CACHE::add_wq(PACKET *packet)
     }
 
     WQ.entry[index] = *packet;
+    WQ.add_index(index);
 
     // ADD LATENCY
     if (WQ.entry[index].event_cycle < current_core_cycle[packet->cpu])
@@ -1719,6 +2119,9 @@ int CACHE::add_wq(PACKET *packet)
 
 int CACHE::prefetch_line(uint64_t ip, uint64_t base_addr, uint64_t pf_addr, int pf_fill_level, uint32_t prefetch_metadata)
 {
+    // the PQ that has to have room is the one of the slice the prefetch goes to
+    SLICE_SCOPE scope(this, get_slice(pf_addr >> LOG2_BLOCK_SIZE));
+
     pf_requested++;
 
     if (PQ.occupancy < PQ.SIZE) {
@@ -1744,7 +2147,10 @@ int CACHE::prefetch_line(uint64_t ip, uint64_t base_addr, uint64_t pf_addr, int
             pf_packet.event_cycle = current_core_cycle[cpu];
 
             // give a dummy 0 as the IP of a prefetch
-            add_pq(&pf_packet);
+            if (functional_warmup)
+                functional_access(&pf_packet);
+            else
+                add_pq(&pf_packet);
 
             pf_issued++;
 
@@ -1757,6 +2163,8 @@ int CACHE::prefetch_line(uint64_t ip, uint64_t base_addr, uint64_t pf_addr, int
 
 int CACHE::kpc_prefetch_line(uint64_t base_addr, uint64_t pf_addr, int pf_fill_level, int delta, int depth, int signature, int confidence, uint32_t prefetch_metadata)
 {
+    SLICE_SCOPE scope(this, get_slice(pf_addr >> LOG2_BLOCK_SIZE));
+
     if (PQ.occupancy < PQ.SIZE) {
         if ((base_addr>>LOG2_PAGE_SIZE) == (pf_addr>>LOG2_PAGE_SIZE)) {
             
@@ -1784,7 +2192,10 @@ int CACHE::kpc_prefetch_line(uint64_t base_addr, uint64_t pf_addr, int pf_fill_l
             pf_packet.event_cycle = current_core_cycle[cpu];
 
             // give a dummy 0 as the IP of a prefetch
-            add_pq(&pf_packet);
+            if (functional_warmup)
+                functional_access(&pf_packet);
+            else
+                add_pq(&pf_packet);
 
             pf_issued++;
 
@@ -1797,6 +2208,8 @@ int CACHE::kpc_prefetch_line(uint64_t base_addr, uint64_t pf_addr, int pf_fill_l
 
 int CACHE::add_pq(PACKET *packet)
 {
+    SLICE_SCOPE scope(this, get_slice(packet->address));
+
     // check for the latest wirtebacks in the write queue
     int wq_index = WQ.check_queue(packet);
     if (wq_index != -1) {
@@ -1887,6 +2300,7 @@ int CACHE::add_pq(PACKET *packet)
 #endif
 
     PQ.entry[index] = *packet;
+    PQ.add_index(index);
 
     // ADD LATENCY
     if (PQ.entry[index].event_cycle < current_core_cycle[packet->cpu])
@@ -1916,6 +2330,8 @@ int CACHE::add_pq(PACKET *packet)
 
 void CACHE::return_data(PACKET *packet)
 {
+    SLICE_SCOPE scope(this, get_slice(packet->address));
+
     // check MSHR information
     int mshr_index = check_mshr(packet);
 
@@ -1987,10 +2403,10 @@ int CACHE::check_mshr(PACKET *packet)
     // search mshr
   //bool instruction_and_data_collision = false;
   
-  for (uint32_t index=0; index<MSHR_SIZE; index++)
+  uint64_t *slot = mshr_table.find(packet->address);
+  if (slot)
     {
-      if (MSHR.entry[index].address == packet->address)
-	{
+      uint32_t index = *slot;
 	  //if(MSHR.entry[index].instruction != packet->instruction)
 	  //  {
 	  //    instruction_and_data_collision = true;
@@ -2004,7 +2420,6 @@ int CACHE::check_mshr(PACKET *packet)
 	    
 	      return index;
 	  //  }
-	}
     }
 
     //if(instruction_and_data_collision) // remove instruction-and-data collision safeguard
@@ -2032,68 +2447,149 @@ void CACHE::add_mshr(PACKET *packet)
 
     packet->cycle_enqueued = current_core_cycle[packet->cpu];
 
-    // search mshr
-    for (index=0; index<MSHR_SIZE; index++) {
-        if (MSHR.entry[index].address == 0) {
-            
-            MSHR.entry[index] = *packet;
-            MSHR.entry[index].returned = INFLIGHT;
-            MSHR.occupancy++;
+    // lowest free slot
+    if (mshr_free.empty())
+        return;
+    index = mshr_free.top();
+    mshr_free.pop();
 
-            DP ( if (warmup_complete[packet->cpu]) {
-            cout << "[" << NAME << "_MSHR] " << __func__ << " instr_id: " << packet->instr_id;
-            cout << " address: " << hex << packet->address << " full_addr: " << packet->full_addr << dec;
-            cout << " index: " << index << " occupancy: " << MSHR.occupancy << endl; });
+#ifdef SANITY_CHECK
+    if (mshr_table.find(packet->address))
+        assert(0);
+#endif
+    mshr_table.insert(packet->address, index);
 
-            break;
-        }
-    }
+    MSHR.entry[index] = *packet;
+    MSHR.entry[index].returned = INFLIGHT;
+    MSHR.occupancy++;
+
+    DP ( if (warmup_complete[packet->cpu]) {
+    cout << "[" << NAME << "_MSHR] " << __func__ << " instr_id: " << packet->instr_id;
+    cout << " address: " << hex << packet->address << " full_addr: " << packet->full_addr << dec;
+    cout << " index: " << index << " occupancy: " << MSHR.occupancy << endl; });
 }
 
-uint32_t CACHE::get_occupancy(uint8_t queue_type, uint64_t address)
+void CACHE::remove_mshr(uint32_t mshr_index)
+{
+    mshr_table.erase(MSHR.entry[mshr_index].address);
+    mshr_free.push(mshr_index);
+
+    MSHR.remove_queue(&MSHR.entry[mshr_index]);
+}
+
+// the queue of slice s without selecting it, so the cores can read it from their own threads (-sim_threads)
+// the queues in RQ/WQ/PQ/MSHR are active_slice's, and slice[active_slice] keeps the ones of slice 0
+const PACKET_QUEUE *CACHE::get_slice_queue(uint8_t queue_type, uint32_t s) const
 {
+    const CACHE_SLICE *parked = NULL;
+    if (s != active_slice)
+        parked = slice[(s == 0) ? active_slice : s];
+
     if (queue_type == 0)
-        return MSHR.occupancy;
+        return parked ? &parked->MSHR : &MSHR;
     else if (queue_type == 1)
-        return RQ.occupancy;
+        return parked ? &parked->RQ : &RQ;
     else if (queue_type == 2)
-        return WQ.occupancy;
+        return parked ? &parked->WQ : &WQ;
     else if (queue_type == 3)
-        return PQ.occupancy;
+        return parked ? &parked->PQ : &PQ;
 
-    return 0;
+    return NULL;
+}
+
+uint32_t CACHE::get_occupancy(uint8_t queue_type, uint64_t address)
+{
+    const PACKET_QUEUE *queue = get_slice_queue(queue_type, get_slice(address));
+    if (queue == NULL)
+        return 0;
+
+    return queue->occupancy;
 }
 
 uint32_t CACHE::get_size(uint8_t queue_type, uint64_t address)
 {
-    if (queue_type == 0)
-        return MSHR.SIZE;
-    else if (queue_type == 1)
-        return RQ.SIZE;
-    else if (queue_type == 2)
-        return WQ.SIZE;
-    else if (queue_type == 3)
-        return PQ.SIZE;
+    const PACKET_QUEUE *queue = get_slice_queue(queue_type, get_slice(address));
+    if (queue == NULL)
+        return 0;
 
-    return 0;
+    return queue->SIZE;
+}
+
+// every LLC slice has queues of its own
+uint32_t CACHE::get_queue_id(uint8_t queue_type, uint64_t address)
+{
+    return get_slice(address);
 }
 
 void CACHE::increment_WQ_FULL(uint64_t address)
 {
+    SLICE_SCOPE scope(this, get_slice(address));
+
     WQ.FULL++;
 }
 
 // zmz modify
+// the arena only grows when the new way count does not fit, lines in the ways that stay are kept
+// ways that come into use start invalid, the ones that go out of use are dropped
 void CACHE::resize_way(int new_way_num)
 {
-    for (uint32_t i=0; i<NUM_SET; i++) {
-            delete[] block[i];
-            block[i] = new BLOCK[new_way_num]; 
-
-            for (uint32_t j=0; j<new_way_num; j++) {
+    if ((uint32_t) new_way_num > block_stride) {
+        BLOCK *old_arena = block_arena;
+        uint32_t old_stride = block_stride;
+
+        block_arena = NULL;
+        allocate_blocks(new_way_num);
+        for (uint32_t i=0; i<NUM_SET; i++)
+            memcpy(block[i], &old_arena[i*old_stride], num_allocated_way*sizeof(BLOCK));
+        delete[] old_arena;
+    }
+    else {
+        for (uint32_t i=0; i<NUM_SET; i++) {
+            for (uint32_t j=num_allocated_way; j<(uint32_t) new_way_num; j++) {
+                block[i][j] = BLOCK();
                 block[i][j].lru = j;
             }
         }
+    }
+    num_allocated_way = new_way_num;
+    build_tag_store();
+}
+
+// zmz modify
+// the ways [start_pos, end_pos) in use, all of them if Mosaic is off. L1D and L2C use the ways of their core
+// the LLC is shared: a core only fills its own ways (window_cpu), lookups (window_cpu < 0) go over the ways of all cores
+void CACHE::mosaic_cache_get_window(int window_cpu, int *start_pos, int *end_pos)
+{
+    *start_pos = 0;
+    *end_pos = NUM_WAY;
+    if (Mosaic_Cache_Monitor.get_work_mode() == 0)
+        return;
+
+    int cache_level;
+    switch (cache_type) {
+        case IS_L1D:
+            cache_level = LPM_L1;
+            window_cpu = cpu;
+            break;
+        case IS_L2C:
+            cache_level = LPM_L2;
+            window_cpu = cpu;
+            break;
+        case IS_LLC:
+            cache_level = LPM_L3;
+            break;
+        default:
+            return;
+    }
+
+    if (window_cpu < 0) {
+        *start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(cache_level);
+        *end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(cache_level);
+    }
+    else {
+        *start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(window_cpu, cache_level);
+        *end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(window_cpu, cache_level);
+    }
 }
 
 // zmz modify
@@ -2103,27 +2599,41 @@ int CACHE::mosaic_cache_get_writeback_count(int way_id)
 
     for(int set_idx = 0; set_idx < NUM_SET; set_idx++)
     {
-        if(block[set_idx][way_id].dirty)
+        if(block[set_idx][way_id].valid && block[set_idx][way_id].dirty)
+        {
+            mosaic_cache_count_writeback_line(&block[set_idx][way_id]);
             writeback_counter++;
+        }
     }
 
     return writeback_counter;
 }
 
 // zmz modify
-bool CACHE::mosaic_cache_can_writeback(int writeback_count)
+// adds a dirty line to the count of the lower WQ it goes to, mosaic_cache_can_writeback() checks them
+void CACHE::mosaic_cache_count_writeback_line(BLOCK *line)
+{
+    pair<uint64_t, int> &queue = mosaic_writeback_queue[lower_level->get_queue_id(2, line->address)];
+
+    queue.first = line->address;
+    queue.second++;
+}
+
+// zmz modify
+// whether every lower WQ (an LLC slice, a DRAM channel) has room for the dirty lines counted for it
+bool CACHE::mosaic_cache_can_writeback()
 {
     if(lower_level)
     {
-        if(lower_level->get_size(2, block[0][0].address) 
-            - lower_level->get_occupancy(2, block[0][0].address < writeback_count))
-        {
-            return false;
-        }
-        else
+        map<uint32_t, pair<uint64_t, int> >::iterator queue;
+        for(queue = mosaic_writeback_queue.begin(); queue != mosaic_writeback_queue.end(); queue++)
         {
-            return true;
+            uint64_t address = queue->second.first;
+            if((int) (lower_level->get_size(2, address) - lower_level->get_occupancy(2, address)) < queue->second.second)
+                return false;
         }
+
+        return true;
     }
     else
     {
@@ -2144,18 +2654,14 @@ void CACHE::mosaic_cache_issue_writeback(int way_id)
     {
         for(int set_idx = 0; set_idx < NUM_SET; set_idx++)
         {
-            PACKET writeback_packet;
-
-            writeback_packet.fill_level = fill_level << 1;
-            writeback_packet.cpu = block[set_idx][way_id].cpu;
-            writeback_packet.address = block[set_idx][way_id].address;
-            writeback_packet.full_addr = block[set_idx][way_id].full_addr;
-            writeback_packet.data = block[set_idx][way_id].data;
-            writeback_packet.instr_id = block[set_idx][way_id].instr_id;
-            writeback_packet.ip = 0; // writeback does not have ip
-            writeback_packet.type = WRITEBACK;
-            writeback_packet.event_cycle = current_core_cycle[block[set_idx][way_id].cpu];
-            lower_level->add_wq(&writeback_packet);
+            // only the dirty lines mosaic_cache_get_writeback_count() counted, a line whose queue
+            // is full (another LLC slice) stays dirty
+            if(!block[set_idx][way_id].valid || !block[set_idx][way_id].dirty)
+                continue;
+            if(lower_level->get_occupancy(2, block[set_idx][way_id].address) == lower_level->get_size(2, block[set_idx][way_id].address))
+                continue;
+
+            mosaic_cache_writeback_line(set_idx, way_id);
         }
     }
     else
@@ -2168,4 +2674,171 @@ void CACHE::mosaic_cache_issue_writeback(int way_id)
             assert(0);
         }
     }
-}
\ No newline at end of file
+}
+
+// zmz modify
+void CACHE::mosaic_cache_writeback_line(uint32_t set, uint32_t way)
+{
+    PACKET writeback_packet;
+
+    writeback_packet.fill_level = fill_level << 1;
+    writeback_packet.cpu = block[set][way].cpu;
+    writeback_packet.address = block[set][way].address;
+    writeback_packet.full_addr = block[set][way].full_addr;
+    writeback_packet.data = block[set][way].data;
+    writeback_packet.instr_id = block[set][way].instr_id;
+    writeback_packet.ip = 0; // writeback does not have ip
+    writeback_packet.type = WRITEBACK;
+    writeback_packet.event_cycle = current_core_cycle[block[set][way].cpu];
+    lower_level->add_wq(&writeback_packet);
+    block[set][way].dirty = 0;
+}
+
+// zmz modify
+// the drain engine (-mosaic_cache_drain_rate): writes back dirty lines of way_id while *budget lasts, and never
+// fills more than 7/8 of a lower WQ, so the demand writebacks keep some room
+// with receiver (migrate mode) a line the receivers would take stays, the reconfig moves it
+// returns true once the way has no dirty line left to write back, with settle the rest is counted per lower WQ
+bool CACHE::mosaic_cache_drain_way(int way_id, CACHE **receiver, int *budget, bool settle)
+{
+    bool clean = true;
+
+    for(uint32_t set_idx = 0; set_idx < NUM_SET; set_idx++)
+    {
+        BLOCK *line = &block[set_idx][way_id];
+        if(!line->valid)
+            continue;
+        if(receiver && mosaic_cache_can_move_to(receiver[line->cpu]) && receiver[line->cpu]->mosaic_cache_take_line(line, 1))
+            continue;
+        if(!line->dirty)
+            continue;
+
+        if((*budget > 0) && ((8 * (lower_level->get_occupancy(2, line->address) + 1)) <= (7 * lower_level->get_size(2, line->address))))
+        {
+            mosaic_cache_writeback_line(set_idx, way_id);
+            (*budget)--;
+            continue;
+        }
+
+        clean = false;
+        if(settle)
+            mosaic_cache_count_writeback_line(line);
+        else if(*budget <= 0)
+            return false;
+    }
+
+    return clean;
+}
+
+// zmz modify
+// -mosaic_cache_writeback_mode 2: the valid lines of way_id move to receiver[line cpu] instead of being
+// written back, a dirty line stays dirty there. returns the lines moved, *dirty_left counts the dirty
+// lines left behind for mosaic_cache_issue_writeback(). dry_run only counts, nothing moves
+int CACHE::mosaic_cache_migrate_way(int way_id, CACHE **receiver, uint8_t dry_run, int *dirty_left)
+{
+    int migrate_counter = 0;
+
+    for(uint32_t set_idx = 0; set_idx < NUM_SET; set_idx++)
+    {
+        BLOCK *line = &block[set_idx][way_id];
+        if(!line->valid)
+            continue;
+
+        CACHE *target = receiver[line->cpu];
+        if(!mosaic_cache_can_move_to(target))
+        {
+            if(line->dirty)
+            {
+                mosaic_cache_count_writeback_line(line);
+                (*dirty_left)++;
+            }
+            continue;
+        }
+
+        if(!target->mosaic_cache_take_line(line, dry_run))
+        {
+            if(line->dirty)
+            {
+                mosaic_cache_count_writeback_line(line);
+                (*dirty_left)++;
+            }
+            continue;
+        }
+
+        migrate_counter++;
+        if(dry_run)
+            continue;
+
+        // the copies above would be left without this cache covering them
+        if(inclusion == INCLUSION_INCLUSIVE)
+        {
+            if(back_invalidate(line->address))
+                target->mosaic_cache_take_line(line, 0);
+        }
+
+        line->valid = 0;
+        line->dirty = 0;
+        update_tag_store(set_idx, way_id);
+    }
+
+    return migrate_counter;
+}
+
+// zmz modify
+// whether the lines of this cache may migrate to target
+// a line cannot move up out of an inclusive cache, it would no longer cover the copy above, nor up into
+// an exclusive cache, which only takes the victims of the caches above it
+bool CACHE::mosaic_cache_can_move_to(CACHE *target)
+{
+    return (target->fill_level >= fill_level) || ((inclusion != INCLUSION_INCLUSIVE) && (target->inclusion != INCLUSION_EXCLUSIVE));
+}
+
+// zmz modify
+// puts a line a Mosaic reconfig took away from another level into a free way of its core's window,
+// or merges it with the copy already here. returns false if the set has no room
+// a dry run reserves the free way in mosaic_reserved, so the next line of the same set looks past it
+bool CACHE::mosaic_cache_take_line(BLOCK *line, uint8_t dry_run)
+{
+    uint32_t set = get_set(line->address);
+    int current_way_start_pos, current_way_end_pos;
+
+    mosaic_cache_get_window(-1, &current_way_start_pos, &current_way_end_pos);
+    int way = find_way(set, line->address, current_way_start_pos, current_way_end_pos);
+    if(way != -1)
+    {
+        if(!dry_run)
+            block[set][way].dirty |= line->dirty;
+        return true;
+    }
+
+    uint64_t reserve_key = (uint64_t)set * NUM_CPUS + line->cpu;
+    int reserved = dry_run ? mosaic_reserved[reserve_key] : 0;
+
+    mosaic_cache_get_window(line->cpu, &current_way_start_pos, &current_way_end_pos);
+    for(way = current_way_start_pos; way < current_way_end_pos; way++)
+    {
+        if(!block[set][way].valid && (reserved-- == 0))
+            break;
+    }
+    if(way == current_way_end_pos)
+        return false;
+    if(dry_run)
+    {
+        mosaic_reserved[reserve_key]++;
+        return true;
+    }
+
+    uint32_t lru = block[set][way].lru;
+    block[set][way] = *line;
+    block[set][way].lru = lru;
+    block[set][way].prefetch = 0;
+    block[set][way].used = 0;
+    update_tag_store(set, way);
+
+    if(cache_type == IS_LLC)
+        llc_update_replacement_state(line->cpu, set, way, line->full_addr, line->ip, 0, WRITEBACK, 0);
+    else
+        update_replacement_state(line->cpu, set, way, line->full_addr, line->ip, 0, WRITEBACK, 0);
+
+    return true;
+}
@@ -0,0 +1,264 @@
+#include "checkpoint.h"
+#include "ooo_cpu.h"
+#include "uncore.h"
+#include "page_table.h"
+
+#include <sstream>
+
+uint8_t checkpoint_restore = 0;
+
+// sections read from the file on restore
+static map <string, vector<uint8_t> > sections;
+
+// file being written on save
+static FILE *checkpoint_file = NULL;
+static uint64_t num_sections = 0;
+
+static void write_section(string key, const void *data, size_t size)
+{
+    uint32_t key_size = key.size();
+    uint64_t data_size = size;
+
+    if ((fwrite(&key_size, sizeof(key_size), 1, checkpoint_file) != 1)
+        || (fwrite(key.data(), 1, key_size, checkpoint_file) != key_size)
+        || (fwrite(&data_size, sizeof(data_size), 1, checkpoint_file) != 1)
+        || (size && (fwrite(data, 1, size, checkpoint_file) != size))) {
+        cerr << "[CHECKPOINT] cannot write section " << key << endl;
+        assert(0);
+    }
+
+    num_sections++;
+}
+
+int checkpoint_data(string key, void *data, size_t size)
+{
+    if (checkpoint_restore == 0) {
+        write_section(key, data, size);
+        return 0;
+    }
+
+    map <string, vector<uint8_t> >::iterator section = sections.find(key);
+    if ((section == sections.end()) || (section->second.size() != size)) {
+        cout << "Checkpoint has no matching " << key << ", starting it cold" << endl;
+        return -1;
+    }
+
+    memcpy(data, section->second.data(), size);
+    return 0;
+}
+
+uint8_t checkpoint_has(string key)
+{
+    return sections.find(key) != sections.end();
+}
+
+int checkpoint_buffer(string key, vector<uint8_t> &buffer)
+{
+    if (checkpoint_restore == 0) {
+        write_section(key, buffer.data(), buffer.size());
+        return 0;
+    }
+
+    map <string, vector<uint8_t> >::iterator section = sections.find(key);
+    if (section == sections.end()) {
+        cout << "Checkpoint has no " << key << ", starting it cold" << endl;
+        return -1;
+    }
+
+    buffer = section->second;
+    return 0;
+}
+
+int checkpoint_table(string key, HASH_TABLE &table)
+{
+    // stored as a flat array of (key, value) pairs
+    vector<uint8_t> buffer;
+    if (checkpoint_restore == 0) {
+        buffer.resize(table.size() * 2 * sizeof(uint64_t));
+        uint64_t *pair = (uint64_t *)buffer.data();
+        for (uint64_t i=0; i<table.keys.size(); i++) {
+            if (table.valid[i]) {
+                *pair++ = table.keys[i];
+                *pair++ = table.values[i];
+            }
+        }
+    }
+
+    if (checkpoint_buffer(key, buffer))
+        return -1;
+
+    if (checkpoint_restore) {
+        table.clear();
+        uint64_t *pair = (uint64_t *)buffer.data();
+        for (size_t i=0; i<buffer.size()/(2*sizeof(uint64_t)); i++, pair += 2)
+            table.insert(pair[0], pair[1]);
+    }
+
+    return 0;
+}
+
+// walks every structure that makes up the warmed-up state
+static void checkpoint_state()
+{
+    for (uint32_t i=0; i<NUM_CPUS; i++)
+        ooo_cpu[i].checkpoint();
+
+    uncore.LLC.checkpoint();
+    uncore.DRAM.checkpoint();
+
+    // virtual memory
+    // the page table is saved as (vpage, ppage) pairs in frame order, so the clock hand still
+    // points at the same page after a restore, the other tables are rebuilt from it
+    vector<uint8_t> buffer;
+    if (checkpoint_restore == 0) {
+        for (uint64_t i=0; i<page_frames.size(); i++) {
+            buffer.insert(buffer.end(), (uint8_t *)&page_frames[i].vpage, (uint8_t *)(&page_frames[i].vpage + 1));
+            buffer.insert(buffer.end(), (uint8_t *)&page_frames[i].ppage, (uint8_t *)(&page_frames[i].ppage + 1));
+        }
+    }
+    if ((checkpoint_buffer("page_table", buffer) == 0) && checkpoint_restore) {
+        page_table.clear();
+        inverse_table.clear();
+        page_frames.clear();
+        uint64_t *pair = (uint64_t *)buffer.data();
+        for (size_t i=0; i<buffer.size()/(2*sizeof(uint64_t)); i++, pair += 2) {
+            page_table.insert(pair[0], page_frames.size());
+            inverse_table.insert(pair[1], pair[0]);
+            page_frames.push_back(PAGE_FRAME(pair[0], pair[1]));
+        }
+    }
+
+    buffer.clear();
+    if (checkpoint_restore == 0) {
+        for (uint64_t i=0; i<page_frames.size(); i++)
+            buffer.push_back(page_frames[i].referenced);
+    }
+    if ((checkpoint_buffer("page_referenced", buffer) == 0) && checkpoint_restore && (buffer.size() == page_frames.size())) {
+        for (uint64_t i=0; i<page_frames.size(); i++)
+            page_frames[i].referenced = buffer[i];
+    }
+
+    checkpoint_data("clock_hand", &clock_hand, sizeof(clock_hand));
+    if (clock_hand >= page_frames.size())
+        clock_hand = 0;
+
+    for (uint32_t i=0; i<NUM_CPUS; i++)
+        checkpoint_table("cpu" + to_string(i) + ".unique_cl", unique_cl[i]);
+
+    buffer.clear();
+    if (checkpoint_restore == 0) {
+        queue <uint64_t> pages = page_queue;
+        while (!pages.empty()) {
+            uint64_t vpage = pages.front();
+            buffer.insert(buffer.end(), (uint8_t *)&vpage, (uint8_t *)(&vpage + 1));
+            pages.pop();
+        }
+    }
+    if ((checkpoint_buffer("page_queue", buffer) == 0) && checkpoint_restore) {
+        page_queue = queue <uint64_t> ();
+        for (size_t i=0; i<buffer.size()/sizeof(uint64_t); i++)
+            page_queue.push(((uint64_t *)buffer.data())[i]);
+    }
+
+    checkpoint_data("previous_ppage", &previous_ppage, sizeof(previous_ppage));
+    checkpoint_data("num_adjacent_page", &num_adjacent_page, sizeof(num_adjacent_page));
+    checkpoint_data("allocated_pages", &allocated_pages, sizeof(allocated_pages));
+    checkpoint_data("num_cl", num_cl, sizeof(num_cl));
+    checkpoint_data("num_page", num_page, sizeof(num_page));
+    checkpoint_data("minor_fault", minor_fault, sizeof(minor_fault));
+    checkpoint_data("major_fault", major_fault, sizeof(major_fault));
+
+    // page allocation keeps drawing from the same random stream
+    stringstream engine;
+    if (checkpoint_restore == 0) {
+        engine << champsim_rand.engine;
+        string state = engine.str();
+        buffer.assign(state.begin(), state.end());
+    }
+    if ((checkpoint_buffer("champsim_rand", buffer) == 0) && checkpoint_restore) {
+        engine.str(string(buffer.begin(), buffer.end()));
+        engine >> champsim_rand.engine;
+    }
+}
+
+void save_checkpoint(const char *name)
+{
+    checkpoint_file = fopen(name, "wb");
+    if (checkpoint_file == NULL) {
+        cerr << "[CHECKPOINT] cannot create " << name << endl;
+        assert(0);
+    }
+
+    // the section count is only known at the end, the header is written again then
+    checkpoint_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.num_cpus = NUM_CPUS;
+    fwrite(&header, sizeof(header), 1, checkpoint_file);
+
+    num_sections = 0;
+    checkpoint_restore = 0;
+    checkpoint_state();
+
+    header.num_sections = num_sections;
+    fseek(checkpoint_file, 0, SEEK_SET);
+    if ((fwrite(&header, sizeof(header), 1, checkpoint_file) != 1) || fclose(checkpoint_file)) {
+        cerr << "[CHECKPOINT] cannot write " << name << endl;
+        assert(0);
+    }
+    checkpoint_file = NULL;
+
+    cout << "Checkpoint saved to " << name << " (" << num_sections << " sections)" << endl;
+}
+
+void load_checkpoint(const char *name)
+{
+    FILE *file = fopen(name, "rb");
+    if (file == NULL) {
+        cerr << "[CHECKPOINT] cannot open " << name << endl;
+        assert(0);
+    }
+
+    checkpoint_header header;
+    if ((fread(&header, sizeof(header), 1, file) != 1) || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic))
+        || (header.version != CHECKPOINT_VERSION)) {
+        cerr << "[CHECKPOINT] " << name << " is not a ChampSim checkpoint" << endl;
+        assert(0);
+    }
+    if (header.num_cpus != NUM_CPUS) {
+        cerr << "[CHECKPOINT] " << name << " was taken with " << header.num_cpus << " cores, this build has " << NUM_CPUS << endl;
+        assert(0);
+    }
+
+    for (uint64_t i=0; i<header.num_sections; i++) {
+        uint32_t key_size;
+        uint64_t data_size;
+        string key;
+
+        if (fread(&key_size, sizeof(key_size), 1, file) != 1) {
+            cerr << "[CHECKPOINT] " << name << " is truncated" << endl;
+            assert(0);
+        }
+        key.resize(key_size);
+        if ((fread(&key[0], 1, key_size, file) != key_size) || (fread(&data_size, sizeof(data_size), 1, file) != 1)) {
+            cerr << "[CHECKPOINT] " << name << " is truncated" << endl;
+            assert(0);
+        }
+
+        vector<uint8_t> &data = sections[key];
+        data.resize(data_size);
+        if (data_size && (fread(data.data(), 1, data_size, file) != data_size)) {
+            cerr << "[CHECKPOINT] " << name << " is truncated" << endl;
+            assert(0);
+        }
+    }
+    fclose(file);
+
+    checkpoint_restore = 1;
+    checkpoint_state();
+    checkpoint_restore = 0;
+    sections.clear();
+
+    cout << "Checkpoint loaded from " << name << endl;
+}
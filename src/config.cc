@@ -0,0 +1,273 @@
+#include "config.h"
+#include "ooo_cpu.h"
+#include "uncore.h"
+
+#include <fstream>
+
+CACHE_CONFIG cache_config[NUM_CACHE_TYPES] = {
+    {ITLB_SET, ITLB_WAY, ITLB_WQ_SIZE, ITLB_RQ_SIZE, ITLB_PQ_SIZE, ITLB_MSHR_SIZE, ITLB_LATENCY, INCLUSION_NINE, 1, SLICE_HASH_MODULO},
+    {DTLB_SET, DTLB_WAY, DTLB_WQ_SIZE, DTLB_RQ_SIZE, DTLB_PQ_SIZE, DTLB_MSHR_SIZE, DTLB_LATENCY, INCLUSION_NINE, 1, SLICE_HASH_MODULO},
+    {STLB_SET, STLB_WAY, STLB_WQ_SIZE, STLB_RQ_SIZE, STLB_PQ_SIZE, STLB_MSHR_SIZE, STLB_LATENCY, INCLUSION_NINE, 1, SLICE_HASH_MODULO},
+    {L1I_SET, L1I_WAY, L1I_WQ_SIZE, L1I_RQ_SIZE, L1I_PQ_SIZE, L1I_MSHR_SIZE, L1I_LATENCY, INCLUSION_NINE, 1, SLICE_HASH_MODULO},
+    {L1D_SET, L1D_WAY, L1D_WQ_SIZE, L1D_RQ_SIZE, L1D_PQ_SIZE, L1D_MSHR_SIZE, L1D_LATENCY, INCLUSION_NINE, 1, SLICE_HASH_MODULO},
+    {L2C_SET, L2C_WAY, L2C_WQ_SIZE, L2C_RQ_SIZE, L2C_PQ_SIZE, L2C_MSHR_SIZE, L2C_LATENCY, INCLUSION_NINE, 1, SLICE_HASH_MODULO},
+    {LLC_SET, LLC_WAY, LLC_WQ_SIZE, LLC_RQ_SIZE, LLC_PQ_SIZE, LLC_MSHR_SIZE, LLC_LATENCY, INCLUSION_NINE, 1, SLICE_HASH_MODULO}
+};
+
+static const char *cache_section[NUM_CACHE_TYPES] = {"ITLB", "DTLB", "STLB", "L1I", "L1D", "L2C", "LLC"};
+
+static string trim(string s)
+{
+    size_t begin = s.find_first_not_of(" \t\r"),
+           end = s.find_last_not_of(" \t\r");
+    if (begin == string::npos)
+        return "";
+
+    return s.substr(begin, end - begin + 1);
+}
+
+static uint32_t *cache_knob(CACHE_CONFIG *config, string key)
+{
+    if (key == "sets")      return &config->sets;
+    if (key == "ways")      return &config->ways;
+    if (key == "wq_size")   return &config->wq_size;
+    if (key == "rq_size")   return &config->rq_size;
+    if (key == "pq_size")   return &config->pq_size;
+    if (key == "mshr_size") return &config->mshr_size;
+    if (key == "latency")   return &config->latency;
+    if (key == "slices")    return &config->slices;
+
+    return NULL;
+}
+
+static uint32_t *core_knob(string key)
+{
+    if (key == "fetch_width")               return &FETCH_WIDTH;
+    if (key == "decode_width")              return &DECODE_WIDTH;
+    if (key == "exec_width")                return &EXEC_WIDTH;
+    if (key == "lq_width")                  return &LQ_WIDTH;
+    if (key == "sq_width")                  return &SQ_WIDTH;
+    if (key == "retire_width")              return &RETIRE_WIDTH;
+    if (key == "scheduler_size")            return &SCHEDULER_SIZE;
+    if (key == "branch_mispredict_penalty") return &BRANCH_MISPREDICT_PENALTY;
+
+    return NULL;
+}
+
+static uint32_t *noc_knob(string key)
+{
+    if (key == "hop_latency") return &NOC_HOP_LATENCY;
+    if (key == "link_width")  return &NOC_LINK_WIDTH;
+    if (key == "link_queue")  return &NOC_LINK_QUEUE;
+
+    return NULL;
+}
+
+static uint32_t *dram_knob(string key)
+{
+    if (key == "rq_size")   return &DRAM_RQ_SIZE;
+    if (key == "wq_size")   return &DRAM_WQ_SIZE;
+    if (key == "data_rate") return &DRAM_DATA_RATE;
+
+    return NULL;
+}
+
+// in nanoseconds
+static double *dram_timing(string key)
+{
+    if (key == "tRP")  return &tRP_DRAM_NANOSECONDS;
+    if (key == "tRCD") return &tRCD_DRAM_NANOSECONDS;
+    if (key == "tCAS") return &tCAS_DRAM_NANOSECONDS;
+
+    return NULL;
+}
+
+void load_config(const char *name)
+{
+    ifstream file(name);
+    if (!file.good()) {
+        cerr << "Cannot open config file " << name << endl;
+        assert(0);
+    }
+
+    string line, section;
+    for (uint32_t line_number = 1; getline(file, line); line_number++) {
+        size_t comment = line.find_first_of("#;");
+        if (comment != string::npos)
+            line = line.substr(0, comment);
+        line = trim(line);
+        if (line.empty())
+            continue;
+
+        if (line[0] == '[') {
+            if (line[line.size()-1] != ']') {
+                cerr << name << ":" << line_number << ": missing ] in " << line << endl;
+                assert(0);
+            }
+            section = trim(line.substr(1, line.size()-2));
+            continue;
+        }
+
+        size_t equal = line.find('=');
+        if (equal == string::npos) {
+            cerr << name << ":" << line_number << ": expected key = value, got " << line << endl;
+            assert(0);
+        }
+        string key = trim(line.substr(0, equal)),
+               value = trim(line.substr(equal+1));
+
+        // the one knob that takes a name instead of a number
+        if ((key == "inclusion") && ((section == "L2C") || (section == "LLC"))) {
+            uint8_t *inclusion = &cache_config[(section == "L2C") ? IS_L2C : IS_LLC].inclusion;
+            if (value == "nine")
+                *inclusion = INCLUSION_NINE;
+            else if (value == "inclusive")
+                *inclusion = INCLUSION_INCLUSIVE;
+            else if (value == "exclusive")
+                *inclusion = INCLUSION_EXCLUSIVE;
+            else {
+                cerr << name << ":" << line_number << ": inclusion must be nine, inclusive or exclusive, not " << value << endl;
+                assert(0);
+            }
+            continue;
+        }
+        if ((key == "slice_hash") && (section == "LLC")) {
+            if (value == "modulo")
+                cache_config[IS_LLC].slice_hash = SLICE_HASH_MODULO;
+            else if (value == "xor")
+                cache_config[IS_LLC].slice_hash = SLICE_HASH_XOR;
+            else {
+                cerr << name << ":" << line_number << ": slice_hash must be modulo or xor, not " << value << endl;
+                assert(0);
+            }
+            continue;
+        }
+
+        if ((key == "topology") && (section == "NOC")) {
+            if (value == "none")
+                NOC_TOPOLOGY = NOC_NONE;
+            else if (value == "ring")
+                NOC_TOPOLOGY = NOC_RING;
+            else if (value == "mesh")
+                NOC_TOPOLOGY = NOC_MESH;
+            else {
+                cerr << name << ":" << line_number << ": topology must be none, ring or mesh, not " << value << endl;
+                assert(0);
+            }
+            continue;
+        }
+
+        uint32_t *knob = NULL;
+        double *timing = NULL;
+        for (uint32_t i=0; i<NUM_CACHE_TYPES; i++) {
+            if (section == cache_section[i])
+                knob = cache_knob(&cache_config[i], key);
+        }
+        if (section == "core")
+            knob = core_knob(key);
+        else if (section == "NOC")
+            knob = noc_knob(key);
+        else if (section == "DRAM") {
+            knob = dram_knob(key);
+            timing = dram_timing(key);
+        }
+
+        if ((knob == NULL) && (timing == NULL)) {
+            cerr << name << ":" << line_number << ": unknown key " << key << " in section [" << section << "]" << endl;
+            assert(0);
+        }
+
+        char *end = NULL;
+        if (knob)
+            *knob = strtoul(value.c_str(), &end, 0);
+        else
+            *timing = strtod(value.c_str(), &end);
+        if (value.empty() || (value[0] == '-') || (*end != '\0')) {
+            cerr << name << ":" << line_number << ": bad value " << value << " for " << key << endl;
+            assert(0);
+        }
+    }
+}
+
+static void configure_cache(CACHE *cache, CACHE_CONFIG *config)
+{
+    if ((cache->NUM_SET == config->sets) && (cache->NUM_WAY == config->ways) && (cache->WQ_SIZE == config->wq_size)
+        && (cache->RQ_SIZE == config->rq_size) && (cache->PQ_SIZE == config->pq_size) && (cache->MSHR_SIZE == config->mshr_size))
+        return;
+
+    cache->configure(config->sets, config->ways, config->wq_size, config->rq_size, config->pq_size, config->mshr_size);
+}
+
+// the caches right above an exclusive one write back their clean victims too, that is what fills it
+static void configure_inclusion(CACHE *cache, CACHE_CONFIG *config, CACHE *upper_icache, CACHE *upper_dcache)
+{
+    cache->inclusion = config->inclusion;
+    upper_icache->clean_writeback = (config->inclusion == INCLUSION_EXCLUSIVE);
+    upper_dcache->clean_writeback = (config->inclusion == INCLUSION_EXCLUSIVE);
+}
+
+// resize the structures that were built with the compile-time defaults
+// runs before anything is initialized, the latencies are set once warmup is done
+void apply_config()
+{
+    for (uint32_t i=0; i<NUM_CACHE_TYPES; i++) {
+        CACHE_CONFIG *config = &cache_config[i];
+
+        // get_set() masks the address with the set count
+        if ((config->sets == 0) || (config->sets & (config->sets - 1))) {
+            cerr << "[" << cache_section[i] << "] sets must be a power of two, not " << config->sets << endl;
+            assert(0);
+        }
+        if ((config->ways == 0) || (config->wq_size == 0) || (config->rq_size == 0) || (config->mshr_size == 0)) {
+            cerr << "[" << cache_section[i] << "] needs at least one way, WQ, RQ and MSHR entry" << endl;
+            assert(0);
+        }
+        if ((config->slices != 1) && ((i != IS_LLC) || (config->slices == 0) || (config->slices & (config->slices - 1)))) {
+            cerr << "[" << cache_section[i] << "] slices must be a power of two, and only the LLC has slices" << endl;
+            assert(0);
+        }
+    }
+
+    if ((FETCH_WIDTH == 0) || (DECODE_WIDTH == 0) || (EXEC_WIDTH == 0) || (LQ_WIDTH == 0) || (SQ_WIDTH == 0)
+        || (RETIRE_WIDTH == 0) || (SCHEDULER_SIZE == 0)) {
+        cerr << "[core] widths and scheduler_size must not be 0" << endl;
+        assert(0);
+    }
+
+    // the data bus return time is CPU_FREQ/DRAM_MTPS cycles per transfer
+    if ((DRAM_RQ_SIZE == 0) || (DRAM_WQ_SIZE == 0) || (DRAM_DATA_RATE == 0) || (DRAM_DATA_RATE > CPU_FREQ)) {
+        cerr << "[DRAM] queue sizes must not be 0 and data_rate must be between 1 and " << CPU_FREQ << endl;
+        assert(0);
+    }
+
+    // a packet needs at least a cycle per hop, and the L2C needs room for at least one request
+    if ((NOC_HOP_LATENCY == 0) || (NOC_LINK_WIDTH == 0) || (NOC_LINK_QUEUE == 0)) {
+        cerr << "[NOC] hop_latency, link_width and link_queue must not be 0" << endl;
+        assert(0);
+    }
+
+    for (uint32_t i=0; i<NUM_CPUS; i++) {
+        configure_cache(&ooo_cpu[i].ITLB, &cache_config[IS_ITLB]);
+        configure_cache(&ooo_cpu[i].DTLB, &cache_config[IS_DTLB]);
+        configure_cache(&ooo_cpu[i].STLB, &cache_config[IS_STLB]);
+        configure_cache(&ooo_cpu[i].L1I, &cache_config[IS_L1I]);
+        configure_cache(&ooo_cpu[i].L1D, &cache_config[IS_L1D]);
+        configure_cache(&ooo_cpu[i].L2C, &cache_config[IS_L2C]);
+
+        configure_inclusion(&ooo_cpu[i].L2C, &cache_config[IS_L2C], &ooo_cpu[i].L1I, &ooo_cpu[i].L1D);
+        configure_inclusion(&uncore.LLC, &cache_config[IS_LLC], &ooo_cpu[i].L2C, &ooo_cpu[i].L2C);
+
+        if (ooo_cpu[i].IFETCH_BUFFER.SIZE != FETCH_WIDTH*2)
+            ooo_cpu[i].IFETCH_BUFFER.resize(FETCH_WIDTH*2);
+        if (ooo_cpu[i].DECODE_BUFFER.SIZE != DECODE_WIDTH*3)
+            ooo_cpu[i].DECODE_BUFFER.resize(DECODE_WIDTH*3);
+    }
+    configure_cache(&uncore.LLC, &cache_config[IS_LLC]);
+
+    for (uint32_t i=0; i<DRAM_CHANNELS; i++) {
+        if (uncore.DRAM.RQ[i].SIZE != DRAM_RQ_SIZE)
+            uncore.DRAM.RQ[i].resize(DRAM_RQ_SIZE);
+        if (uncore.DRAM.WQ[i].SIZE != DRAM_WQ_SIZE)
+            uncore.DRAM.WQ[i].resize(DRAM_WQ_SIZE);
+    }
+}
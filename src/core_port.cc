@@ -0,0 +1,151 @@
+#include "core_port.h"
+
+CORE_PORT core_port[NUM_CPUS];
+
+void CORE_PORT::queue_request(PACKET *packet, uint8_t queue_type)
+{
+    PORT_REQUEST request;
+    request.packet = *packet;
+    request.cycle = current_core_cycle[cpu];
+    request.queue_type = queue_type;
+
+    outbox.push_back(request);
+    pending[queue_type]++;
+}
+
+int CORE_PORT::add_rq(PACKET *packet)
+{
+    queue_request(packet, 1);
+
+    return -1;
+}
+
+int CORE_PORT::add_wq(PACKET *packet)
+{
+    queue_request(packet, 2);
+
+    return -1;
+}
+
+int CORE_PORT::add_pq(PACKET *packet)
+{
+    queue_request(packet, 3);
+
+    return -1;
+}
+
+void CORE_PORT::return_data(PACKET *packet)
+{
+    // the LLC returns data straight to the L2C, the cores are stopped while the uncore runs
+    upper_level_dcache[packet->cpu]->return_data(packet);
+}
+
+void CORE_PORT::operate()
+{
+    // requests only move at quantum boundaries, see deliver_core_ports()
+}
+
+void CORE_PORT::increment_WQ_FULL(uint64_t address)
+{
+    wq_full.push_back(address);
+}
+
+void CORE_PORT::functional_access(PACKET *packet)
+{
+    lower_level->functional_access(packet);
+}
+
+uint32_t CORE_PORT::get_occupancy(uint8_t queue_type, uint64_t address)
+{
+    // the LLC as it was at the last quantum boundary plus what this core sent since
+    // other cores may have sent more in the meantime, deliver() holds back whatever does not fit
+    uint32_t occupancy = lower_level->get_occupancy(queue_type, address);
+    if (queue_type < 4)
+        occupancy += pending[queue_type];
+
+    uint32_t size = lower_level->get_size(queue_type, address);
+    if (occupancy > size)
+        occupancy = size;
+
+    return occupancy;
+}
+
+uint32_t CORE_PORT::get_size(uint8_t queue_type, uint64_t address)
+{
+    return lower_level->get_size(queue_type, address);
+}
+
+uint32_t CORE_PORT::get_queue_id(uint8_t queue_type, uint64_t address)
+{
+    return lower_level->get_queue_id(queue_type, address);
+}
+
+uint64_t CORE_PORT::get_next_event_cycle()
+{
+    return UINT64_MAX;
+}
+
+int CORE_PORT::deliver(uint64_t cycle)
+{
+    PORT_REQUEST &request = outbox.front();
+    PACKET *packet = &request.packet;
+    int ret = 0;
+
+    // the LLC adds its latency to the cycle the request was sent at, as if it had arrived then
+    current_core_cycle[cpu] = request.cycle;
+
+    if (request.queue_type == 1) {
+        if (lower_level->add_rq(packet) == -2)
+            ret = -1;
+    }
+    else if (request.queue_type == 2) {
+        if (lower_level->get_occupancy(2, packet->address) == lower_level->get_size(2, packet->address))
+            ret = -1;
+        else
+            lower_level->add_wq(packet);
+    }
+    else {
+        if (lower_level->add_pq(packet) == -2)
+            ret = -1;
+    }
+
+    current_core_cycle[cpu] = cycle;
+
+    // a full LLC queue keeps the request in the outbox until the next cycle
+    if (ret == 0) {
+        pending[request.queue_type]--;
+        outbox.pop_front();
+    }
+
+    return ret;
+}
+
+void deliver_core_ports(uint64_t cycle)
+{
+    uint8_t blocked[NUM_CPUS];
+
+    for (uint32_t i=0; i<NUM_CPUS; i++) {
+        blocked[i] = 0;
+
+        for (; !core_port[i].wq_full.empty(); core_port[i].wq_full.pop_front())
+            core_port[i].lower_level->increment_WQ_FULL(core_port[i].wq_full.front());
+    }
+
+    // merge the outboxes by send cycle, ties go to the lower cpu like in the serial loop
+    while (1) {
+        CORE_PORT *next = NULL;
+        for (uint32_t i=0; i<NUM_CPUS; i++) {
+            CORE_PORT *port = &core_port[i];
+            if (blocked[i] || port->outbox.empty() || (port->outbox.front().cycle > cycle))
+                continue;
+            if ((next == NULL) || (port->outbox.front().cycle < next->outbox.front().cycle))
+                next = port;
+        }
+
+        if (next == NULL)
+            break;
+
+        if (next->deliver(cycle))
+            blocked[next->cpu] = 1;
+    }
+}
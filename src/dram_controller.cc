@@ -4,6 +4,9 @@
 uint32_t DRAM_MTPS, DRAM_DBUS_RETURN_TIME,
          tRP, tRCD, tCAS;
 
+uint32_t DRAM_WQ_SIZE = 64, DRAM_RQ_SIZE = 64, DRAM_DATA_RATE = DRAM_IO_FREQ;
+double tRP_DRAM_NANOSECONDS = 12.5, tRCD_DRAM_NANOSECONDS = 12.5, tCAS_DRAM_NANOSECONDS = 12.5;
+
 void MEMORY_CONTROLLER::reset_remain_requests(PACKET_QUEUE *queue, uint32_t channel)
 {
     for (uint32_t i=0; i<queue->SIZE; i++) {
@@ -120,6 +123,75 @@ void MEMORY_CONTROLLER::operate()
     }
 }
 
+void MEMORY_CONTROLLER::functional_access(PACKET *packet)
+{
+    // only the row buffers are warmed, open page policy like schedule(): every read or write leaves its row open
+    uint64_t op_addr = packet->address;
+    bank_request[dram_get_channel(op_addr)][dram_get_rank(op_addr)][dram_get_bank(op_addr)].open_row = dram_get_row(op_addr);
+}
+
+void MEMORY_CONTROLLER::checkpoint()
+{
+    // only the open rows are kept, the banks come back idle
+    uint32_t open_row[DRAM_CHANNELS][DRAM_RANKS][DRAM_BANKS];
+    for (uint32_t i=0; i<DRAM_CHANNELS; i++)
+        for (uint32_t j=0; j<DRAM_RANKS; j++)
+            for (uint32_t k=0; k<DRAM_BANKS; k++)
+                open_row[i][j][k] = bank_request[i][j][k].open_row;
+
+    if ((checkpoint_data(NAME + ".open_row", open_row, sizeof(open_row)) == 0) && checkpoint_restore) {
+        for (uint32_t i=0; i<DRAM_CHANNELS; i++)
+            for (uint32_t j=0; j<DRAM_RANKS; j++)
+                for (uint32_t k=0; k<DRAM_BANKS; k++)
+                    bank_request[i][j][k].open_row = open_row[i][j][k];
+    }
+}
+
+uint64_t MEMORY_CONTROLLER::get_next_event_cycle()
+{
+    uint64_t next_cycle = UINT64_MAX;
+
+    for (uint32_t i=0; i<DRAM_CHANNELS; i++) {
+        // a pending read/write mode switch happens on the very next operate()
+        if ((write_mode[i] == 0) && ((WQ[i].occupancy >= DRAM_WRITE_HIGH_WM) || ((RQ[i].occupancy == 0) && (WQ[i].occupancy > 0))))
+            return 0;
+        if (write_mode[i] && ((WQ[i].occupancy == 0) || (RQ[i].occupancy && (WQ[i].occupancy < DRAM_WRITE_LOW_WM))))
+            return 0;
+
+        // only the queue of the current mode is scheduled and processed
+        PACKET_QUEUE *queue = write_mode[i] ? &WQ[i] : &RQ[i];
+
+        // schedule() is a no-op while every unscheduled request targets a busy bank,
+        // and banks are only released by process()
+        if ((queue->next_schedule_index < queue->SIZE) && (queue->next_schedule_cycle < next_cycle)) {
+            for (uint32_t j=0; j<queue->SIZE; j++) {
+                uint64_t op_addr = queue->entry[j].address;
+                if (queue->entry[j].scheduled || (op_addr == 0))
+                    continue;
+
+                if (bank_request[dram_get_channel(op_addr)][dram_get_rank(op_addr)][dram_get_bank(op_addr)].working == 0) {
+                    next_cycle = queue->next_schedule_cycle;
+                    break;
+                }
+            }
+        }
+
+        // process() waits for both the request and its bank
+        if (queue->next_process_index < queue->SIZE) {
+            uint64_t op_addr = queue->entry[queue->next_process_index].address,
+                     process_cycle = queue->next_process_cycle,
+                     bank_cycle = bank_request[dram_get_channel(op_addr)][dram_get_rank(op_addr)][dram_get_bank(op_addr)].cycle_available;
+
+            if (bank_cycle > process_cycle)
+                process_cycle = bank_cycle;
+            if (process_cycle < next_cycle)
+                next_cycle = process_cycle;
+        }
+    }
+
+    return next_cycle;
+}
+
 void MEMORY_CONTROLLER::schedule(PACKET_QUEUE *queue)
 {
     uint64_t read_addr;
@@ -348,6 +420,12 @@ void MEMORY_CONTROLLER::process(PACKET_QUEUE *queue)
                 scheduled_reads[op_channel]--;
             }
 
+            // the data is on the bus until dbus_cycle_available
+            // only the request that owns the queue entry is sampled: reads merged into it by add_rq()/add_wq()
+            // and reads forwarded from the WQ never get here, so they are not in the DRAM percentiles
+            if ((op_cpu < NUM_CPUS) && (op_type < NUM_TYPES))
+                sim_latency[op_cpu][op_type].add(dbus_cycle_available[op_channel] - queue->entry[request_index].cycle_enqueued);
+
             // remove the oldest entry
             queue->remove_queue(&queue->entry[request_index]);
             update_process_cycle(queue);
@@ -455,15 +533,17 @@ int MEMORY_CONTROLLER::add_rq(PACKET *packet)
     }
 
     // check for duplicates in the read queue
-    int index = check_dram_queue(&RQ[channel], packet);
-    if (index != -1)
-        return index; // merged index
+    int merged_index = check_dram_queue(&RQ[channel], packet);
+    if (merged_index != -1)
+        return merged_index;
 
     // search for the empty index
-    for (index=0; index<DRAM_RQ_SIZE; index++) {
+    for (uint32_t index=0; index<DRAM_RQ_SIZE; index++) {
         if (RQ[channel].entry[index].address == 0) {
             
             RQ[channel].entry[index] = *packet;
+            RQ[channel].entry[index].cycle_enqueued = current_core_cycle[packet->cpu];
+            RQ[channel].add_index(index);
             RQ[channel].occupancy++;
 
 #ifdef DEBUG_PRINT
@@ -497,15 +577,17 @@ int MEMORY_CONTROLLER::add_wq(PACKET *packet)
 
     // check for duplicates in the write queue
     uint32_t channel = dram_get_channel(packet->address);
-    int index = check_dram_queue(&WQ[channel], packet);
-    if (index != -1)
-        return index; // merged index
+    int merged_index = check_dram_queue(&WQ[channel], packet);
+    if (merged_index != -1)
+        return merged_index;
 
     // search for the empty index
-    for (index=0; index<DRAM_WQ_SIZE; index++) {
+    for (uint32_t index=0; index<DRAM_WQ_SIZE; index++) {
         if (WQ[channel].entry[index].address == 0) {
             
             WQ[channel].entry[index] = *packet;
+            WQ[channel].entry[index].cycle_enqueued = current_core_cycle[packet->cpu];
+            WQ[channel].add_index(index);
             WQ[channel].occupancy++;
 
 #ifdef DEBUG_PRINT
@@ -599,16 +681,15 @@ void MEMORY_CONTROLLER::update_process_cycle(PACKET_QUEUE *queue)
 
 int MEMORY_CONTROLLER::check_dram_queue(PACKET_QUEUE *queue, PACKET *packet)
 {
-    // search write queue
-    for (uint32_t index=0; index<queue->SIZE; index++) {
-        if (queue->entry[index].address == packet->address) {
-            
-            DP ( if (warmup_complete[packet->cpu]) {
-            cout << "[" << queue->NAME << "] " << __func__ << " same entry instr_id: " << packet->instr_id << " prior_id: " << queue->entry[index].instr_id;
-            cout << " address: " << hex << packet->address << " full_addr: " << packet->full_addr << dec << endl; });
+    // search the queue's address index
+    int index = queue->check_queue(packet);
+    if (index != -1) {
 
-            return index;
-        }
+        DP ( if (warmup_complete[packet->cpu]) {
+        cout << "[" << queue->NAME << "] " << __func__ << " same entry instr_id: " << packet->instr_id << " prior_id: " << queue->entry[index].instr_id;
+        cout << " address: " << hex << packet->address << " full_addr: " << packet->full_addr << dec << endl; });
+
+        return index;
     }
 
     DP ( if (warmup_complete[packet->cpu]) {
@@ -697,6 +778,11 @@ uint32_t MEMORY_CONTROLLER::get_size(uint8_t queue_type, uint64_t address)
     return 0;
 }
 
+uint32_t MEMORY_CONTROLLER::get_queue_id(uint8_t queue_type, uint64_t address)
+{
+    return dram_get_channel(address);
+}
+
 void MEMORY_CONTROLLER::increment_WQ_FULL(uint64_t address)
 {
     uint32_t channel = dram_get_channel(address);
@@ -0,0 +1,109 @@
+#include "hash_table.h"
+
+static uint64_t hash_key(uint64_t key)
+{
+    // vpages and cache line addresses are mostly sequential, mix all bits into the low ones
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return key;
+}
+
+uint64_t *HASH_TABLE::find(uint64_t key)
+{
+    for (uint64_t i = hash_key(key) & mask; valid[i]; i = (i + 1) & mask) {
+        if (keys[i] == key)
+            return &values[i];
+    }
+
+    return NULL;
+}
+
+uint64_t *HASH_TABLE::insert(uint64_t key, uint64_t value)
+{
+    // keep the load factor under 1/2 so probe sequences stay short
+    if (2*(occupancy + 1) > keys.size())
+        resize(2*keys.size());
+
+    uint64_t i = hash_key(key) & mask;
+    for (; valid[i]; i = (i + 1) & mask) {
+        if (keys[i] == key) {
+            values[i] = value;
+            return &values[i];
+        }
+    }
+
+    keys[i] = key;
+    values[i] = value;
+    valid[i] = 1;
+    occupancy++;
+
+    return &values[i];
+}
+
+void HASH_TABLE::erase(uint64_t key)
+{
+    uint64_t i = hash_key(key) & mask;
+    for (; valid[i]; i = (i + 1) & mask) {
+        if (keys[i] == key)
+            break;
+    }
+    if (valid[i] == 0)
+        return;
+
+    valid[i] = 0;
+    occupancy--;
+
+    // no tombstones: move back every following entry of the run whose home slot is not between the hole and itself
+    for (uint64_t j = (i + 1) & mask; valid[j]; j = (j + 1) & mask) {
+        uint64_t home = hash_key(keys[j]) & mask;
+        if ((i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j)))
+            continue;
+
+        keys[i] = keys[j];
+        values[i] = values[j];
+        valid[i] = 1;
+        valid[j] = 0;
+        i = j;
+    }
+}
+
+void HASH_TABLE::clear()
+{
+    keys.clear();
+    values.clear();
+    valid.clear();
+    resize(HASH_TABLE_MIN_SIZE);
+}
+
+void HASH_TABLE::swap(HASH_TABLE &other)
+{
+    keys.swap(other.keys);
+    values.swap(other.values);
+    valid.swap(other.valid);
+    std::swap(occupancy, other.occupancy);
+    std::swap(mask, other.mask);
+}
+
+void HASH_TABLE::resize(uint64_t size)
+{
+    vector <uint64_t> old_keys, old_values;
+    vector <uint8_t> old_valid;
+    old_keys.swap(keys);
+    old_values.swap(values);
+    old_valid.swap(valid);
+
+    keys.assign(size, 0);
+    values.assign(size, 0);
+    valid.assign(size, 0);
+    mask = size - 1;
+    occupancy = 0;
+
+    for (uint64_t i=0; i<old_keys.size(); i++) {
+        if (old_valid[i])
+            insert(old_keys[i], old_values[i]);
+    }
+}
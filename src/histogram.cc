@@ -0,0 +1,58 @@
+#include "histogram.h"
+
+#include <math.h>
+
+static uint32_t bucket_index(uint64_t latency)
+{
+    if (latency < HISTOGRAM_SUB_BUCKETS)
+        return latency;
+
+    // the top bit picks the power of two, the next bits the bucket within it
+    uint32_t log2_latency = 63 - __builtin_clzll(latency),
+             sub_bucket = (latency >> (log2_latency - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+
+    return (log2_latency - HISTOGRAM_SUB_BUCKET_BITS + 1)*HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+static uint64_t bucket_max(uint32_t index)
+{
+    if (index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+
+    uint32_t log2_latency = index/HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKET_BITS - 1,
+             sub_bucket = index%HISTOGRAM_SUB_BUCKETS;
+    uint64_t width = 1ULL << (log2_latency - HISTOGRAM_SUB_BUCKET_BITS);
+
+    return (HISTOGRAM_SUB_BUCKETS + sub_bucket)*width + width - 1;
+}
+
+void LATENCY_HISTOGRAM::clear()
+{
+    count = 0;
+    for (uint32_t i=0; i<HISTOGRAM_BUCKETS; i++)
+        bucket[i] = 0;
+}
+
+void LATENCY_HISTOGRAM::add(uint64_t latency)
+{
+    bucket[bucket_index(latency)]++;
+    count++;
+}
+
+uint64_t LATENCY_HISTOGRAM::percentile(double fraction)
+{
+    if (count == 0)
+        return 0;
+
+    uint64_t target = (uint64_t) ceil(fraction * count), seen = 0;
+    if (target == 0)
+        target = 1;
+
+    for (uint32_t i=0; i<HISTOGRAM_BUCKETS; i++) {
+        seen += bucket[i];
+        if (seen >= target)
+            return bucket_max(i);
+    }
+
+    return bucket_max(HISTOGRAM_BUCKETS - 1);
+}
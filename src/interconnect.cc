@@ -0,0 +1,332 @@
+#include "interconnect.h"
+
+uint8_t NOC_TOPOLOGY = NOC_NONE;
+uint32_t NOC_HOP_LATENCY = 1,
+         NOC_LINK_WIDTH = 32,
+         NOC_LINK_QUEUE = 8;
+
+void INTERCONNECT::configure(uint8_t v1, uint32_t v2, uint32_t v3, uint32_t v4, CACHE *v5)
+{
+    topology = v1;
+    hop_latency = v2;
+    link_width = v3;
+    link_queue = v4;
+    llc = v5;
+
+    num_nodes = (NUM_CPUS > llc->num_slices) ? NUM_CPUS : llc->num_slices;
+
+    uint32_t grid_nodes = num_nodes;
+    if (topology == NOC_RING) {
+        // 0: to the next node, 1: to the previous node
+        num_ports = 3;
+    }
+    else {
+        // 0: east, 1: west, 2: south, 3: north
+        num_ports = 5;
+        for (columns = 1; (columns * columns) < num_nodes; columns++);
+        rows = (num_nodes + columns - 1) / columns;
+        grid_nodes = rows * columns;
+    }
+
+    link.clear();
+    link.resize(grid_nodes * num_ports);
+    for (uint32_t i=0; i<grid_nodes; i++) {
+        for (uint32_t j=0; j<num_ports; j++)
+            link[i*num_ports + j].node = i;
+
+        if (topology == NOC_RING) {
+            link[i*num_ports + 0].node = (i + 1) % num_nodes;
+            link[i*num_ports + 1].node = (i + num_nodes - 1) % num_nodes;
+        }
+        else {
+            // links off the edge of the grid are never routed over
+            if ((i % columns) + 1 < columns)
+                link[i*num_ports + 0].node = i + 1;
+            if (i % columns)
+                link[i*num_ports + 1].node = i - 1;
+            if ((i / columns) + 1 < rows)
+                link[i*num_ports + 2].node = i + columns;
+            if (i / columns)
+                link[i*num_ports + 3].node = i - columns;
+        }
+    }
+}
+
+void INTERCONNECT::reset_stats()
+{
+    for (uint32_t i=0; i<NOC_CLASSES; i++) {
+        packets[i] = 0;
+        flits[i] = 0;
+        hops[i] = 0;
+        total_latency[i] = 0;
+    }
+
+    for (uint32_t i=0; i<link.size(); i++) {
+        link[i].packets = 0;
+        link[i].flits = 0;
+        link[i].stall = 0;
+    }
+}
+
+uint32_t INTERCONNECT::core_node(uint32_t cpu)
+{
+    return cpu * num_nodes / NUM_CPUS;
+}
+
+uint32_t INTERCONNECT::slice_node(uint64_t address)
+{
+    return llc->get_slice(address) * num_nodes / llc->num_slices;
+}
+
+// the link a packet at node takes towards dest
+uint32_t INTERCONNECT::next_link(uint32_t node, uint32_t dest)
+{
+    uint32_t port = num_ports - 1;
+
+    if (node == dest)
+        return node*num_ports + port;
+
+    if (topology == NOC_RING) {
+        uint32_t distance = (dest + num_nodes - node) % num_nodes;
+        port = (distance <= (num_nodes / 2)) ? 0 : 1;
+    }
+    else {
+        uint32_t x = node % columns, y = node / columns,
+                 dest_x = dest % columns, dest_y = dest / columns;
+
+        if (x < dest_x)
+            port = 0;
+        else if (x > dest_x)
+            port = 1;
+        else if (y < dest_y)
+            port = 2;
+        else
+            port = 3;
+    }
+
+    return node*num_ports + port;
+}
+
+NOC_LINK *INTERCONNECT::first_link(uint32_t cpu, uint64_t address)
+{
+    return &link[next_link(core_node(cpu), slice_node(address))];
+}
+
+int INTERCONNECT::inject(NOC_PACKET *packet, uint32_t node, uint8_t noc_class)
+{
+    link[next_link(node, packet->dest)].queue[noc_class].push_back(*packet);
+    in_flight++;
+
+    return -1;
+}
+
+// hands a packet to the LLC or back to its L2C, 0 if the LLC queue is full
+uint8_t INTERCONNECT::deliver(NOC_PACKET *noc_packet)
+{
+    PACKET *packet = &noc_packet->packet;
+    NOC_PORT *source = &port[packet->cpu];
+
+    if (noc_packet->queue_type == 0) {
+        source->upper_level_dcache[packet->cpu]->return_data(packet);
+        return 1;
+    }
+
+    if (noc_packet->queue_type == 1)
+        return (source->lower_level->add_rq(packet) != -2);
+
+    if (noc_packet->queue_type == 2) {
+        if (source->lower_level->get_occupancy(2, packet->address) == source->lower_level->get_size(2, packet->address))
+            return 0;
+        source->lower_level->add_wq(packet);
+        return 1;
+    }
+
+    return (source->lower_level->add_pq(packet) != -2);
+}
+
+void INTERCONNECT::operate()
+{
+    if (in_flight == 0)
+        return;
+
+    // all cores tick together
+    uint64_t cycle = current_core_cycle[0];
+
+    for (uint32_t i=0; i<link.size(); i++) {
+        NOC_LINK *current = &link[i];
+        if (current->busy_cycle > cycle)
+            continue;
+
+        // responses go first, the cores are waiting for them
+        for (int c=NOC_CLASSES-1; c>=0; c--) {
+            if (current->queue[c].empty() || (current->queue[c].front().ready_cycle > cycle))
+                continue;
+
+            NOC_PACKET packet = current->queue[c].front();
+
+            if ((i % num_ports) == (num_ports - 1)) {
+                // delivering may send a response back through this very port
+                current->queue[c].pop_front();
+                if (deliver(&packet) == 0) {
+                    current->queue[c].push_front(packet);
+                    current->stall++;
+                    continue;
+                }
+
+                in_flight--;
+                packets[c]++;
+                flits[c] += packet.flits;
+                hops[c] += packet.hops;
+                total_latency[c] += cycle - packet.inject_cycle;
+            }
+            else {
+                NOC_LINK *next = &link[next_link(current->node, packet.dest)];
+                if (next->queue[c].size() >= link_queue) {
+                    current->stall++;
+                    continue;
+                }
+
+                current->queue[c].pop_front();
+                packet.ready_cycle = cycle + hop_latency + packet.flits - 1;
+                packet.hops++;
+                next->queue[c].push_back(packet);
+            }
+
+            current->busy_cycle = cycle + packet.flits;
+            current->packets++;
+            current->flits += packet.flits;
+            break;
+        }
+    }
+}
+
+uint64_t INTERCONNECT::get_next_event_cycle()
+{
+    if (in_flight == 0)
+        return UINT64_MAX;
+
+    uint64_t next_cycle = UINT64_MAX;
+    for (uint32_t i=0; i<link.size(); i++) {
+        for (uint32_t c=0; c<NOC_CLASSES; c++) {
+            if (link[i].queue[c].empty())
+                continue;
+
+            uint64_t cycle = link[i].queue[c].front().ready_cycle;
+            if (cycle < link[i].busy_cycle)
+                cycle = link[i].busy_cycle;
+            if (cycle < next_cycle)
+                next_cycle = cycle;
+        }
+    }
+
+    return next_cycle;
+}
+
+static void build_packet(NOC_PACKET *noc_packet, PACKET *packet, uint32_t dest, uint8_t queue_type, uint32_t link_width)
+{
+    noc_packet->packet = *packet;
+    noc_packet->ready_cycle = current_core_cycle[packet->cpu];
+    noc_packet->inject_cycle = current_core_cycle[packet->cpu];
+    noc_packet->dest = dest;
+    noc_packet->hops = 0;
+    noc_packet->queue_type = queue_type;
+
+    // a header flit, then the block for writebacks and returned data
+    noc_packet->flits = 1;
+    if ((queue_type == 0) || (queue_type == 2))
+        noc_packet->flits += (BLOCK_SIZE + link_width - 1) / link_width;
+}
+
+int NOC_PORT::add_rq(PACKET *packet)
+{
+    if (get_occupancy(1, packet->address) == get_size(1, packet->address))
+        return -2;
+
+    NOC_PACKET noc_packet;
+    build_packet(&noc_packet, packet, noc->slice_node(packet->address), 1, noc->link_width);
+
+    return noc->inject(&noc_packet, noc->core_node(cpu), NOC_REQUEST);
+}
+
+int NOC_PORT::add_wq(PACKET *packet)
+{
+    // the L2C checked get_occupancy(), a writeback is never dropped
+    NOC_PACKET noc_packet;
+    build_packet(&noc_packet, packet, noc->slice_node(packet->address), 2, noc->link_width);
+
+    return noc->inject(&noc_packet, noc->core_node(cpu), NOC_REQUEST);
+}
+
+int NOC_PORT::add_pq(PACKET *packet)
+{
+    if (get_occupancy(3, packet->address) == get_size(3, packet->address))
+        return -2;
+
+    NOC_PACKET noc_packet;
+    build_packet(&noc_packet, packet, noc->slice_node(packet->address), 3, noc->link_width);
+
+    return noc->inject(&noc_packet, noc->core_node(cpu), NOC_REQUEST);
+}
+
+void NOC_PORT::return_data(PACKET *packet)
+{
+    // the LLC cannot hold on to its data, the response queues take whatever it returns
+    NOC_PACKET noc_packet;
+    build_packet(&noc_packet, packet, noc->core_node(cpu), 0, noc->link_width);
+
+    noc->inject(&noc_packet, noc->slice_node(packet->address), NOC_RESPONSE);
+}
+
+void NOC_PORT::operate()
+{
+    // packets move in INTERCONNECT::operate()
+}
+
+void NOC_PORT::increment_WQ_FULL(uint64_t address)
+{
+    lower_level->increment_WQ_FULL(address);
+}
+
+void NOC_PORT::functional_access(PACKET *packet)
+{
+    lower_level->functional_access(packet);
+}
+
+// the request queues are the ones of the first link on the way to the slice, the MSHR is the LLC's
+uint32_t NOC_PORT::get_occupancy(uint8_t queue_type, uint64_t address)
+{
+    if ((queue_type == 0) || (queue_type > 3))
+        return lower_level->get_occupancy(queue_type, address);
+
+    uint32_t occupancy = noc->first_link(cpu, address)->queue[NOC_REQUEST].size();
+    if (occupancy > noc->link_queue)
+        occupancy = noc->link_queue;
+
+    return occupancy;
+}
+
+uint32_t NOC_PORT::get_size(uint8_t queue_type, uint64_t address)
+{
+    if ((queue_type == 0) || (queue_type > 3))
+        return lower_level->get_size(queue_type, address);
+
+    return noc->link_queue;
+}
+
+uint32_t NOC_PORT::get_queue_id(uint8_t queue_type, uint64_t address)
+{
+    if ((queue_type == 0) || (queue_type > 3))
+        return lower_level->get_queue_id(queue_type, address);
+
+    return noc->first_link(cpu, address) - &noc->link[0];
+}
+
+uint64_t NOC_PORT::get_next_event_cycle()
+{
+    return UINT64_MAX;
+}
+
+uint8_t NOC_PORT::invalidate_line(uint64_t address)
+{
+    return upper_level_dcache[cpu]->invalidate_line(address);
+}
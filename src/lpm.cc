@@ -20,6 +20,7 @@ void LPM::init_LPM(int total_cache_level, float delta, uint64_t new_window_width
 	ratio_memory_compute = delta;
 	window_width = new_window_width;
 	last_inst_num = 0;
+	print_detail = true;
 
 	pure_miss_cycle = new int[cache_level_count];
 	mix_cycle = new int[cache_level_count];
@@ -32,13 +33,12 @@ void LPM::init_LPM(int total_cache_level, float delta, uint64_t new_window_width
 
 	need_update = new bool[cache_level_count];
 
-	cycle_stat = new struct cycle_stat_t*[cache_level_count];
+	level_stat = new struct level_stat_t[cache_level_count];
 
 	access_count = new int[cache_level_count];
 
 	for (int i = 0; i < cache_level_count; i++)
 	{
-		cycle_stat[i] = new struct cycle_stat_t[window_width];
 		access_count[i] = 0;
 	}
 
@@ -66,11 +66,59 @@ void LPM::reset(uint64_t new_start_cycle)
 		need_update[idx] = false;
 		access_count[idx] = 0;
 
-		for (int cyc_idx = 0; cyc_idx < window_width; cyc_idx++)
+		// accesses still in flight from the last window are forgotten
+		level_stat[idx].in_flight.hit_count = 0;
+		level_stat[idx].in_flight.miss_count = 0;
+		level_stat[idx].pending.clear();
+		level_stat[idx].counted_cycle = new_start_cycle;
+		level_stat[idx].pure_hit = 0;
+		level_stat[idx].pure_miss = 0;
+		level_stat[idx].mix = 0;
+	}
+}
+
+void LPM::advance(int cache_level, uint64_t cycle)
+{
+	struct level_stat_t* stat = &level_stat[cache_level];
+
+	while(stat->counted_cycle < cycle)
+	{
+		map<uint64_t, struct cycle_stat_t>::iterator next = stat->pending.begin();
+
+		// a change that came in after its cycle was counted still applies from here on
+		if(next != stat->pending.end() && next->first <= stat->counted_cycle)
 		{
-			cycle_stat[idx][cyc_idx].hit_count = 0;
-			cycle_stat[idx][cyc_idx].miss_count = 0;
+			stat->in_flight.hit_count += next->second.hit_count;
+			stat->in_flight.miss_count += next->second.miss_count;
+			stat->pending.erase(next);
+			continue;
 		}
+
+		uint64_t end_cycle = cycle;
+		if(next != stat->pending.end() && next->first < end_cycle)
+		{
+			end_cycle = next->first;
+		}
+
+		if(stat->in_flight.miss_count > 0) // pure miss cycle or mix cycle
+		{
+			if(stat->in_flight.hit_count > 0) // mix cycle
+			{
+				stat->mix += end_cycle - stat->counted_cycle;
+			}
+			else //pure miss cycle
+			{
+				stat->pure_miss += end_cycle - stat->counted_cycle;
+			}
+		}
+		else // pure hit cycle or memory non-active cycle
+		{
+			if(stat->in_flight.hit_count > 0) // pure hit cycle
+			{
+				stat->pure_hit += end_cycle - stat->counted_cycle;
+			}
+		}
+		stat->counted_cycle = end_cycle;
 	}
 }
 
@@ -81,35 +129,20 @@ bool LPM::update_lpmr(int cache_level, int inst_num, uint64_t current_cycle)
 		return false;
 	}
 
+	uint64_t end_cycle = current_cycle;
+	if(end_cycle > window_start_cycle + window_width)
+	{
+		end_cycle = window_start_cycle + window_width;
+	}
+
 	// update m,x,w,h
 	for(int cache_level_idx = 0; cache_level_idx < cache_level_count; ++cache_level_idx)
 	{
-		mix_cycle[cache_level_idx] = 0;
-		pure_miss_cycle[cache_level_idx] = 0;
-		pure_hit_cycle[cache_level_idx] = 0;
-		active_cycle[cache_level_idx] = 0;
+		advance(cache_level_idx, end_cycle);
 
-		for(int cyc_idx= 0; cyc_idx < (current_cycle - window_start_cycle); cyc_idx++)
-		{
-			if(cycle_stat[cache_level_idx][cyc_idx].miss_count > 0) // pure miss cycle or mix cycle
-			{
-				if(cycle_stat[cache_level_idx][cyc_idx].hit_count > 0) // mix cycle
-				{
-					mix_cycle[cache_level_idx]++;
-				}
-				else //pure miss cycle
-				{
-					pure_miss_cycle[cache_level_idx]++;
-				}
-			}
-			else // pure hit cycle or memory non-active cycle
-			{
-				if(cycle_stat[cache_level_idx][cyc_idx].hit_count > 0) // pure hit cycle
-				{
-					pure_hit_cycle[cache_level_idx]++;
-				}
-			}
-		}
+		mix_cycle[cache_level_idx] = level_stat[cache_level_idx].mix;
+		pure_miss_cycle[cache_level_idx] = level_stat[cache_level_idx].pure_miss;
+		pure_hit_cycle[cache_level_idx] = level_stat[cache_level_idx].pure_hit;
 		active_cycle[cache_level_idx] = pure_miss_cycle[cache_level_idx] + mix_cycle[cache_level_idx] 
 			+ pure_hit_cycle[cache_level_idx];
 		ratio_miss_cycle_active_cycle[cache_level_idx]
@@ -150,11 +183,14 @@ bool LPM::update_lpmr(int cache_level, int inst_num, uint64_t current_cycle)
 
 
 	// for test
-	cout<<endl<<"window width: "<<window_width<<endl;
-	cout<<endl<<"m[0]="<<pure_miss_cycle[0]<<", x[0]="<<mix_cycle[0]<<", h[0]="<<pure_hit_cycle[0]<<", w[0]="<<active_cycle[0]<<", div="<<ratio_miss_cycle_active_cycle[0]<<endl;
-	cout<<"m[1]="<<pure_miss_cycle[1]<<", x[1]="<<mix_cycle[1]<<", h[1]="<<pure_hit_cycle[1]<<", w[1]="<<active_cycle[1]<<", div="<<ratio_miss_cycle_active_cycle[1]<<endl;
-	cout<<"m[2]="<<pure_miss_cycle[2]<<", x[2]="<<mix_cycle[2]<<", h[2]="<<pure_hit_cycle[2]<<", w[2]="<<active_cycle[2]<<", div="<<ratio_miss_cycle_active_cycle[2]<<endl;
-	cout << "inst_count="<<inst_count<<", cycle_count="<<cycle_count<<", f_mem="<<f_mem<<", access_count="<<access_count[cache_level]<<", active_cycle="<<active_cycle[cache_level]<<", multiplex_ratio_miss_cycle_active_cycle="<<multiplex_ratio_miss_cycle_active_cycle<<endl;
+	if(print_detail)
+	{
+		cout<<endl<<"window width: "<<window_width<<endl;
+		cout<<endl<<"m[0]="<<pure_miss_cycle[0]<<", x[0]="<<mix_cycle[0]<<", h[0]="<<pure_hit_cycle[0]<<", w[0]="<<active_cycle[0]<<", div="<<ratio_miss_cycle_active_cycle[0]<<endl;
+		cout<<"m[1]="<<pure_miss_cycle[1]<<", x[1]="<<mix_cycle[1]<<", h[1]="<<pure_hit_cycle[1]<<", w[1]="<<active_cycle[1]<<", div="<<ratio_miss_cycle_active_cycle[1]<<endl;
+		cout<<"m[2]="<<pure_miss_cycle[2]<<", x[2]="<<mix_cycle[2]<<", h[2]="<<pure_hit_cycle[2]<<", w[2]="<<active_cycle[2]<<", div="<<ratio_miss_cycle_active_cycle[2]<<endl;
+		cout << "inst_count="<<inst_count<<", cycle_count="<<cycle_count<<", f_mem="<<f_mem<<", access_count="<<access_count[cache_level]<<", active_cycle="<<active_cycle[cache_level]<<", multiplex_ratio_miss_cycle_active_cycle="<<multiplex_ratio_miss_cycle_active_cycle<<endl;
+	}
 
 	lpmr[cache_level] = ((float)inst_count) / ((float)cycle_count) 
 			* f_mem *  ((float)active_cycle[0]) / ((float)access_count[0])
@@ -208,38 +244,49 @@ bool LPM::access_reg(int cache_level, uint64_t event_cycle, uint64_t hit_latency
 		return false;
 	}
 
+	// an access only adds the cycles its intervals start and end at, advance() counts the cycles in between
+	uint64_t window_end_cycle = window_start_cycle + window_width;
+	map<uint64_t, struct cycle_stat_t>& pending = level_stat[cache_level].pending;
+
 	if (type == LPM_ACCESS_END_EXTEND)
 	{
-		for(uint64_t cycle_idx=0; cycle_idx < event_cycle - window_start_cycle; cycle_idx++)
+		// a miss since the start of the window
+		pending[window_start_cycle].miss_count++;
+		if(event_cycle < window_end_cycle)
 		{
-			cycle_stat[cache_level][cycle_idx].miss_count++;
+			pending[event_cycle].miss_count--;
 		}
 		access_count[cache_level]++;
 		need_update[cache_level] = true;
 		return true;
 	}
 	
-	uint64_t start_cycle_idx = event_cycle - window_start_cycle;
-	//uint64_t end_cycle_idx = ((start_cycle_idx + cycle_count) < window_width) ? (start_cycle_idx+cycle_count) : window_width;
+	if(event_cycle >= window_end_cycle)
+	{
+		need_update[cache_level] = true;
+		return true;
+	}
 
-	for(uint64_t cycle_idx = start_cycle_idx; cycle_idx < window_width; ++cycle_idx)
+	if(type == LPM_ACCESS_START)
 	{
-		if(type == LPM_ACCESS_START)
-		{
-			if(cycle_idx - start_cycle_idx < hit_latency)
-			{
-				cycle_stat[cache_level][cycle_idx].hit_count++;
-				access_count[cache_level]++;
-			}
-			else
-			{
-				cycle_stat[cache_level][cycle_idx].miss_count++;
-			}
-		}
-		else // LPM_ACCESS_END
+		// accesses start in cycle order, so everything before this one is settled
+		advance(cache_level, event_cycle);
+
+		// hit for hit_latency cycles, then a miss until the end of the window or its LPM_ACCESS_END
+		uint64_t hit_end_cycle = ((event_cycle + hit_latency) < window_end_cycle) ? (event_cycle + hit_latency) : window_end_cycle;
+		pending[event_cycle].hit_count++;
+		if(hit_end_cycle < window_end_cycle)
 		{
-			cycle_stat[cache_level][cycle_idx].miss_count--;
+			pending[hit_end_cycle].hit_count--;
+			pending[hit_end_cycle].miss_count++;
 		}
+
+		// one access per hit cycle, as update_lpmr() expects
+		access_count[cache_level] += hit_end_cycle - event_cycle;
+	}
+	else // LPM_ACCESS_END
+	{
+		pending[event_cycle].miss_count--;
 	}
 	// for test
 	//cout<<"lpm need update"<<endl;
@@ -268,16 +315,7 @@ void LPM::set_window_width(uint64_t new_window_width)
 {
 	window_width = new_window_width;
 
-	for (int i = 0; i < cache_level_count; i++)
-	{
-		delete [] cycle_stat[i];
-		cycle_stat[i] = new struct cycle_stat_t[window_width];
-		for (int j = 0; j < window_width; j++)
-		{
-			cycle_stat[i][j].hit_count = 0;
-			cycle_stat[i][j].miss_count = 0;
-		}
-	}
+	reset(window_start_cycle);
 }
 
 void LPM::_destroy_lpm()
@@ -290,9 +328,5 @@ void LPM::_destroy_lpm()
 	delete []ratio_pure_miss_cycle_all_miss_cycle;
 	delete []lpmr;
 	delete []need_update;
-	for(int i = 0; i < cache_level_count; i++)
-	{
-		delete []cycle_stat[i];
-	}
-	delete []cycle_stat;
+	delete []level_stat;
 }
\ No newline at end of file
@@ -3,7 +3,13 @@
 #include <getopt.h>
 #include "ooo_cpu.h"
 #include "uncore.h"
+#include "core_port.h"
+#include "page_table.h"
+#include "config.h"
+#include "stats.h"
 #include <fstream>
+#include <mutex>
+#include <condition_variable>
 
 // zmz modify
 int mosaic_cache_adaptive_way_num[3];
@@ -26,127 +32,468 @@ uint8_t warmup_complete[NUM_CPUS],
         all_simulation_complete = 0,
         MAX_INSTR_DESTINATIONS = NUM_INSTR_DESTINATIONS,
         knob_cloudsuite = 0,
-        knob_low_bandwidth = 0;
+        knob_low_bandwidth = 0,
+        knob_cycle_skipping = 0,
+        knob_trace_prefetch = 0,
+        knob_functional_warmup = 0,
+        functional_warmup = 0;
 
 uint64_t warmup_instructions     = 1000000,
          simulation_instructions = 10000000,
-         champsim_seed;
+         skip_instructions       = 0,
+         champsim_seed,
+         skipped_cycles = 0;
+
+// parallel simulation: host threads for the cores, and cycles between two syncs with the uncore
+uint32_t knob_sim_threads = 0;
+uint64_t sync_quantum = 0;
 
 time_t start_time;
 
+// warmed-up state checkpoint
+char save_checkpoint_name[1024] = "",
+     load_checkpoint_name[1024] = "",
+     config_name[1024] = "",
+     stats_name[1024] = "",
+     json_stats_name[1024] = "";
+
 // PAGE TABLE
 uint32_t PAGE_TABLE_LATENCY = 0, SWAP_LATENCY = 0;
 queue <uint64_t > page_queue;
-map <uint64_t, uint64_t> page_table, inverse_table, recent_page, unique_cl[NUM_CPUS];
+HASH_TABLE page_table, inverse_table, unique_cl[NUM_CPUS];
+vector <PAGE_FRAME> page_frames;
+uint64_t clock_hand = 0;
 uint64_t previous_ppage, num_adjacent_page, num_cl[NUM_CPUS], allocated_pages, num_page[NUM_CPUS], minor_fault[NUM_CPUS], major_fault[NUM_CPUS];
+mutex page_table_lock; // the page tables are shared by the core threads
 
 // zmz modify
 // WARNING: THE FOLLOWING FUNCTIONS ARE FOR MOSAIC CACHE ONLY!
-void _mosaic_cache_solve_op(int op_id, int origin_way_pos)
+// the private way boundary op_id moves, where it is now or where the pending reconfig of the core puts it
+int _mosaic_cache_get_op_boundary(int core_idx, int op_id, bool pending)
 {
-    //Mosaic_Cache Mosaic_Cache_Monitor=Get_Instance();
-    int start_pos, end_pos;
-    CACHE* cache_ptr = NULL;
-    int writeback_cache_level;
+    switch (op_id)
+    {
+        case 1:
+            if(pending)
+                return Mosaic_Cache_Monitor.get_pending_way_end_pos(core_idx, LPM_L1);
+            return Mosaic_Cache_Monitor.get_current_way_end_pos(core_idx, LPM_L1);
+        case 2:
+            if(pending)
+                return Mosaic_Cache_Monitor.get_pending_way_start_pos(core_idx, LPM_L2);
+            return Mosaic_Cache_Monitor.get_current_way_start_pos(core_idx, LPM_L2);
+        case 3:
+            if(pending)
+                return Mosaic_Cache_Monitor.get_pending_way_end_pos(core_idx, LPM_L2);
+            return Mosaic_Cache_Monitor.get_current_way_end_pos(core_idx, LPM_L2);
+        default:
+            assert(0);
+    }
 
+    return -1;
+}
+
+// the private ways core_idx gives away in op_id, [start_pos, end_pos) of the returned cache
+// the boundary moves from origin_way_pos to new_way_pos
+CACHE* _mosaic_cache_get_op_ways(int core_idx, int op_id, int origin_way_pos, int new_way_pos, int *start_pos, int *end_pos)
+{
     switch (op_id)
     {
-        case 0:
-            return;
         case 1:
-            start_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L1);
-            end_pos = origin_way_pos;
-            writeback_cache_level = LPM_L1;
-            break;
+            *start_pos = new_way_pos;
+            *end_pos = origin_way_pos;
+            return &(ooo_cpu[core_idx].L1D);
         case 2:
-            start_pos = origin_way_pos;
-            end_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L2);
-            writeback_cache_level = LPM_L2;
-            break;
+            *start_pos = origin_way_pos;
+            *end_pos = new_way_pos;
+            return &(ooo_cpu[core_idx].L2C);
         case 3:
-            start_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L2);
-            end_pos =origin_way_pos;
-            writeback_cache_level = LPM_L2;
-            break;
-        case 4:
-            start_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
-            end_pos = origin_way_pos;
-            break;
+            *start_pos = new_way_pos;
+            *end_pos = origin_way_pos;
+            return &(ooo_cpu[core_idx].L2C);
         default:
-            return;
+            assert(0);
     }
 
-    bool rollback_flag = false;
+    return NULL;
+}
 
+// one past the last LLC way any core uses once the pending reconfigs are committed
+int _mosaic_cache_get_pending_l3_way_end_pos()
+{
+    int end_pos = 0;
     for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
     {
-        switch(op_id)
+        if(Mosaic_Cache_Monitor.get_pending_way_end_pos(core_idx, LPM_L3) > end_pos)
+            end_pos = Mosaic_Cache_Monitor.get_pending_way_end_pos(core_idx, LPM_L3);
+    }
+
+    return end_pos;
+}
+
+// the caches the lines of the ways core_idx gave away in op_id move to in migrate mode, by the core of the line
+void _mosaic_cache_get_op_receiver(int core_idx, int op_id, CACHE* receiver[NUM_CPUS])
+{
+    for(int i = 0; i < NUM_CPUS; i++)
+    {
+        switch (op_id)
         {
             case 1:
-                cache_ptr = &(ooo_cpu[core_idx].L1D);
+                receiver[i] = &(ooo_cpu[core_idx].L2C);
                 break;
             case 2:
-                cache_ptr = &(ooo_cpu[core_idx].L2C);
+                receiver[i] = &(ooo_cpu[core_idx].L1D);
                 break;
             case 3:
-                cache_ptr = &(ooo_cpu[core_idx].L2C);
+                receiver[i] = &(uncore.LLC);
                 break;
             case 4:
-                cache_ptr = &(uncore.LLC);
+                receiver[i] = &(ooo_cpu[i].L2C);
                 break;
             default:
                 assert(0);
         }
+    }
+}
+
+// forgets the ways the migrate dry runs of the last pass reserved, every level a line can move to
+void _mosaic_cache_clear_reserved()
+{
+    for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+    {
+        ooo_cpu[core_idx].L1D.mosaic_reserved.clear();
+        ooo_cpu[core_idx].L2C.mosaic_reserved.clear();
+    }
+    uncore.LLC.mosaic_reserved.clear();
+}
+
+// the dirty lines of [start_pos, end_pos) that have to be written back, in migrate mode the lines the
+// receivers have room for move there (or would, with dry_run) and do not count
+// they are also counted per lower WQ for mosaic_cache_can_writeback()
+int _mosaic_cache_count_writeback(CACHE *cache_ptr, int start_pos, int end_pos, CACHE* receiver[NUM_CPUS], uint8_t dry_run, int *migrate_num)
+{
+    int writeback_num = 0;
+
+    cache_ptr->mosaic_writeback_queue.clear();
+    for(int way_idx = start_pos; way_idx < end_pos; way_idx++)
+    {
+        if(Mosaic_Cache_Monitor.get_writeback_mode() == 2)
+            *migrate_num += cache_ptr->mosaic_cache_migrate_way(way_idx, receiver, dry_run, &writeback_num);
+        else
+            writeback_num += cache_ptr->mosaic_cache_get_writeback_count(way_idx);
+    }
+
+    return writeback_num;
+}
+
+// write back the ways given away in the last reconfig(), a core whose lower level cannot take them is rolled back
+// in migrate mode the lines move to the level that took the ways first, only what does not fit is written back
+// with drain, a core with any line to write back is deferred instead, _mosaic_cache_drain() writes them back
+// origin_way_pos[core][op] is the boundary op moves, origin_l3_way_end_pos the end of the LLC ways any core used
+void _mosaic_cache_solve_op(int origin_way_pos[NUM_CPUS][4], int origin_l3_way_end_pos, bool drain)
+{
+    //Mosaic_Cache Mosaic_Cache_Monitor=Get_Instance();
+    int start_pos, end_pos;
+    CACHE* cache_ptr = NULL;
+    CACHE* receiver[NUM_CPUS];
+    bool rollback_flag[NUM_CPUS];
+    bool any_rollback = false;
+
+    // non-writeback mode, the lines in the ways given away are left behind
+    if(Mosaic_Cache_Monitor.get_writeback_mode() == 1)
+        return;
+
+    // the dry runs of all cores share the receivers, a way one of them reserved is gone for the others
+    _mosaic_cache_clear_reserved();
+    for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+    {
+        rollback_flag[core_idx] = false;
+
+        int op_id = Mosaic_Cache_Monitor.get_last_operation(core_idx);
+        if(op_id < 1 || op_id > 3)
+            continue;
+
+        cache_ptr = _mosaic_cache_get_op_ways(core_idx, op_id, origin_way_pos[core_idx][op_id], _mosaic_cache_get_op_boundary(core_idx, op_id, false), &start_pos, &end_pos);
+        _mosaic_cache_get_op_receiver(core_idx, op_id, receiver);
+
+        int migrate_num = 0;
+        int writeback_num = _mosaic_cache_count_writeback(cache_ptr, start_pos, end_pos, receiver, 1, &migrate_num);
+        if(drain ? (writeback_num > 0) : !cache_ptr->mosaic_cache_can_writeback())
+        {
+            rollback_flag[core_idx] = true;
+            any_rollback = true;
+        }
+    }
+
+    // the cores that vote together go back together
+    for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+    {
+        if(rollback_flag[core_idx] || (any_rollback && Mosaic_Cache_Monitor.get_partition_mode() == 0))
+        {
+            if(drain)
+                Mosaic_Cache_Monitor.Defer(core_idx);
+            else
+                Mosaic_Cache_Monitor.RollBack(core_idx);
+        }
+    }
+
+    // the LLC is shared, only the ways no core uses any more are written back, and only once
+    // the cores giving back their L3 ways (op 4) are rolled back if the DRAM cannot take them
+    int l3_writeback_core = -1;
+    for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+    {
+        if(Mosaic_Cache_Monitor.get_last_operation(core_idx) == 4)
+        {
+            l3_writeback_core = core_idx;
+            break;
+        }
+    }
+    if(l3_writeback_core != -1)
+    {
+        _mosaic_cache_get_op_receiver(l3_writeback_core, 4, receiver);
+
+        int migrate_num = 0;
+        int writeback_num = _mosaic_cache_count_writeback(&(uncore.LLC), Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3), origin_l3_way_end_pos, receiver, 1, &migrate_num);
+        if(drain ? (writeback_num > 0) : !uncore.LLC.mosaic_cache_can_writeback())
+        {
+            for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+            {
+                if(Mosaic_Cache_Monitor.get_last_operation(core_idx) == 4)
+                {
+                    if(drain)
+                        Mosaic_Cache_Monitor.Defer(core_idx);
+                    else
+                        Mosaic_Cache_Monitor.RollBack(core_idx);
+                }
+            }
+            l3_writeback_core = -1;
+        }
+    }
 
-        int writeback_num = 0;
+    // issue writeback
+    for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+    {
+        int op_id = Mosaic_Cache_Monitor.get_last_operation(core_idx);
+        if(op_id < 1 || op_id > 3)
+            continue;
 
+        cache_ptr = _mosaic_cache_get_op_ways(core_idx, op_id, origin_way_pos[core_idx][op_id], _mosaic_cache_get_op_boundary(core_idx, op_id, false), &start_pos, &end_pos);
+        _mosaic_cache_get_op_receiver(core_idx, op_id, receiver);
+
+        int migrate_num = 0;
+        int writeback_num = _mosaic_cache_count_writeback(cache_ptr, start_pos, end_pos, receiver, 0, &migrate_num);
         for(int way_idx = start_pos; way_idx < end_pos; way_idx++)
         {
+            cache_ptr->mosaic_cache_issue_writeback(way_idx);
+        }
+        Mosaic_Cache_Monitor.add_writeback(core_idx, (op_id == 1) ? LPM_L1 : LPM_L2, writeback_num);
+        Mosaic_Cache_Monitor.add_migration(core_idx, (op_id == 1) ? LPM_L1 : LPM_L2, migrate_num);
+    }
+
+    if(l3_writeback_core != -1)
+    {
+        _mosaic_cache_get_op_receiver(l3_writeback_core, 4, receiver);
 
-            writeback_num += cache_ptr->mosaic_cache_get_writeback_count(way_idx); 
+        int migrate_num = 0;
+        int writeback_num = _mosaic_cache_count_writeback(&(uncore.LLC), Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3), origin_l3_way_end_pos, receiver, 0, &migrate_num);
+        for(int way_idx = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3); way_idx < origin_l3_way_end_pos; way_idx++)
+        {
+            uncore.LLC.mosaic_cache_issue_writeback(way_idx);
         }
-        if(!cache_ptr->mosaic_cache_can_writeback(writeback_num))
+        Mosaic_Cache_Monitor.add_writeback(l3_writeback_core, LPM_L3, writeback_num);
+        Mosaic_Cache_Monitor.add_migration(l3_writeback_core, LPM_L3, migrate_num);
+    }
+}
+
+// writes back up to drain_rate dirty lines of [start_pos, end_pos), true once they are clean
+// in migrate mode the lines the receivers have room for move at the commit, only the others are drained
+// at a check (settle) the ways also count as clean if the lower level takes the rest at once
+bool _mosaic_cache_drain_ways(CACHE *cache_ptr, int start_pos, int end_pos, int core_idx, int op_id, bool settle)
+{
+    int budget = Mosaic_Cache_Monitor.get_drain_rate();
+    bool clean = true;
+    CACHE* receiver[NUM_CPUS];
+    CACHE** migrate_receiver = NULL;
+
+    if(Mosaic_Cache_Monitor.get_writeback_mode() == 2)
+    {
+        _mosaic_cache_get_op_receiver(core_idx, op_id, receiver);
+        migrate_receiver = receiver;
+    }
+
+    // at a check the dirty lines left are counted per lower WQ
+    cache_ptr->mosaic_writeback_queue.clear();
+    for(int way_idx = start_pos; way_idx < end_pos; way_idx++)
+    {
+        if(!cache_ptr->mosaic_cache_drain_way(way_idx, migrate_receiver, &budget, settle))
+            clean = false;
+    }
+    Mosaic_Cache_Monitor.add_writeback(core_idx, (op_id == 1) ? LPM_L1 : ((op_id == 4) ? LPM_L3 : LPM_L2), Mosaic_Cache_Monitor.get_drain_rate() - budget);
+
+    if(clean || !settle)
+        return clean;
+
+    return cache_ptr->mosaic_cache_can_writeback();
+}
+
+// the drain engine (-mosaic_cache_drain_rate), runs every cycle while a reconfig is pending
+// the ways a pending reconfig gives away stay with their level until they are clean, then it is committed
+// a reconfig still pending at the next check (settle) is cancelled, unless the lower level takes the rest at once
+void _mosaic_cache_drain(bool settle)
+{
+    if(!Mosaic_Cache_Monitor.has_pending())
+        return;
+
+    int start_pos, end_pos;
+    CACHE* cache_ptr = NULL;
+    bool clean[NUM_CPUS];
+    bool all_clean = true;
+    int l3_drain_core = -1;
+
+    // like in _mosaic_cache_solve_op(), the cores share the ways reserved in the receivers
+    _mosaic_cache_clear_reserved();
+    for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+    {
+        clean[core_idx] = true;
+
+        int op_id = Mosaic_Cache_Monitor.get_pending_operation(core_idx);
+        if(op_id == 4 && l3_drain_core == -1)
+            l3_drain_core = core_idx;
+        if(op_id < 1 || op_id > 3)
+            continue;
+
+        cache_ptr = _mosaic_cache_get_op_ways(core_idx, op_id, _mosaic_cache_get_op_boundary(core_idx, op_id, false), _mosaic_cache_get_op_boundary(core_idx, op_id, true), &start_pos, &end_pos);
+        clean[core_idx] = _mosaic_cache_drain_ways(cache_ptr, start_pos, end_pos, core_idx, op_id, settle);
+    }
+
+    // the LLC ways no core keeps are drained once for all cores giving them back
+    if(l3_drain_core != -1)
+    {
+        bool l3_clean = _mosaic_cache_drain_ways(&(uncore.LLC), _mosaic_cache_get_pending_l3_way_end_pos(), Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3), l3_drain_core, 4, settle);
+        for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
         {
-            rollback_flag = true;
-            break;                                    
+            if(Mosaic_Cache_Monitor.get_pending_operation(core_idx) == 4)
+                clean[core_idx] = l3_clean;
         }
     }
-    
-    if(rollback_flag == true) // reconfig fail, need rollback
+
+    for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+    {
+        if(!clean[core_idx])
+            all_clean = false;
+    }
+
+    // the cores that vote together move together
+    if(!all_clean && Mosaic_Cache_Monitor.get_partition_mode() == 0)
     {
-        Mosaic_Cache_Monitor.RollBack();
+        if(settle)
+        {
+            for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+            {
+                Mosaic_Cache_Monitor.CancelPending(core_idx);
+            }
+        }
         return;
     }
 
-    // issue writeback
+    int origin_way_pos[NUM_CPUS][4];
     for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
     {
-        switch(op_id)
+        origin_way_pos[core_idx][0] = 0;
+        for(int op_id = 1; op_id <= 3; op_id++)
         {
-            case 1:
-                cache_ptr = &(ooo_cpu[core_idx].L1D);
-                break;
-            case 2:
-                cache_ptr = &(ooo_cpu[core_idx].L2C);
-                break;
-            case 3:
-                cache_ptr = &(ooo_cpu[core_idx].L2C);
-                break;
-            case 4:
-                cache_ptr = &(uncore.LLC);
-                break;
-            default:
-                assert(0);
+            origin_way_pos[core_idx][op_id] = _mosaic_cache_get_op_boundary(core_idx, op_id, false);
+        }
+    }
+    int origin_l3_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
+
+    bool committed = false;
+    Mosaic_Cache_Monitor.clear_last_operation();
+    for(int core_idx = 0; core_idx < NUM_CPUS; core_idx++)
+    {
+        if(Mosaic_Cache_Monitor.get_pending_operation(core_idx) == 0)
+            continue;
+
+        if(clean[core_idx])
+        {
+            Mosaic_Cache_Monitor.Commit(core_idx);
+            committed = true;
         }
+        else if(settle)
+        {
+            Mosaic_Cache_Monitor.CancelPending(core_idx);
+        }
+    }
 
-        int writeback_num = 0;
+    // the ways are clean, this moves their lines in migrate mode, and writes back the rest at a check
+    if(committed)
+        _mosaic_cache_solve_op(origin_way_pos, origin_l3_way_end_pos, false);
+}
 
-        for(int way_idx = start_pos; way_idx < end_pos; way_idx++)
+// zmz modify (step 6)
+void operate_mosaic_cache()
+{
+    int mosaic_cache_mode = Mosaic_Cache_Monitor.get_work_mode();
+    switch(mosaic_cache_mode)
+    {
+        case 0: /* mosaic cache off */
         {
-            writeback_num += cache_ptr->mosaic_cache_get_writeback_count(way_idx);
-            cache_ptr->mosaic_cache_issue_writeback(way_idx);
+            break;
+        }
+        case 1: /* motivation mode */
+        {
+            if(Mosaic_Cache_Monitor.need_check(current_core_cycle[0]))
+            {
+                cout<<"[MOTIVATION] Current Cycle: "<<current_core_cycle[0]<<endl;
+
+                for(int i=0; i<NUM_CPUS; i++)
+                {
+                    int inst_num = ooo_cpu[i].num_retired;
+                    cout<<" Core "<<i
+                        <<": L1="<<Mosaic_Cache_Monitor.get_lpmr(i, LPM_L1, inst_num, current_core_cycle[i])
+                        <<", L2="<<Mosaic_Cache_Monitor.get_lpmr(i, LPM_L2, inst_num, current_core_cycle[i])
+                        <<", L3="<<Mosaic_Cache_Monitor.get_lpmr(i, LPM_L3, inst_num, current_core_cycle[i])
+                        <<endl;
+                    Mosaic_Cache_Monitor.set_last_inst_num(i, inst_num);
+                }
+                Mosaic_Cache_Monitor.forward_window(current_core_cycle[0]);
+            }
+            break;
+        }
+        case 2: /* l1<-->l2 */
+        case 3: /* l2<-->l3 */
+        case 4: /* l1<-->l2<-->l3 */
+        {
+            bool check = Mosaic_Cache_Monitor.need_check(current_core_cycle[0]);
+            _mosaic_cache_drain(check);
+
+            if(check)
+            {
+                // every core reconfigs on its own lpmr, the boundaries are kept for the writebacks
+                int origin_way_pos[NUM_CPUS][4];
+                for(int i=0; i<NUM_CPUS; i++)
+                {
+                    Mosaic_Cache_Monitor.update_lpmr(i, ooo_cpu[i].num_retired, current_core_cycle[i]);
+
+                    origin_way_pos[i][0] = 0;
+                    for(int op_id = 1; op_id <= 3; op_id++)
+                    {
+                        origin_way_pos[i][op_id] = _mosaic_cache_get_op_boundary(i, op_id, false);
+                    }
+                }
+                int origin_l3_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
+
+                if(Mosaic_Cache_Monitor.reconfig(current_core_cycle[0]))
+                {
+                    _mosaic_cache_solve_op(origin_way_pos, origin_l3_way_end_pos, Mosaic_Cache_Monitor.get_drain_rate() > 0);
+                }
+                Mosaic_Cache_Monitor.forward_window(current_core_cycle[0]);
+            }
+            break;
+        }
+        default:
+        {
+            assert(0);
         }
-        Mosaic_Cache_Monitor.add_writeback(core_idx, writeback_cache_level, writeback_num);
     }
 }
 
@@ -156,6 +503,23 @@ void record_roi_stats(uint32_t cpu, CACHE *cache)
         cache->roi_access[cpu][i] = cache->sim_access[cpu][i];
         cache->roi_hit[cpu][i] = cache->sim_hit[cpu][i];
         cache->roi_miss[cpu][i] = cache->sim_miss[cpu][i];
+        cache->roi_latency[cpu][i] = cache->sim_latency[cpu][i];
+    }
+}
+
+// tail latency per access type, a type without a sample is left out
+void print_latency(string name, LATENCY_HISTOGRAM *latency)
+{
+    const char *type_name[NUM_TYPES] = {"LOAD     ", "RFO      ", "PREFETCH ", "WRITEBACK"};
+
+    for (uint32_t i=0; i<NUM_TYPES; i++) {
+        if (latency[i].count == 0)
+            continue;
+
+        // DRAM is one character longer than the cache names
+        cout << left << setw(4) << name << right << " " << type_name[i] << " LATENCY p50: " << setw(6) << latency[i].percentile(0.5);
+        cout << "  p90: " << setw(6) << latency[i].percentile(0.9) << "  p99: " << setw(6) << latency[i].percentile(0.99);
+        cout << "  p999: " << setw(6) << latency[i].percentile(0.999) << " cycles" << endl;
     }
 }
 
@@ -188,9 +552,17 @@ void print_roi_stats(uint32_t cpu, CACHE *cache)
     cout << " PREFETCH  REQUESTED: " << setw(10) << cache->pf_requested << "  ISSUED: " << setw(10) << cache->pf_issued;
     cout << "  USEFUL: " << setw(10) << cache->pf_useful << "  USELESS: " << setw(10) << cache->pf_useless << endl;
 
+    // only an inclusive cache below takes lines away
+    if (cache->back_invalidated) {
+        cout << cache->NAME;
+        cout << " BACK-INVALIDATED: " << setw(10) << cache->back_invalidated << endl;
+    }
+
     cout << cache->NAME;
     cout << " AVERAGE MISS LATENCY: " << (1.0*(cache->total_miss_latency))/TOTAL_MISS << " cycles" << endl;
     //cout << " AVERAGE MISS LATENCY: " << (cache->total_miss_latency)/TOTAL_MISS << " cycles " << cache->total_miss_latency << "/" << TOTAL_MISS<< endl;
+
+    print_latency(cache->NAME, cache->roi_latency[cpu]);
 }
 
 void print_sim_stats(uint32_t cpu, CACHE *cache)
@@ -261,6 +633,35 @@ void print_dram_stats()
         cout << " AVG_CONGESTED_CYCLE: -" << endl;
 }
 
+void print_noc_stats()
+{
+    const char *class_name[NOC_CLASSES] = {"REQUEST", "RESPONSE"};
+
+    cout << endl;
+    cout << "NOC Statistics" << endl;
+    cout << " TOPOLOGY: " << (uncore.NOC.topology == NOC_RING ? "ring" : "mesh") << "  NODES: " << uncore.NOC.num_nodes;
+    cout << "  HOP_LATENCY: " << uncore.NOC.hop_latency << "  LINK_WIDTH: " << uncore.NOC.link_width << endl;
+    for (uint32_t i=0; i<NOC_CLASSES; i++) {
+        cout << " " << setw(8) << class_name[i] << " PACKETS: " << setw(10) << uncore.NOC.packets[i];
+        cout << "  FLITS: " << setw(10) << uncore.NOC.flits[i];
+        if (uncore.NOC.packets[i]) {
+            cout << "  AVERAGE HOPS: " << (1.0*uncore.NOC.hops[i]) / uncore.NOC.packets[i];
+            cout << "  AVERAGE LATENCY: " << (1.0*uncore.NOC.total_latency[i]) / uncore.NOC.packets[i] << endl;
+        }
+        else
+            cout << "  AVERAGE HOPS: -  AVERAGE LATENCY: -" << endl;
+    }
+
+    // the busiest link and how often a packet waited for room in the next queue or the LLC
+    uint64_t busiest = 0, stall = 0;
+    for (uint32_t i=0; i<uncore.NOC.link.size(); i++) {
+        if (uncore.NOC.link[i].flits > busiest)
+            busiest = uncore.NOC.link[i].flits;
+        stall += uncore.NOC.link[i].stall;
+    }
+    cout << " MAX_LINK_FLITS: " << setw(10) << busiest << "  LINK_STALL: " << setw(10) << stall << endl;
+}
+
 void reset_cache_stats(uint32_t cpu, CACHE *cache)
 {
     for (uint32_t i=0; i<NUM_TYPES; i++) {
@@ -273,9 +674,11 @@ void reset_cache_stats(uint32_t cpu, CACHE *cache)
         cache->sim_access[cpu][i] = 0;
         cache->sim_hit[cpu][i] = 0;
         cache->sim_miss[cpu][i] = 0;
+        cache->sim_latency[cpu][i].clear();
     }
 
     cache->total_miss_latency = 0;
+    cache->back_invalidated = 0;
 
     cache->RQ.ACCESS = 0;
     cache->RQ.MERGED = 0;
@@ -296,6 +699,9 @@ void finish_warmup()
     elapsed_minute -= elapsed_hour*60;
     elapsed_second -= (elapsed_hour*3600 + elapsed_minute*60);
 
+    // the last row of the time series that still counts warmup
+    sample_stats(1);
+
     // reset core latency
     // note: since re-ordering he function calls in the main simulation loop, it's no longer necessary to add
     //       extra latency for scheduling and execution, unless you want these steps to take longer than 1 cycle.
@@ -337,17 +743,39 @@ void finish_warmup()
         uncore.DRAM.WQ[i].ROW_BUFFER_HIT = 0;
         uncore.DRAM.WQ[i].ROW_BUFFER_MISS = 0;
     }
+    for (uint32_t i=0; i<NUM_CPUS; i++) {
+        for (uint32_t j=0; j<NUM_TYPES; j++)
+            uncore.DRAM.sim_latency[i][j].clear();
+    }
+    uncore.NOC.reset_stats();
 
     // set actual cache latency
     for (uint32_t i=0; i<NUM_CPUS; i++) {
-        ooo_cpu[i].ITLB.LATENCY = ITLB_LATENCY;
-        ooo_cpu[i].DTLB.LATENCY = DTLB_LATENCY;
-        ooo_cpu[i].STLB.LATENCY = STLB_LATENCY;
-        ooo_cpu[i].L1I.LATENCY  = L1I_LATENCY;
-        ooo_cpu[i].L1D.LATENCY  = L1D_LATENCY;
-        ooo_cpu[i].L2C.LATENCY  = L2C_LATENCY;
-    }
-    uncore.LLC.LATENCY = LLC_LATENCY;
+        ooo_cpu[i].ITLB.LATENCY = cache_config[IS_ITLB].latency;
+        ooo_cpu[i].DTLB.LATENCY = cache_config[IS_DTLB].latency;
+        ooo_cpu[i].STLB.LATENCY = cache_config[IS_STLB].latency;
+        ooo_cpu[i].L1I.LATENCY  = cache_config[IS_L1I].latency;
+        ooo_cpu[i].L1D.LATENCY  = cache_config[IS_L1D].latency;
+        ooo_cpu[i].L2C.LATENCY  = cache_config[IS_L2C].latency;
+    }
+    uncore.LLC.LATENCY = cache_config[IS_LLC].latency;
+
+    rebase_stats();
+}
+
+// end of the region of interest for one core
+void finish_simulation(uint32_t i)
+{
+    simulation_complete[i] = 1;
+    ooo_cpu[i].finish_sim_instr = ooo_cpu[i].num_retired - ooo_cpu[i].begin_sim_instr;
+    ooo_cpu[i].finish_sim_cycle = current_core_cycle[i] - ooo_cpu[i].begin_sim_cycle;
+
+    record_roi_stats(i, &ooo_cpu[i].L1D);
+    record_roi_stats(i, &ooo_cpu[i].L1I);
+    record_roi_stats(i, &ooo_cpu[i].L2C);
+    record_roi_stats(i, &uncore.LLC);
+    for (uint32_t j=0; j<NUM_TYPES; j++)
+        uncore.DRAM.roi_latency[i][j] = uncore.DRAM.sim_latency[i][j];
 }
 
 void print_deadlock(uint32_t i)
@@ -386,6 +814,148 @@ void print_deadlock(uint32_t i)
     assert(0);
 }
 
+// fast-forward every core clock to one cycle before the earliest cycle at which anything
+// (core pipeline, caches, DRAM, deadlock check or mosaic check) can change state
+void skip_idle_cycles()
+{
+    uint64_t next_cycle = UINT64_MAX;
+
+    for (uint32_t i=0; i<NUM_CPUS; i++) {
+        uint64_t cpu_cycle = ooo_cpu[i].get_next_event_cycle();
+        if (cpu_cycle < next_cycle)
+            next_cycle = cpu_cycle;
+
+        if (ooo_cpu[i].ROB.entry[ooo_cpu[i].ROB.head].ip && ((ooo_cpu[i].ROB.entry[ooo_cpu[i].ROB.head].event_cycle + DEADLOCK_CYCLE) < next_cycle))
+            next_cycle = ooo_cpu[i].ROB.entry[ooo_cpu[i].ROB.head].event_cycle + DEADLOCK_CYCLE;
+    }
+
+    uint64_t uncore_cycle = uncore.LLC.get_next_event_cycle();
+    if (uncore_cycle < next_cycle)
+        next_cycle = uncore_cycle;
+    uncore_cycle = uncore.DRAM.get_next_event_cycle();
+    if (uncore_cycle < next_cycle)
+        next_cycle = uncore_cycle;
+    uncore_cycle = uncore.NOC.get_next_event_cycle();
+    if (uncore_cycle < next_cycle)
+        next_cycle = uncore_cycle;
+
+    if (Mosaic_Cache_Monitor.get_work_mode() != 0) {
+        uint64_t check_cycle = Mosaic_Cache_Monitor.get_next_check_cycle();
+        if (check_cycle < next_cycle)
+            next_cycle = check_cycle;
+    }
+
+    // all cores tick together, so current_core_cycle[0] stands for every core
+    if ((next_cycle == UINT64_MAX) || (next_cycle <= (current_core_cycle[0] + 1)))
+        return;
+
+    skipped_cycles += next_cycle - 1 - current_core_cycle[0];
+    for (uint32_t i=0; i<NUM_CPUS; i++)
+        current_core_cycle[i] = next_cycle - 1;
+}
+
+// parallel simulation (-sim_threads)
+// the uncore runs one quantum ahead: it simulates the LLC and DRAM for the next sync_quantum cycles,
+// then the cores catch up on their threads, each L2C sending to the LLC through its CORE_PORT
+// the LLC cannot serve a request earlier than its latency after it was sent, so with a quantum
+// no longer than that every request still reaches the LLC in time and keeps the cycle it was sent at
+// a longer quantum means fewer syncs, but requests may then be served up to sync_quantum - LLC latency late
+// what is still skewed with the default quantum: a core sees the LLC queue occupancy of the last boundary
+// (plus its own requests), and what the uncore pushes into an L2C outside of a fill (back-invalidations,
+// Mosaic writebacks and migrations) lands up to a quantum early in that core's time
+// the L1/L2C prefetchers and branch predictors run on the core threads, so they keep their tables per core
+// a thread spins briefly on a sync before it sleeps, more threads than host cores would starve otherwise
+#define SYNC_SPIN 4096
+vector <thread> sim_threads;
+atomic <uint64_t> quantum_end_cycle(0);
+atomic <uint32_t> quantum_running(0);
+atomic <uint8_t> sim_threads_exit(0);
+mutex quantum_lock;
+condition_variable quantum_start, quantum_done;
+uint8_t finish_reported[NUM_CPUS];
+
+void run_core_quantum(uint32_t i, uint64_t end_cycle)
+{
+    while (current_core_cycle[i] < end_cycle) {
+        current_core_cycle[i]++;
+        ooo_cpu[i].operate();
+
+        // the ROI still ends at the right cycle, the rest of the bookkeeping waits for the quantum boundary
+        if ((all_warmup_complete > NUM_CPUS) && (simulation_complete[i] == 0) && (ooo_cpu[i].num_retired >= (ooo_cpu[i].begin_sim_instr + ooo_cpu[i].simulation_instructions)))
+            finish_simulation(i);
+    }
+}
+
+void run_cores(uint32_t thread_id, uint64_t end_cycle)
+{
+    for (uint32_t i=thread_id; i<NUM_CPUS; i+=knob_sim_threads)
+        run_core_quantum(i, end_cycle);
+}
+
+void sim_thread(uint32_t thread_id, uint64_t done_cycle)
+{
+
+    while (1) {
+        for (uint32_t spin=0; (quantum_end_cycle == done_cycle) && (sim_threads_exit == 0); spin++) {
+            if (spin < SYNC_SPIN)
+                continue;
+            unique_lock <mutex> lock(quantum_lock);
+            while ((quantum_end_cycle == done_cycle) && (sim_threads_exit == 0))
+                quantum_start.wait(lock);
+        }
+        if (quantum_end_cycle == done_cycle)
+            return;
+
+        done_cycle = quantum_end_cycle;
+        run_cores(thread_id, done_cycle);
+
+        if (--quantum_running == 0) {
+            lock_guard <mutex> lock(quantum_lock);
+            quantum_done.notify_one();
+        }
+    }
+}
+
+void run_parallel_quantum()
+{
+    // all cores sit at the same cycle between quanta
+    uint64_t first_cycle = current_core_cycle[0] + 1,
+             last_cycle = current_core_cycle[0] + sync_quantum;
+
+    for (uint64_t cycle=first_cycle; cycle<=last_cycle; cycle++) {
+        for (uint32_t i=0; i<NUM_CPUS; i++)
+            current_core_cycle[i] = cycle;
+
+        deliver_core_ports(cycle);
+        uncore.NOC.operate();
+        uncore.DRAM.operate();
+        uncore.LLC.operate();
+
+        // zmz modify (step 6)
+        operate_mosaic_cache();
+    }
+
+    for (uint32_t i=0; i<NUM_CPUS; i++)
+        current_core_cycle[i] = first_cycle - 1;
+
+    // this thread runs the first group of cores itself
+    quantum_running = knob_sim_threads - 1;
+    {
+        lock_guard <mutex> lock(quantum_lock);
+        quantum_end_cycle = last_cycle;
+    }
+    quantum_start.notify_all();
+    run_cores(0, last_cycle);
+
+    for (uint32_t spin=0; quantum_running; spin++) {
+        if (spin < SYNC_SPIN)
+            continue;
+        unique_lock <mutex> lock(quantum_lock);
+        while (quantum_running)
+            quantum_done.wait(lock);
+    }
+}
+
 void signal_handler(int signal) 
 {
 	cout << "Caught signal: " << signal << endl;
@@ -429,6 +999,8 @@ uint64_t va_to_pa(uint32_t cpu, uint64_t instr_id, uint64_t va, uint64_t unique_
         assert(0);
 #endif
 
+    lock_guard <mutex> page_table_guard(page_table_lock);
+
     uint8_t  swap = 0;
     uint64_t high_bit_mask = rotr64(cpu, lg2(NUM_CPUS)),
              unique_va = va | high_bit_mask;
@@ -439,63 +1011,46 @@ uint64_t va_to_pa(uint32_t cpu, uint64_t instr_id, uint64_t va, uint64_t unique_
     // smart random number generator
     uint64_t random_ppage;
 
-    map <uint64_t, uint64_t>::iterator pr = page_table.begin();
-    map <uint64_t, uint64_t>::iterator ppage_check = inverse_table.begin();
+    uint64_t *ppage_check;
 
     // check unique cache line footprint
-    map <uint64_t, uint64_t>::iterator cl_check = unique_cl[cpu].find(unique_va >> LOG2_BLOCK_SIZE);
-    if (cl_check == unique_cl[cpu].end()) { // we've never seen this cache line before
-        unique_cl[cpu].insert(make_pair(unique_va >> LOG2_BLOCK_SIZE, 0));
+    uint64_t *cl_check = unique_cl[cpu].find(unique_va >> LOG2_BLOCK_SIZE);
+    if (cl_check == NULL) { // we've never seen this cache line before
+        unique_cl[cpu].insert(unique_va >> LOG2_BLOCK_SIZE, 0);
         num_cl[cpu]++;
     }
     else
-        cl_check->second++;
+        (*cl_check)++;
 
-    pr = page_table.find(vpage);
-    if (pr == page_table.end()) { // no VA => PA translation found 
+    uint64_t *pr = page_table.find(vpage);
+    if (pr == NULL) { // no VA => PA translation found 
 
         if (allocated_pages >= DRAM_PAGES) { // not enough memory
 
-            // TODO: elaborate page replacement algorithm
-            // here, ChampSim randomly selects a page that is not recently used and we only track 32K recently accessed pages
-            uint8_t  found_NRU = 0;
-            uint64_t NRU_vpage = 0; // implement it
-            map <uint64_t, uint64_t>::iterator pr2 = recent_page.begin();
-            for (pr = page_table.begin(); pr != page_table.end(); pr++) {
-
-                NRU_vpage = pr->first;
-                if (recent_page.find(NRU_vpage) == recent_page.end()) {
-                    found_NRU = 1;
-                    break;
-                }
-            }
-#ifdef SANITY_CHECK
-            if (found_NRU == 0)
-                assert(0);
+            // the clock hand picks a page that was not used since it last came by
+            uint64_t victim = find_victim_frame();
+            uint64_t NRU_vpage = page_frames[victim].vpage,
+                     mapped_ppage = page_frames[victim].ppage;
 
-            if (pr == page_table.end())
-                assert(0);
-#endif
             DP ( if (warmup_complete[cpu]) {
-            cout << "[SWAP] update page table NRU_vpage: " << hex << pr->first << " new_vpage: " << vpage << " ppage: " << pr->second << dec << endl; });
+            cout << "[SWAP] update page table NRU_vpage: " << hex << NRU_vpage << " new_vpage: " << vpage << " ppage: " << mapped_ppage << dec << endl; });
 
-            // update page table with new VA => PA mapping
-            // since we cannot change the key value already inserted in a map structure, we need to erase the old node and add a new node
-            uint64_t mapped_ppage = pr->second;
-            page_table.erase(pr);
-            page_table.insert(make_pair(vpage, mapped_ppage));
+            // update page table with new VA => PA mapping, the frame keeps its ppage
+            page_table.erase(NRU_vpage);
+            page_table.insert(vpage, victim);
+            page_frames[victim].vpage = vpage;
 
             // update inverse table with new PA => VA mapping
             ppage_check = inverse_table.find(mapped_ppage);
 #ifdef SANITY_CHECK
-            if (ppage_check == inverse_table.end())
+            if (ppage_check == NULL)
                 assert(0);
 #endif
-            ppage_check->second = vpage;
+            *ppage_check = vpage;
 
             DP ( if (warmup_complete[cpu]) {
             cout << "[SWAP] update inverse table NRU_vpage: " << hex << NRU_vpage << " new_vpage: ";
-            cout << ppage_check->second << " ppage: " << ppage_check->first << dec << endl; });
+            cout << *ppage_check << " ppage: " << mapped_ppage << dec << endl; });
 
             // update page_queue
             page_queue.pop();
@@ -532,9 +1087,9 @@ uint64_t va_to_pa(uint32_t cpu, uint64_t instr_id, uint64_t va, uint64_t unique_
 
             while (1) { // try to find an empty physical page number
                 ppage_check = inverse_table.find(random_ppage); // check if this page can be allocated 
-                if (ppage_check != inverse_table.end()) { // random_ppage is not available
+                if (ppage_check != NULL) { // random_ppage is not available
                     DP ( if (warmup_complete[cpu]) {
-                    cout << "vpage: " << hex << ppage_check->first << " is already mapped to ppage: " << random_ppage << dec << endl; }); 
+                    cout << "vpage: " << hex << *ppage_check << " is already mapped to ppage: " << random_ppage << dec << endl; }); 
                     
                     if (num_adjacent_page > 0)
                         fragmented = 1;
@@ -552,8 +1107,9 @@ uint64_t va_to_pa(uint32_t cpu, uint64_t instr_id, uint64_t va, uint64_t unique_
 
             // insert translation to page tables
             //printf("Insert  num_adjacent_page: %u  vpage: %lx  ppage: %lx\n", num_adjacent_page, vpage, random_ppage);
-            page_table.insert(make_pair(vpage, random_ppage));
-            inverse_table.insert(make_pair(random_ppage, vpage));
+            page_table.insert(vpage, page_frames.size());
+            page_frames.push_back(PAGE_FRAME(vpage, random_ppage));
+            inverse_table.insert(random_ppage, vpage);
             page_queue.push(vpage);
             previous_ppage = random_ppage;
             num_adjacent_page--;
@@ -579,10 +1135,12 @@ uint64_t va_to_pa(uint32_t cpu, uint64_t instr_id, uint64_t va, uint64_t unique_
 
     pr = page_table.find(vpage);
 #ifdef SANITY_CHECK
-    if (pr == page_table.end())
+    if (pr == NULL)
         assert(0);
 #endif
-    uint64_t ppage = pr->second;
+    PAGE_FRAME *frame = &page_frames[*pr];
+    frame->referenced = 1;
+    uint64_t ppage = frame->ppage;
 
     uint64_t pa = ppage << LOG2_PAGE_SIZE;
     pa |= voffset;
@@ -642,14 +1200,29 @@ int main(int argc, char** argv)
         {
             {"warmup_instructions", required_argument, 0, 'w'},
             {"simulation_instructions", required_argument, 0, 'i'},
+            {"skip_instructions", required_argument, 0, 'n'},
             {"hide_heartbeat", no_argument, 0, 'h'},
             {"cloudsuite", no_argument, 0, 'c'},
             {"low_bandwidth",  no_argument, 0, 'b'},
             {"traces",  no_argument, 0, 't'},
+            {"cycle_skipping", no_argument, 0, 's'},
+            {"trace_prefetch", no_argument, 0, 'a'},
+            {"functional_warmup", no_argument, 0, 'q'},
+            {"save_checkpoint", required_argument, 0, 'o'},
+            {"load_checkpoint", required_argument, 0, 'r'},
+            {"sim_threads", required_argument, 0, 'u'},
+            {"sync_quantum", required_argument, 0, 'Q'},
+            {"config", required_argument, 0, 'C'},
+            {"stats_file", required_argument, 0, 'S'},
+            {"stats_interval", required_argument, 0, 'I'},
+            {"stats_instructions", no_argument, 0, 'N'},
+            {"json_stats", required_argument, 0, 'J'},
             {"mosaic_cache_target_delta", required_argument, 0, 'd'}, /*zmz modify*/
             {"mosaic_cache_check_period", required_argument, 0, 'p'}, /*zmz modify*/
             {"mosaic_cache_work_mode", required_argument, 0, 'm'}, /*zmz modify*/
             {"mosaic_cache_writeback_mode", required_argument, 0, 'v'}, /*zmz modify*/
+            {"mosaic_cache_partition_mode", required_argument, 0, 'P'}, /*zmz modify*/
+            {"mosaic_cache_drain_rate", required_argument, 0, 'D'}, /*zmz modify*/
             {"mosaic_cache_l1_adaptive_way_num", required_argument, 0, 'x'}, /*zmz modify*/
             {"mosaic_cache_l1_reconfig_threshold", required_argument, 0, 'e'}, /*zmz modify*/
             {"mosaic_cache_l2_adaptive_way_num", required_argument, 0, 'y'}, /*zmz modify*/
@@ -681,6 +1254,9 @@ int main(int argc, char** argv)
             case 'i':
                 simulation_instructions = atol(optarg);
                 break;
+            case 'n':
+                skip_instructions = atol(optarg);
+                break;
             case 'h':
                 show_heartbeat = 0;
                 break;
@@ -694,6 +1270,42 @@ int main(int argc, char** argv)
             case 't':
                 traces_encountered = 1;
                 break;
+            case 's':
+                knob_cycle_skipping = 1;
+                break;
+            case 'a':
+                knob_trace_prefetch = 1;
+                break;
+            case 'q':
+                knob_functional_warmup = 1;
+                break;
+            case 'o':
+                snprintf(save_checkpoint_name, sizeof(save_checkpoint_name), "%s", optarg);
+                break;
+            case 'r':
+                snprintf(load_checkpoint_name, sizeof(load_checkpoint_name), "%s", optarg);
+                break;
+            case 'u':
+                knob_sim_threads = atol(optarg);
+                break;
+            case 'Q':
+                sync_quantum = atol(optarg);
+                break;
+            case 'C':
+                snprintf(config_name, sizeof(config_name), "%s", optarg);
+                break;
+            case 'S':
+                snprintf(stats_name, sizeof(stats_name), "%s", optarg);
+                break;
+            case 'I':
+                stats_interval = atol(optarg);
+                break;
+            case 'N':
+                stats_instructions = 1;
+                break;
+            case 'J':
+                snprintf(json_stats_name, sizeof(json_stats_name), "%s", optarg);
+                break;
             case 'd': /*zmz modify*/
                 Mosaic_Cache_Monitor.set_delta(atof(optarg));
                 break;
@@ -706,6 +1318,12 @@ int main(int argc, char** argv)
             case 'v': /*zmz modify*/
                 Mosaic_Cache_Monitor.set_writeback_mode(atoi(optarg));
                 break;
+            case 'P': /*zmz modify*/
+                Mosaic_Cache_Monitor.set_partition_mode(atoi(optarg));
+                break;
+            case 'D': /*zmz modify*/
+                Mosaic_Cache_Monitor.set_drain_rate(atoi(optarg));
+                break;
             case 'x': /*zmz modify*/
                 mosaic_cache_adaptive_way_num[LPM_L1] = atoi(optarg);
                 break;
@@ -744,6 +1362,11 @@ int main(int argc, char** argv)
         //     break;
     }
 
+    // cache geometry, core widths and DRAM from the config file, before anything is initialized
+    if (config_name[0])
+        load_config(config_name);
+    apply_config();
+
     // zmz modify
     if(Mosaic_Cache_Monitor.get_work_mode() != 0)
     {
@@ -756,16 +1379,16 @@ int main(int argc, char** argv)
             switch(cache_level_idx)
             {
                 case LPM_L1:
-                    way_num = L1D_WAY;
-                    latency = L1D_LATENCY;
+                    way_num = cache_config[IS_L1D].ways;
+                    latency = cache_config[IS_L1D].latency;
                     break;
                 case LPM_L2:
-                    way_num = L2C_WAY;
-                    latency = L2C_LATENCY;
+                    way_num = cache_config[IS_L2C].ways;
+                    latency = cache_config[IS_L2C].latency;
                     break;
                 case LPM_L3:
-                    way_num = LLC_WAY;
-                    latency = LLC_LATENCY;
+                    way_num = cache_config[IS_LLC].ways;
+                    latency = cache_config[IS_LLC].latency;
                     break;
                 default:
                     break;
@@ -806,15 +1429,43 @@ int main(int argc, char** argv)
     // consequences of knobs
     cout << "Warmup Instructions: " << warmup_instructions << endl;
     cout << "Simulation Instructions: " << simulation_instructions << endl;
+    if (skip_instructions)
+        cout << "Skip Instructions: " << skip_instructions << endl;
     //cout << "Scramble Loads: " << (knob_scramble_loads ? "ture" : "false") << endl;
     cout << "Number of CPUs: " << NUM_CPUS << endl;
-    cout << "LLC sets: " << LLC_SET << endl;
-    cout << "LLC ways: " << LLC_WAY << endl;
+    if (config_name[0])
+        cout << "Config: " << config_name << endl;
+    cout << "LLC sets: " << uncore.LLC.NUM_SET << endl;
+    cout << "LLC ways: " << uncore.LLC.NUM_WAY << endl;
+    if (knob_cycle_skipping)
+        cout << "Cycle skipping: on" << endl;
+    if (knob_trace_prefetch)
+        cout << "Trace prefetch: on" << endl;
+    if (knob_functional_warmup)
+        cout << "Functional warmup: on" << endl;
+    if (save_checkpoint_name[0])
+        cout << "Save checkpoint: " << save_checkpoint_name << endl;
+    if (load_checkpoint_name[0])
+        cout << "Load checkpoint: " << load_checkpoint_name << endl;
+    if (knob_sim_threads) {
+        if (knob_sim_threads > NUM_CPUS)
+            knob_sim_threads = NUM_CPUS;
+        if (sync_quantum == 0)
+            sync_quantum = cache_config[IS_LLC].latency;
+        cout << "Simulation threads: " << knob_sim_threads << " sync quantum: " << sync_quantum;
+        cout << (sync_quantum > cache_config[IS_LLC].latency ? " cycles (relaxed)" : " cycles") << endl;
+
+        // the uncore cannot skip ahead of cores that run on their own
+        if (knob_cycle_skipping) {
+            cout << "Cycle skipping is not supported with -sim_threads, turning it off" << endl;
+            knob_cycle_skipping = 0;
+        }
+    }
 
     if (knob_low_bandwidth)
-        DRAM_MTPS = DRAM_IO_FREQ/4;
+        DRAM_MTPS = DRAM_DATA_RATE/4;
     else
-        DRAM_MTPS = DRAM_IO_FREQ;
+        DRAM_MTPS = DRAM_DATA_RATE;
 
     // DRAM access latency
     tRP  = (uint32_t)((1.0 * tRP_DRAM_NANOSECONDS  * CPU_FREQ) / 1000); 
@@ -841,8 +1492,7 @@ int main(int argc, char** argv)
 
             sprintf(ooo_cpu[count_traces].trace_string, "%s", argv[i]);
 
-            char *full_name = ooo_cpu[count_traces].trace_string,
-                 *last_dot = strrchr(ooo_cpu[count_traces].trace_string, '.');
+            char *full_name = ooo_cpu[count_traces].trace_string;
 
 			ifstream test_file(full_name);
 			if(!test_file.good()){
@@ -851,14 +1501,36 @@ int main(int argc, char** argv)
 			}
 				
 
-            if (full_name[last_dot - full_name + 1] == 'g') // gzip format
-                sprintf(ooo_cpu[count_traces].gunzip_command, "gunzip -c %s", argv[i]);
-            else if (full_name[last_dot - full_name + 1] == 'x') // xz
-                sprintf(ooo_cpu[count_traces].gunzip_command, "xz -dc %s", argv[i]);
-            else {
-                cout << "ChampSim does not support traces other than gz or xz compression!" << endl; 
+            // gz and xz (and zstd when built with ZSTD_TRACE) are decoded in-process, .champsim.bin is mapped
+            TRACE_READER *reader = &ooo_cpu[count_traces].trace_reader;
+            int open_ret = reader->open(full_name);
+            if (open_ret == -2) {
+                cout << "ChampSim does not support traces other than gz, xz or champsim.bin!" << endl; 
                 assert(0);
             }
+            else if (open_ret) {
+                cout << "Cannot open or read trace " << full_name << endl;
+                assert(0);
+            }
+
+            if (reader->format == TRACE_FORMAT_BIN) {
+                size_t instr_size = knob_cloudsuite ? sizeof(cloudsuite_instr) : sizeof(input_instr);
+                if ((reader->bin_header.cloudsuite != knob_cloudsuite) || (reader->bin_header.record_size != instr_size)) {
+                    cout << "Trace " << full_name << " was converted with" << (reader->bin_header.cloudsuite ? "" : "out") << " -cloudsuite";
+                    cout << " (record size " << reader->bin_header.record_size << ")" << endl;
+                    assert(0);
+                }
+            }
+
+            // start mid-trace, e.g. at a simpoint
+            // a checkpoint knows its own trace position
+            if (skip_instructions && (load_checkpoint_name[0] == '\0')) {
+                size_t instr_size = knob_cloudsuite ? sizeof(cloudsuite_instr) : sizeof(input_instr);
+                if (reader->seek(skip_instructions, instr_size)) {
+                    cout << "Trace " << full_name << " has fewer than " << skip_instructions << " instructions to skip" << endl;
+                    assert(0);
+                }
+            }
 
             char *pch[100];
             int count_str = 0;
@@ -879,12 +1551,6 @@ int main(int argc, char** argv)
                 j++;
             }
 
-            ooo_cpu[count_traces].trace_file = popen(ooo_cpu[count_traces].gunzip_command, "r");
-            if (ooo_cpu[count_traces].trace_file == NULL) {
-                printf("\n*** Trace file not found: %s ***\n\n", argv[i]);
-                assert(0);
-            }
-
             count_traces++;
             if (count_traces > NUM_CPUS) {
                 printf("\n*** Too many traces for the configured number of cores ***\n\n");
@@ -1002,9 +1668,83 @@ int main(int argc, char** argv)
 
     uncore.LLC.llc_initialize_replacement();
     uncore.LLC.llc_prefetcher_initialize();
+    if (cache_config[IS_LLC].slices > 1)
+        uncore.LLC.configure_slices(cache_config[IS_LLC].slices, cache_config[IS_LLC].slice_hash);
+
+    // with a [NOC] topology the L2C and the LLC talk through the network in both directions
+    if (NOC_TOPOLOGY != NOC_NONE) {
+        uncore.NOC.configure(NOC_TOPOLOGY, NOC_HOP_LATENCY, NOC_LINK_WIDTH, NOC_LINK_QUEUE, &uncore.LLC);
+        for (uint32_t i=0; i<NUM_CPUS; i++) {
+            NOC_PORT *port = &uncore.NOC.port[i];
+            port->cpu = i;
+            port->noc = &uncore.NOC;
+            port->upper_level_icache[i] = &ooo_cpu[i].L2C;
+            port->upper_level_dcache[i] = &ooo_cpu[i].L2C;
+            port->lower_level = &uncore.LLC;
+            ooo_cpu[i].L2C.lower_level = port;
+            uncore.LLC.upper_level_icache[i] = port;
+            uncore.LLC.upper_level_dcache[i] = port;
+        }
+    }
+
+    // with -sim_threads every L2C reaches the LLC (or its network port) through its core port
+    if (knob_sim_threads) {
+        for (uint32_t i=0; i<NUM_CPUS; i++) {
+            core_port[i].cpu = i;
+            core_port[i].upper_level_icache[i] = &ooo_cpu[i].L2C;
+            core_port[i].upper_level_dcache[i] = &ooo_cpu[i].L2C;
+            core_port[i].lower_level = ooo_cpu[i].L2C.lower_level;
+            ooo_cpu[i].L2C.lower_level = &core_port[i];
+        }
+    }
 
     // simulation entry point
     start_time = time(NULL);
+
+    if (stats_name[0])
+        open_stats(stats_name);
+
+    // a checkpoint replaces the warmup, it also moves the traces to where the warmup left them
+    if (load_checkpoint_name[0])
+        load_checkpoint(load_checkpoint_name);
+
+    // decompress on a separate thread, ahead of the fetch stage
+    if (knob_trace_prefetch) {
+        for (uint32_t i=0; i<NUM_CPUS; i++)
+            ooo_cpu[i].trace_reader.start_prefetch();
+    }
+
+    // functional warmup: run the warmup instructions through the caches and predictors only
+    // either way the timed simulation starts right away with warmup already done
+    if (load_checkpoint_name[0] || knob_functional_warmup) {
+        if (load_checkpoint_name[0] == '\0') {
+            functional_warmup = 1;
+            for (uint64_t n=0; n<warmup_instructions; n++) {
+                for (uint32_t i=0; i<NUM_CPUS; i++)
+                    ooo_cpu[i].functional_step();
+            }
+            functional_warmup = 0;
+        }
+
+        for (uint32_t i=0; i<NUM_CPUS; i++) {
+            warmup_complete[i] = 1;
+            ooo_cpu[i].last_sim_instr = ooo_cpu[i].num_retired;
+            while (ooo_cpu[i].next_print_instruction <= ooo_cpu[i].num_retired)
+                ooo_cpu[i].next_print_instruction += STAT_PRINTING_PERIOD;
+        }
+        all_warmup_complete = NUM_CPUS + 1;
+        finish_warmup();
+
+        if (save_checkpoint_name[0] && (load_checkpoint_name[0] == '\0'))
+            save_checkpoint(save_checkpoint_name);
+    }
+
+    if (knob_sim_threads) {
+        quantum_end_cycle = current_core_cycle[0];
+        for (uint32_t i=1; i<knob_sim_threads; i++)
+            sim_threads.push_back(thread(sim_thread, i, current_core_cycle[0]));
+    }
+
     uint8_t run_simulation = 1;
     while (run_simulation) {
 
@@ -1014,53 +1754,20 @@ int main(int argc, char** argv)
         elapsed_minute -= elapsed_hour*60;
         elapsed_second -= (elapsed_hour*3600 + elapsed_minute*60);
 
+        // one whole quantum with -sim_threads, the loop below then only does the bookkeeping
+        if (knob_sim_threads)
+            run_parallel_quantum();
+
         for (int i=0; i<NUM_CPUS; i++) 
         {
-            // proceed one cycle
-            current_core_cycle[i]++;
+            if (knob_sim_threads == 0) {
+                // proceed one cycle
+                current_core_cycle[i]++;
 
-            //cout << "Trying to process instr_id: " << ooo_cpu[i].instr_unique_id << " fetch_stall: " << +ooo_cpu[i].fetch_stall;
-            //cout << " stall_cycle: " << stall_cycle[i] << " current: " << current_core_cycle[i] << endl;
+                //cout << "Trying to process instr_id: " << ooo_cpu[i].instr_unique_id << " fetch_stall: " << +ooo_cpu[i].fetch_stall;
+                //cout << " stall_cycle: " << stall_cycle[i] << " current: " << current_core_cycle[i] << endl;
 
-            // core might be stalled due to page fault or branch misprediction
-            if (stall_cycle[i] <= current_core_cycle[i]) 
-            {
-                // retire
-                if ((ooo_cpu[i].ROB.entry[ooo_cpu[i].ROB.head].executed == COMPLETED) && (ooo_cpu[i].ROB.entry[ooo_cpu[i].ROB.head].event_cycle <= current_core_cycle[i]))
-		          ooo_cpu[i].retire_rob();
-
-                // complete 
-                ooo_cpu[i].update_rob();
-
-                // schedule
-                uint32_t schedule_index = ooo_cpu[i].ROB.next_schedule;
-                if ((ooo_cpu[i].ROB.entry[schedule_index].scheduled == 0) && (ooo_cpu[i].ROB.entry[schedule_index].event_cycle <= current_core_cycle[i]))
-                    ooo_cpu[i].schedule_instruction();
-                // execute
-                ooo_cpu[i].execute_instruction();
-
-                ooo_cpu[i].update_rob();
-
-                // memory operation
-                ooo_cpu[i].schedule_memory_instruction();
-                ooo_cpu[i].execute_memory_instruction();
-
-                ooo_cpu[i].update_rob();
-
-                // decode
-                if(ooo_cpu[i].DECODE_BUFFER.occupancy > 0)
-                {
-                    ooo_cpu[i].decode_and_dispatch();
-                }
-	      
-                // fetch
-                ooo_cpu[i].fetch_instruction();
-	      
-                // read from trace
-                if ((ooo_cpu[i].IFETCH_BUFFER.occupancy < ooo_cpu[i].IFETCH_BUFFER.SIZE) && (ooo_cpu[i].fetch_stall == 0))
-                {
-                    ooo_cpu[i].read_from_trace();
-                }
+                ooo_cpu[i].operate();
             }
 
             // heartbeat information
@@ -1097,6 +1804,9 @@ int main(int argc, char** argv)
             { // this part is called only once when all cores are warmed up
                 all_warmup_complete++;
                 finish_warmup();
+
+                if (save_checkpoint_name[0])
+                    save_checkpoint(save_checkpoint_name);
             }
 
             /*
@@ -1109,20 +1819,17 @@ int main(int argc, char** argv)
             */
             
             // simulation complete
-            if ((all_warmup_complete > NUM_CPUS) && (simulation_complete[i] == 0) && (ooo_cpu[i].num_retired >= (ooo_cpu[i].begin_sim_instr + ooo_cpu[i].simulation_instructions))) {
-                simulation_complete[i] = 1;
-                ooo_cpu[i].finish_sim_instr = ooo_cpu[i].num_retired - ooo_cpu[i].begin_sim_instr;
-                ooo_cpu[i].finish_sim_cycle = current_core_cycle[i] - ooo_cpu[i].begin_sim_cycle;
+            if ((all_warmup_complete > NUM_CPUS) && (simulation_complete[i] == 0) && (ooo_cpu[i].num_retired >= (ooo_cpu[i].begin_sim_instr + ooo_cpu[i].simulation_instructions)))
+                finish_simulation(i);
+
+            // a core thread finishes during its quantum, it is reported here
+            if (simulation_complete[i] && (finish_reported[i] == 0)) {
+                finish_reported[i] = 1;
 
                 cout << "Finished CPU " << i << " instructions: " << ooo_cpu[i].finish_sim_instr << " cycles: " << ooo_cpu[i].finish_sim_cycle;
                 cout << " cumulative IPC: " << ((float) ooo_cpu[i].finish_sim_instr / ooo_cpu[i].finish_sim_cycle);
                 cout << " (Simulation time: " << elapsed_hour << " hr " << elapsed_minute << " min " << elapsed_second << " sec) " << endl;
 
-                record_roi_stats(i, &ooo_cpu[i].L1D);
-                record_roi_stats(i, &ooo_cpu[i].L1I);
-                record_roi_stats(i, &ooo_cpu[i].L2C);
-                record_roi_stats(i, &uncore.LLC);
-
                 all_simulation_complete++;
             }
 
@@ -1131,132 +1838,32 @@ int main(int argc, char** argv)
         }
 
         // TODO: should it be backward?
-        uncore.DRAM.operate();
-        uncore.LLC.operate();
-
-        // zmz modify (step 6)
-        int mosaic_cache_mode = Mosaic_Cache_Monitor.get_work_mode();
-        switch(mosaic_cache_mode)
-        {
-            case 0: /* mosaic cache off */
-            {
-                break;
-            }
-            case 1: /* motivation mode */
-            {
-                if(Mosaic_Cache_Monitor.need_check(current_core_cycle[0]))
-                {
-                    cout<<"[MOTIVATION] Current Cycle: "<<current_core_cycle[0]<<endl;
+        if (knob_sim_threads == 0) {
+            uncore.NOC.operate();
+            uncore.DRAM.operate();
+            uncore.LLC.operate();
 
-                    for(int i=0; i<NUM_CPUS; i++)
-                    {
-                        int inst_num = ooo_cpu[i].num_retired;
-                        cout<<" Core "<<i
-                            <<": L1="<<Mosaic_Cache_Monitor.get_lpmr(i, LPM_L1, inst_num, current_core_cycle[i])
-                            <<", L2="<<Mosaic_Cache_Monitor.get_lpmr(i, LPM_L2, inst_num, current_core_cycle[i])
-                            <<", L3="<<Mosaic_Cache_Monitor.get_lpmr(i, LPM_L3, inst_num, current_core_cycle[i])
-                            <<endl;
-                        Mosaic_Cache_Monitor.set_last_inst_num(i, inst_num);
-                    }
-                    Mosaic_Cache_Monitor.forward_window(current_core_cycle[0]);
-                }
-                break;
-            }
-            case 2: /* l1<-->l2 */
-            {
-                if(Mosaic_Cache_Monitor.need_check(current_core_cycle[0]))
-                {
-                    int origin_l1_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L1);
-                    int origin_l2_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L2);
+            // zmz modify (step 6)
+            operate_mosaic_cache();
+        }
 
-                    if(Mosaic_Cache_Monitor.reconfig(current_core_cycle[0]))
-                    {
-                        int op_type = Mosaic_Cache_Monitor.get_last_operation();
-
-                        switch(op_type)
-                        {
-                            case 1:
-                                _mosaic_cache_solve_op(op_type, origin_l1_way_end_pos);
-                                break;
-                            case 2:
-                                _mosaic_cache_solve_op(op_type, origin_l2_way_start_pos);
-                                break;
-                            default:
-                                assert(0);
-                        }
-                    }
-                    Mosaic_Cache_Monitor.forward_window(current_core_cycle[0]);
-                }
-                break;
-            }
-            case 3: /* l2<-->l3 */
-            {
-                if(Mosaic_Cache_Monitor.need_check(current_core_cycle[0]))
-                {
-                    int origin_l2_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L2);
-                    int origin_l3_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
+        // jump over cycles in which nothing can happen
+        if (knob_cycle_skipping && run_simulation)
+            skip_idle_cycles();
 
-                    if(Mosaic_Cache_Monitor.reconfig(current_core_cycle[0]))
-                    {
-                        int op_type = Mosaic_Cache_Monitor.get_last_operation();
-
-                        switch(op_type)
-                        {
-                            case 3:
-                                _mosaic_cache_solve_op(op_type, origin_l2_way_end_pos);
-                                break;
-                            case 4:
-                                _mosaic_cache_solve_op(op_type, origin_l3_way_end_pos);
-                                break;
-                            default:
-                                assert(0);
-                        }
-                    }
-                    Mosaic_Cache_Monitor.forward_window(current_core_cycle[0]);
-                }
-                break;
-            }
-            case 4: /* l1<-->l2<-->l3 */
-            {
-                if(Mosaic_Cache_Monitor.need_check(current_core_cycle[0]))
-                {
-                    int origin_l1_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L1);
-                    int origin_l2_way_start_pos = Mosaic_Cache_Monitor.get_current_way_start_pos(LPM_L2);
-                    int origin_l2_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L2);
-                    int origin_l3_way_end_pos = Mosaic_Cache_Monitor.get_current_way_end_pos(LPM_L3);
+        if (stats_name[0])
+            sample_stats(0);
+    }
 
-                    if(Mosaic_Cache_Monitor.reconfig(current_core_cycle[0]))
-                    {
-                        int op_type = Mosaic_Cache_Monitor.get_last_operation();
-
-                        switch(op_type)
-                        {
-                            case 1:
-                                _mosaic_cache_solve_op(op_type, origin_l1_way_end_pos);
-                                break;
-                            case 2:
-                                _mosaic_cache_solve_op(op_type, origin_l2_way_start_pos);
-                                break;
-                            case 3:
-                                _mosaic_cache_solve_op(op_type, origin_l2_way_end_pos);
-                                break;
-                            case 4:
-                                _mosaic_cache_solve_op(op_type, origin_l3_way_end_pos);
-                                break;
-                            default:
-                                assert(0);
-                        }
-                    }
-                    Mosaic_Cache_Monitor.forward_window(current_core_cycle[0]);
-                }
-                break;
-            }
-            default:
-            {
-                assert(0);
-            }
-        }
+    {
+        lock_guard <mutex> lock(quantum_lock);
+        sim_threads_exit = 1;
     }
+    quantum_start.notify_all();
+    for (uint32_t i=0; i<sim_threads.size(); i++)
+        sim_threads[i].join();
+
+    close_stats();
 
     uint64_t elapsed_second = (uint64_t)(time(NULL) - start_time),
              elapsed_minute = elapsed_second / 60,
@@ -1265,6 +1872,8 @@ int main(int argc, char** argv)
     elapsed_second -= (elapsed_hour*3600 + elapsed_minute*60);
     
     cout << endl << "ChampSim completed all CPUs" << endl;
+    if (knob_cycle_skipping)
+        cout << "Skipped cycles: " << skipped_cycles << endl;
     if (NUM_CPUS > 1) {
         cout << endl << "Total Simulation Statistics (not including warmup)" << endl;
         for (uint32_t i=0; i<NUM_CPUS; i++) {
@@ -1293,6 +1902,7 @@ int main(int argc, char** argv)
         print_roi_stats(i, &ooo_cpu[i].L2C);
 #endif
         print_roi_stats(i, &uncore.LLC);
+        print_latency(uncore.DRAM.NAME, uncore.DRAM.roi_latency[i]);
         cout << "Major fault: " << major_fault[i] << " Minor fault: " << minor_fault[i] << endl;
     }
 
@@ -1307,8 +1917,13 @@ int main(int argc, char** argv)
 #ifndef CRC2_COMPILE
     uncore.LLC.llc_replacement_final_stats();
     print_dram_stats();
+    if (NOC_TOPOLOGY != NOC_NONE)
+        print_noc_stats();
     print_branch_stats();
 #endif
 
+    if (json_stats_name[0])
+        write_json_stats(json_stats_name);
+
     return 0;
 }
@@ -1,5 +1,7 @@
 #include "mosaic_cache.h"
 
+#include <sstream>
+
 extern Mosaic_Cache Mosaic_Cache_Monitor;
 
 Mosaic_Cache::Mosaic_Cache(int new_core_num, int new_cache_level_count)
@@ -12,22 +14,36 @@ void Mosaic_Cache::Mosaic_Cache_Global_Init(int new_core_num, int new_cache_leve
 	// init system and cache configuration
 	core_num = new_core_num;
 	cache_level_count = new_cache_level_count;
-	mosaic_cache_info = new struct mosaic_cache_info_t[cache_level_count];
-	for(int idx = 0; idx < cache_level_count; idx++)
+	mosaic_cache_info = new struct mosaic_cache_info_t*[core_num];
+	cache_info_snapshot = new struct mosaic_cache_info_t*[core_num];
+	pending_cache_info = new struct mosaic_cache_info_t*[core_num];
+	last_operation = new int[core_num];
+	pending_operation = new int[core_num];
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
 	{
-		mosaic_cache_info[idx].need_set = true;
-		mosaic_cache_info[idx].need_init = true;
-	}
+		mosaic_cache_info[core_idx] = new struct mosaic_cache_info_t[cache_level_count];
+		for(int idx = 0; idx < cache_level_count; idx++)
+		{
+			mosaic_cache_info[core_idx][idx].need_set = true;
+			mosaic_cache_info[core_idx][idx].need_init = true;
+		}
 
-	// for rollback
-	cache_info_snapshot = NULL;
-	last_operation = 0;
+		// for rollback
+		cache_info_snapshot[core_idx] = NULL;
+		last_operation[core_idx] = 0;
+
+		// for the drain engine
+		pending_cache_info[core_idx] = new struct mosaic_cache_info_t[cache_level_count];
+		pending_operation[core_idx] = 0;
+	}
 
 	// init mosaic_cache configuration
 	target_delta = 1;
 	check_period = 500000;
 	set_work_mode(0);
 	set_writeback_mode(0);
+	set_partition_mode(1);
+	set_drain_rate(0);
 
 	// init mosaic_cache information
 	last_check_cycle = 0;
@@ -50,10 +66,23 @@ void Mosaic_Cache::Mosaic_Cache_Global_Init(int new_core_num, int new_cache_leve
 		}
 	}
 	_total_writeback_counter = 0;
+	_migration_counter = new int*[core_num];
+	for(int core_idx = 0; core_idx < core_num; ++core_idx)
+	{
+		_migration_counter[core_idx] = new int[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			_migration_counter[core_idx][i] = 0;
+		}
+	}
+	_total_migration_counter = 0;
 	_l1_to_l2_counter = 0;
 	_l2_to_l1_counter = 0;
 	_l2_to_l3_counter = 0;
 	_l3_to_l2_counter = 0;
+	_total_reconfig_counter = 0;
+	_drained_reconfig_counter = 0;
+	_cancelled_reconfig_counter = 0;
 }
 
 Mosaic_Cache::~Mosaic_Cache()
@@ -62,13 +91,21 @@ Mosaic_Cache::~Mosaic_Cache()
 	print_statistics();
 
 	delete[] lpm_monitor;
-	delete[] mosaic_cache_info;
-	delete[] cache_info_snapshot;
 	for(int core_idx = 0; core_idx < core_num; core_idx++)
 	{
+		delete[] mosaic_cache_info[core_idx];
+		delete[] cache_info_snapshot[core_idx];
+		delete[] pending_cache_info[core_idx];
 		delete[] _writeback_counter[core_idx];
+		delete[] _migration_counter[core_idx];
 	}
+	delete[] mosaic_cache_info;
+	delete[] cache_info_snapshot;
+	delete[] pending_cache_info;
+	delete[] last_operation;
+	delete[] pending_operation;
 	delete[] _writeback_counter;
+	delete[] _migration_counter;
 }
 
 bool Mosaic_Cache::set_work_mode(int new_mode)
@@ -82,15 +119,35 @@ bool Mosaic_Cache::set_work_mode(int new_mode)
 
 bool Mosaic_Cache::set_writeback_mode(int new_mode)
 {
-	if(new_mode < 0 || new_mode > 1)
+	if(new_mode < 0 || new_mode > 2)
 		return false;
 	writeback_mode = new_mode;
 	return true;
 }
 
+bool Mosaic_Cache::set_partition_mode(int new_mode)
+{
+	if(new_mode < 0 || new_mode > 1)
+		return false;
+	partition_mode = new_mode;
+	return true;
+}
+
+bool Mosaic_Cache::set_drain_rate(int new_rate)
+{
+	if(new_rate < 0)
+		return false;
+	drain_rate = new_rate;
+	return true;
+}
+
 void Mosaic_Cache::set_delta(float new_delta)
 {
 	target_delta = new_delta;
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
+	{
+		lpm_monitor[core_idx].set_delta(target_delta);
+	}
 }
 
 void Mosaic_Cache::set_check_period(uint64_t new_check_period)
@@ -113,53 +170,67 @@ bool Mosaic_Cache::set_mosaic_cache_info(int cache_level, int way_num, int adapt
 		return false;
 	}
 
-	mosaic_cache_info[cache_level].origin_way_num = way_num;
-	mosaic_cache_info[cache_level].current_way_start_pos = 0;
-	mosaic_cache_info[cache_level].current_way_end_pos = way_num;
-	mosaic_cache_info[cache_level].adaptive_way_num = adaptive_way_num;
-	mosaic_cache_info[cache_level].ratio_of_lower_level = ratio;
-	mosaic_cache_info[cache_level].reconfig_threshold = reconfig_threshold;
-	mosaic_cache_info[cache_level].latency = latency;
-	mosaic_cache_info[cache_level].need_set = false;
+	// every core starts with the same ways
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
+	{
+		mosaic_cache_info[core_idx][cache_level].origin_way_num = way_num;
+		mosaic_cache_info[core_idx][cache_level].current_way_start_pos = 0;
+		mosaic_cache_info[core_idx][cache_level].current_way_end_pos = way_num;
+		mosaic_cache_info[core_idx][cache_level].adaptive_way_num = adaptive_way_num;
+		mosaic_cache_info[core_idx][cache_level].ratio_of_lower_level = ratio;
+		mosaic_cache_info[core_idx][cache_level].reconfig_threshold = reconfig_threshold;
+		mosaic_cache_info[core_idx][cache_level].latency = latency;
+		mosaic_cache_info[core_idx][cache_level].need_set = false;
+	}
 
 	return true;
 }
 
 bool Mosaic_Cache::init_mosaic_cache()
 {
-	for(int cache_level_idx = 0; cache_level_idx < cache_level_count; cache_level_idx++)
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
 	{
-		if(mosaic_cache_info[cache_level_idx].need_set == true)
-			return false;
-		if(mosaic_cache_info[cache_level_idx].ratio_of_lower_level == 0)
-		{
-			cout<<"[ERR] l"<<(cache_level_idx+1)<<".ratio_of_lower_level = 0!"<<endl;
-			return false;
-		}
+		struct mosaic_cache_info_t *cache_info = mosaic_cache_info[core_idx];
 
-		if(cache_level_idx == LPM_L1)
-		{
-			mosaic_cache_info[cache_level_idx].max_way_num =
-				mosaic_cache_info[cache_level_idx].origin_way_num
-				+ mosaic_cache_info[cache_level_idx+1].adaptive_way_num
-				* mosaic_cache_info[cache_level_idx].ratio_of_lower_level / 2;
-		}
-		else if(cache_level_idx == LPM_L2)
-		{
-			mosaic_cache_info[cache_level_idx].max_way_num =
-				mosaic_cache_info[cache_level_idx].origin_way_num
-				+ mosaic_cache_info[cache_level_idx+1].adaptive_way_num
-				* mosaic_cache_info[cache_level_idx].ratio_of_lower_level / core_num;
-		}
-		else if(cache_level_idx == LPM_L3)
+		for(int cache_level_idx = 0; cache_level_idx < cache_level_count; cache_level_idx++)
 		{
-			mosaic_cache_info[cache_level_idx].max_way_num = 
-				mosaic_cache_info[cache_level_idx].origin_way_num 
-				+ mosaic_cache_info[cache_level_idx-1].adaptive_way_num * core_num 
-				/ mosaic_cache_info[cache_level_idx-1].ratio_of_lower_level; 
+			if(cache_info[cache_level_idx].need_set == true)
+				return false;
+			if(cache_info[cache_level_idx].ratio_of_lower_level == 0)
+			{
+				cout<<"[ERR] l"<<(cache_level_idx+1)<<".ratio_of_lower_level = 0!"<<endl;
+				return false;
+			}
+
+			// a core that gives all its adaptive L2 ways to L3 gets max_way_num L3 ways
+			if(cache_level_idx == LPM_L1)
+			{
+				cache_info[cache_level_idx].max_way_num =
+					cache_info[cache_level_idx].origin_way_num
+					+ cache_info[cache_level_idx+1].adaptive_way_num
+					* cache_info[cache_level_idx].ratio_of_lower_level / 2;
+			}
+			else if(cache_level_idx == LPM_L2)
+			{
+				cache_info[cache_level_idx].max_way_num =
+					cache_info[cache_level_idx].origin_way_num
+					+ cache_info[cache_level_idx+1].adaptive_way_num
+					* cache_info[cache_level_idx].ratio_of_lower_level / core_num;
+			}
+			else if(cache_level_idx == LPM_L3)
+			{
+				cache_info[cache_level_idx].max_way_num = 
+					cache_info[cache_level_idx].origin_way_num 
+					+ cache_info[cache_level_idx-1].adaptive_way_num * core_num 
+					/ cache_info[cache_level_idx-1].ratio_of_lower_level; 
+			}
+			if(core_idx == 0)
+				cout<<"init cache l"<<cache_level_idx<<endl;
+			cache_info[cache_level_idx].need_init = false;
 		}
-		cout<<"init cache l"<<cache_level_idx<<endl;
-		mosaic_cache_info[cache_level_idx].need_init = false;
+
+		// the cycle counts are only printed in motivation mode
+		lpm_monitor[core_idx].set_print_detail(work_mode == 1);
 	}
 	return true;
 }
@@ -168,14 +239,17 @@ bool Mosaic_Cache::set_adaptive(int cache_level, int new_adaptive_way_num, int r
 {
 	if(cache_level<LPM_L1 || cache_level > LPM_L3)
 		return false;
-	if(mosaic_cache_info[cache_level].need_init == true)
+	if(mosaic_cache_info[0][cache_level].need_init == true)
 		return false;
-	if(mosaic_cache_info[cache_level].origin_way_num < new_adaptive_way_num)
+	if(mosaic_cache_info[0][cache_level].origin_way_num < new_adaptive_way_num)
 		return false;
 	if(reconfig_threshold > core_num)
 		return false;
-	mosaic_cache_info[cache_level].adaptive_way_num = new_adaptive_way_num;
-	mosaic_cache_info[cache_level].reconfig_threshold = reconfig_threshold;
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
+	{
+		mosaic_cache_info[core_idx][cache_level].adaptive_way_num = new_adaptive_way_num;
+		mosaic_cache_info[core_idx][cache_level].reconfig_threshold = reconfig_threshold;
+	}
 	if(init_mosaic_cache())
 	{
 		return true;
@@ -184,52 +258,113 @@ bool Mosaic_Cache::set_adaptive(int cache_level, int new_adaptive_way_num, int r
 		return false;
 }
 
+int Mosaic_Cache::get_current_way_num(int core_id, int cache_level)
+{
+	if(core_id < 0 || core_id >= core_num || cache_level < LPM_L1 || cache_level > LPM_L3)
+		return -1;
+	if(mosaic_cache_info[core_id][cache_level].need_init == true)
+		return -1;
+	int ret_val = mosaic_cache_info[core_id][cache_level].current_way_end_pos 
+		- mosaic_cache_info[core_id][cache_level].current_way_start_pos + 1;
+	return ret_val;
+}
+
+int Mosaic_Cache::get_current_way_start_pos(int core_id, int cache_level)
+{
+	if(core_id < 0 || core_id >= core_num || cache_level < LPM_L1 || cache_level > LPM_L3)
+		return -1;
+	if(mosaic_cache_info[core_id][cache_level].need_init == true)
+		return -1;
+	return mosaic_cache_info[core_id][cache_level].current_way_start_pos;
+}
+
+int Mosaic_Cache::get_current_way_end_pos(int core_id, int cache_level)
+{
+	if(core_id < 0 || core_id >= core_num || cache_level < LPM_L1 || cache_level > LPM_L3)
+		return -1;
+	if(mosaic_cache_info[core_id][cache_level].need_init == true)
+		return -1;
+	return mosaic_cache_info[core_id][cache_level].current_way_end_pos;
+}
+
+// the ways the core moves to once its pending reconfig is committed
+int Mosaic_Cache::get_pending_way_start_pos(int core_id, int cache_level)
+{
+	if(core_id < 0 || core_id >= core_num || cache_level < LPM_L1 || cache_level > LPM_L3)
+		return -1;
+	if(pending_operation[core_id] == 0)
+		return get_current_way_start_pos(core_id, cache_level);
+	return pending_cache_info[core_id][cache_level].current_way_start_pos;
+}
+
+int Mosaic_Cache::get_pending_way_end_pos(int core_id, int cache_level)
+{
+	if(core_id < 0 || core_id >= core_num || cache_level < LPM_L1 || cache_level > LPM_L3)
+		return -1;
+	if(pending_operation[core_id] == 0)
+		return get_current_way_end_pos(core_id, cache_level);
+	return pending_cache_info[core_id][cache_level].current_way_end_pos;
+}
+
 int Mosaic_Cache::get_current_way_num(int cache_level)
 {
 	if(cache_level < LPM_L1 || cache_level > LPM_L3)
 		return -1;
-	if(mosaic_cache_info[cache_level].need_init == true)
+	if(mosaic_cache_info[0][cache_level].need_init == true)
 		return -1;
-	int ret_val = mosaic_cache_info[cache_level].current_way_end_pos 
-		- mosaic_cache_info[cache_level].current_way_start_pos + 1;
+	int ret_val = get_current_way_end_pos(cache_level) - get_current_way_start_pos(cache_level) + 1;
 	return ret_val;
 }
 
+// the first way any core uses
 int Mosaic_Cache::get_current_way_start_pos(int cache_level)
 {
 	if(cache_level < LPM_L1 || cache_level > LPM_L3)
 		return -1;
-	if(mosaic_cache_info[cache_level].need_init == true)
+	if(mosaic_cache_info[0][cache_level].need_init == true)
 		return -1;
-	return mosaic_cache_info[cache_level].current_way_start_pos;
+	int ret_val = mosaic_cache_info[0][cache_level].current_way_start_pos;
+	for(int core_idx = 1; core_idx < core_num; core_idx++)
+	{
+		if(mosaic_cache_info[core_idx][cache_level].current_way_start_pos < ret_val)
+			ret_val = mosaic_cache_info[core_idx][cache_level].current_way_start_pos;
+	}
+	return ret_val;
 }
 
+// one past the last way any core uses
 int Mosaic_Cache::get_current_way_end_pos(int cache_level)
 {
 	if(cache_level < LPM_L1 || cache_level > LPM_L3)
 		return -1;
-	if(mosaic_cache_info[cache_level].need_init == true)
+	if(mosaic_cache_info[0][cache_level].need_init == true)
 		return -1;
-	return mosaic_cache_info[cache_level].current_way_end_pos;
+	int ret_val = mosaic_cache_info[0][cache_level].current_way_end_pos;
+	for(int core_idx = 1; core_idx < core_num; core_idx++)
+	{
+		if(mosaic_cache_info[core_idx][cache_level].current_way_end_pos > ret_val)
+			ret_val = mosaic_cache_info[core_idx][cache_level].current_way_end_pos;
+	}
+	return ret_val;
 }
 
 int Mosaic_Cache::get_max_way_num(int cache_level)
 {
 	if(cache_level < LPM_L1 || cache_level > LPM_L3)
 		return -1;
-	if(mosaic_cache_info[cache_level].need_init == true)
+	if(mosaic_cache_info[0][cache_level].need_init == true)
 		return -1;
-	return mosaic_cache_info[cache_level].max_way_num;
+	return mosaic_cache_info[0][cache_level].max_way_num;
 }
 
 bool Mosaic_Cache::need_check(uint64_t current_cycle)
 {
 
-	if(mosaic_cache_info[LPM_L1].need_init == true
-		|| mosaic_cache_info[LPM_L2].need_init == true
-		|| mosaic_cache_info[LPM_L3].need_init == true)
+	if(mosaic_cache_info[0][LPM_L1].need_init == true
+		|| mosaic_cache_info[0][LPM_L2].need_init == true
+		|| mosaic_cache_info[0][LPM_L3].need_init == true)
 	{
-		cout<<"not ready yet. l1:"<<mosaic_cache_info[LPM_L1].need_init<<" l2:"<<mosaic_cache_info[LPM_L2].need_init<<" l3:"<<mosaic_cache_info[LPM_L3].need_init<<endl;
+		cout<<"not ready yet. l1:"<<mosaic_cache_info[0][LPM_L1].need_init<<" l2:"<<mosaic_cache_info[0][LPM_L2].need_init<<" l3:"<<mosaic_cache_info[0][LPM_L3].need_init<<endl;
 		return false;
 	}
 
@@ -244,6 +379,21 @@ bool Mosaic_Cache::need_check(uint64_t current_cycle)
 	}
 }
 
+// the first cycle at which need_check() may return true (or prints its warning)
+uint64_t Mosaic_Cache::get_next_check_cycle()
+{
+	if(mosaic_cache_info[0][LPM_L1].need_init == true
+		|| mosaic_cache_info[0][LPM_L2].need_init == true
+		|| mosaic_cache_info[0][LPM_L3].need_init == true)
+		return 0;
+
+	// the drain engine writes back every cycle
+	if(has_pending())
+		return 0;
+
+	return last_check_cycle + check_period;
+}
+
 bool Mosaic_Cache::need_forward(uint64_t current_cycle)
 {
 	if(last_check_cycle + check_period < current_cycle)
@@ -254,41 +404,70 @@ bool Mosaic_Cache::need_forward(uint64_t current_cycle)
 
 bool Mosaic_Cache::reconfig(uint64_t current_cycle)
 {
-	if(mosaic_cache_info[LPM_L1].need_init == true
-		|| mosaic_cache_info[LPM_L2].need_init == true
-		|| mosaic_cache_info[LPM_L3].need_init == true)
+	if(mosaic_cache_info[0][LPM_L1].need_init == true
+		|| mosaic_cache_info[0][LPM_L2].need_init == true
+		|| mosaic_cache_info[0][LPM_L3].need_init == true)
 		return false;
 
 	if(work_mode == 0 || work_mode == 1 || current_cycle < last_check_cycle)
 		return false;
 
+	clear_last_operation();
+
+	// a core still draining keeps its pending reconfig
+	if(partition_mode == 0)
+	{
+		if(has_pending())
+			return false;
+		return _reconfig_cores(0, core_num);
+	}
+
+	bool ret = false;
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
+	{
+		if(pending_operation[core_idx] != 0)
+			continue;
+		if(_reconfig_cores(core_idx, core_idx + 1))
+		{
+			ret = true;
+		}
+	}
+	return ret;
+}
+
+bool Mosaic_Cache::_reconfig_cores(int first_core, int last_core)
+{
+	// the thresholds are votes of all cores, a core on its own reconfigs as soon as it misses the target
+	int threshold[LPM_L3+1];
+	for(int cache_level_idx = LPM_L1; cache_level_idx <= LPM_L3; cache_level_idx++)
+	{
+		threshold[cache_level_idx] = 1;
+		if(last_core - first_core == core_num)
+		{
+			threshold[cache_level_idx] = mosaic_cache_info[first_core][cache_level_idx].reconfig_threshold;
+		}
+	}
+
 	if(work_mode == 2) // only for L1-L2
 	{
 		int vote=0;
 		// L2->L1?
-		for(int core_idx = 0; core_idx < core_num; core_idx++)
+		for(int core_idx = first_core; core_idx < last_core; core_idx++)
 		{
 			if(!lpm_monitor[core_idx].check_perf_match(LPM_L1))
 			{
 				vote++;
 			}
 		}
-		if(vote >= mosaic_cache_info[LPM_L1].reconfig_threshold)
+		if(vote >= threshold[LPM_L1])
 		{
 			// L2->L1
-			if(_reconfig_l2_to_l1())
-			{
-				return true;
-			}
-			else
-			{
-				return false;
-			}
+			return _reconfig_l2_to_l1(first_core, last_core);
 		}
 		
 		// L1->L2?
 		vote = 0;
-		for(int core_idx = 0; core_idx < core_num; core_idx++)
+		for(int core_idx = first_core; core_idx < last_core; core_idx++)
 		{
 			if(!lpm_monitor[core_idx].check_perf_match(LPM_L2)
 				&& lpm_monitor[core_idx].check_perf_match(LPM_L1))
@@ -296,17 +475,10 @@ bool Mosaic_Cache::reconfig(uint64_t current_cycle)
 				vote++;
 			}
 		}
-		if(vote >= mosaic_cache_info[LPM_L2].reconfig_threshold)
+		if(vote >= threshold[LPM_L2])
 		{
 			// L1->L2
-			if(_reconfig_l1_to_l2())
-			{
-				return true;
-			}
-			else
-			{
-				return false;
-			}
+			return _reconfig_l1_to_l2(first_core, last_core);
 		}
 		return false;
 	}
@@ -314,28 +486,21 @@ bool Mosaic_Cache::reconfig(uint64_t current_cycle)
 	{
 		// L3->L2?
 		int vote = 0;
-		for(int core_idx = 0; core_idx < core_num; core_idx++)
+		for(int core_idx = first_core; core_idx < last_core; core_idx++)
 		{
 			if(!lpm_monitor[core_idx].check_perf_match(LPM_L2))
 			{
 				vote++;
 			}
 		}
-		if(vote >= mosaic_cache_info[LPM_L2].reconfig_threshold)
+		if(vote >= threshold[LPM_L2])
 		{
-			if(_reconfig_l3_to_l2())
-			{
-				return true;
-			}
-			else
-			{
-				return false;
-			}
+			return _reconfig_l3_to_l2(first_core, last_core);
 		}
 
 		// L2->L3?
 		vote = 0;
-		for(int core_idx = 0; core_idx < core_num; core_idx++)
+		for(int core_idx = first_core; core_idx < last_core; core_idx++)
 		{
 			if(!lpm_monitor[core_idx].check_perf_match(LPM_L3)
 				&& lpm_monitor[core_idx].check_perf_match(LPM_L2))
@@ -343,16 +508,9 @@ bool Mosaic_Cache::reconfig(uint64_t current_cycle)
 				vote++;
 			}
 		}
-		if(vote >= mosaic_cache_info[LPM_L3].reconfig_threshold)
+		if(vote >= threshold[LPM_L3])
 		{
-			if(_reconfig_l2_to_l3())
-			{
-				return true;
-			}
-			else
-			{
-				return false;
-			}
+			return _reconfig_l2_to_l3(first_core, last_core);
 		}
 		return false;
 	}
@@ -362,7 +520,7 @@ bool Mosaic_Cache::reconfig(uint64_t current_cycle)
 		int vote_l2 = 0;
 		int vote_l3 = 0;
 		// L2 first
-		for(int core_idx = 0; core_idx < core_num; core_idx++)
+		for(int core_idx = first_core; core_idx < last_core; core_idx++)
 		{
 			if(!lpm_monitor[core_idx].check_perf_match(LPM_L1))
 			{
@@ -378,49 +536,28 @@ bool Mosaic_Cache::reconfig(uint64_t current_cycle)
 			}
 		}
 
-		if(vote_l2 >= mosaic_cache_info[LPM_L2].reconfig_threshold)
+		if(vote_l2 >= threshold[LPM_L2])
 		{
-			if(_reconfig_l3_to_l2())
+			if(_reconfig_l3_to_l2(first_core, last_core))
 			{
 				return true;
 			}
-			else if(vote_l1 < mosaic_cache_info[LPM_L1].reconfig_threshold)
+			else if(vote_l1 < threshold[LPM_L1])
 			{
-				if(_reconfig_l1_to_l2())
-				{
-					return true;
-				}
-				else
-				{
-					return false;
-				}
+				return _reconfig_l1_to_l2(first_core, last_core);
 			}
 			else
 			{
 				return false;
 			}
 		}
-		else if(vote_l1 >= mosaic_cache_info[LPM_L1].reconfig_threshold)
+		else if(vote_l1 >= threshold[LPM_L1])
 		{
-			if(_reconfig_l2_to_l1())
-			{
-				return true;
-			}
-			else
-			{
-				return false;
-			}
+			return _reconfig_l2_to_l1(first_core, last_core);
 		}
-		else if(vote_l3 >= mosaic_cache_info[LPM_L3].reconfig_threshold)
+		else if(vote_l3 >= threshold[LPM_L3])
 		{
-			if(_reconfig_l2_to_l3())
-			{
-				return true;
-			}
-			else
-			{
-				return false;
-			}
+			return _reconfig_l2_to_l3(first_core, last_core);
 		}
 		else
 		{
@@ -444,7 +581,7 @@ bool Mosaic_Cache::access_reg(int core_id, int cache_level, uint64_t event_cycle
 
 	if(type == LPM_ACCESS_START)
 	{
-		int cycle_count = mosaic_cache_info[cache_level].latency;
+		int cycle_count = mosaic_cache_info[core_id][cache_level].latency;
 		lpm_monitor[core_id].access_reg(cache_level, event_cycle, cycle_count, LPM_ACCESS_START);
 	}
 	else if(type == LPM_ACCESS_END) 
@@ -477,12 +614,28 @@ float Mosaic_Cache::get_lpmr(int core_id, int cache_level, int inst_num, uint64_
 	return lpm_monitor[core_id].get_lpmr(cache_level, inst_num, current_cycle);
 }
 
+// the lpmr of every level, reconfig() matches them against the target
+void Mosaic_Cache::update_lpmr(int core_id, int inst_num, uint64_t current_cycle)
+{
+	for(int cache_level_idx = 0; cache_level_idx < cache_level_count; cache_level_idx++)
+	{
+		lpm_monitor[core_id].get_lpmr(cache_level_idx, inst_num, current_cycle);
+	}
+	lpm_monitor[core_id].set_last_inst_num(inst_num);
+}
+
 void Mosaic_Cache::add_writeback(int core_id, int cache_level, int writeback_count)
 {
 	_writeback_counter[core_id][cache_level] += writeback_count;
 	_total_writeback_counter += writeback_count;
 }
 
+void Mosaic_Cache::add_migration(int core_id, int cache_level, int migration_count)
+{
+	_migration_counter[core_id][cache_level] += migration_count;
+	_total_migration_counter += migration_count;
+}
+
 void Mosaic_Cache::print_statistics()
 {
 	cout<<"====MOSAIC_CACHE_STAT_BEGIN===="<<endl;
@@ -495,6 +648,23 @@ void Mosaic_Cache::print_statistics()
 			cout<<"---- Cache L"<<(i+1)<<": "<<_writeback_counter[core_idx][i]<<endl;
 		}
 	}
+	if(drain_rate > 0)
+	{
+		cout<<"TOTAL DRAINED RECONFIG: "<<_drained_reconfig_counter<<endl;
+		cout<<"TOTAL CANCELLED RECONFIG: "<<_cancelled_reconfig_counter<<endl;
+	}
+	if(writeback_mode == 2)
+	{
+		cout<<"TOTAL MIGRATION: "<<_total_migration_counter<<endl;
+		for(int core_idx = 0; core_idx < core_num; core_idx++)
+		{
+			cout<<"-- Core ["<<core_idx<<"]"<<endl;
+			for(int i = 0; i < 3; i++)
+			{
+				cout<<"---- Cache L"<<(i+1)<<": "<<_migration_counter[core_idx][i]<<endl;
+			}
+		}
+	}
 	cout<<"TOTAL CACHE RECONFIG: "<<_total_reconfig_counter<<endl;
 	cout<<"-- L1 to L2: "<<_l1_to_l2_counter<<endl;
 	cout<<"-- L2 to L1: "<<_l2_to_l1_counter<<endl;
@@ -503,22 +673,49 @@ void Mosaic_Cache::print_statistics()
 	cout<<"====MOSAIC_CACHE_STAT_END===="<<endl;
 }
 
-bool Mosaic_Cache::_reconfig_l1_to_l2()
+std::string Mosaic_Cache::json_statistics()
+{
+	std::ostringstream out;
+	out<<"{\"work_mode\": "<<work_mode<<", \"total_writeback\": "<<_total_writeback_counter<<", \"writeback\": [";
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
+	{
+		out<<(core_idx ? ", " : "")<<"["<<_writeback_counter[core_idx][0]<<", "<<_writeback_counter[core_idx][1]<<", "<<_writeback_counter[core_idx][2]<<"]";
+	}
+	out<<"], \"total_migration\": "<<_total_migration_counter<<", \"migration\": [";
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
+	{
+		out<<(core_idx ? ", " : "")<<"["<<_migration_counter[core_idx][0]<<", "<<_migration_counter[core_idx][1]<<", "<<_migration_counter[core_idx][2]<<"]";
+	}
+	out<<"], \"total_reconfig\": "<<_total_reconfig_counter;
+	out<<", \"l1_to_l2\": "<<_l1_to_l2_counter<<", \"l2_to_l1\": "<<_l2_to_l1_counter;
+	out<<", \"l2_to_l3\": "<<_l2_to_l3_counter<<", \"l3_to_l2\": "<<_l3_to_l2_counter;
+	out<<", \"drained_reconfig\": "<<_drained_reconfig_counter<<", \"cancelled_reconfig\": "<<_cancelled_reconfig_counter<<"}";
+	return out.str();
+}
+
+// the ways of the cores [first_core, last_core) are the same, so are the checks
+bool Mosaic_Cache::_reconfig_l1_to_l2(int first_core, int last_core)
 {
-	if(mosaic_cache_info[LPM_L1].current_way_end_pos > mosaic_cache_info[LPM_L1].origin_way_num
-		&& mosaic_cache_info[LPM_L2].current_way_start_pos > 0)
+	struct mosaic_cache_info_t *cache_info = mosaic_cache_info[first_core];
+	if(cache_info[LPM_L1].current_way_end_pos > cache_info[LPM_L1].origin_way_num
+		&& cache_info[LPM_L2].current_way_start_pos > 0)
 	{
 		// L2 already sent adaptive block to L1, now return to L2
-		int new_pos = mosaic_cache_info[LPM_L1].current_way_end_pos
-			- mosaic_cache_info[LPM_L1].ratio_of_lower_level / 2;
-		if(new_pos > mosaic_cache_info[LPM_L1].origin_way_num)
+		int new_pos = cache_info[LPM_L1].current_way_end_pos
+			- cache_info[LPM_L1].ratio_of_lower_level / 2;
+		if(new_pos > cache_info[LPM_L1].origin_way_num)
 		{
-			// create rollback information
-			_snapshot();
-			last_operation =1;
-
-			mosaic_cache_info[LPM_L2].current_way_start_pos--;
-			mosaic_cache_info[LPM_L1].current_way_end_pos = new_pos;
+			for(int core_idx = first_core; core_idx < last_core; core_idx++)
+			{
+				// create rollback information
+				_snapshot(core_idx);
+				last_operation[core_idx] = 1;
+				_l1_to_l2_counter++;
+				_total_reconfig_counter++;
+
+				mosaic_cache_info[core_idx][LPM_L2].current_way_start_pos--;
+				mosaic_cache_info[core_idx][LPM_L1].current_way_end_pos = new_pos;
+			}
 			return true;
 		}
 		else
@@ -532,21 +729,27 @@ bool Mosaic_Cache::_reconfig_l1_to_l2()
 	}
 }
 
-bool Mosaic_Cache::_reconfig_l2_to_l1()
+bool Mosaic_Cache::_reconfig_l2_to_l1(int first_core, int last_core)
 {
-	if(mosaic_cache_info[LPM_L1].current_way_end_pos < mosaic_cache_info[LPM_L1].max_way_num
-		&& mosaic_cache_info[LPM_L2].current_way_start_pos < mosaic_cache_info[LPM_L2].adaptive_way_num-1)
+	struct mosaic_cache_info_t *cache_info = mosaic_cache_info[first_core];
+	if(cache_info[LPM_L1].current_way_end_pos < cache_info[LPM_L1].max_way_num
+		&& cache_info[LPM_L2].current_way_start_pos < cache_info[LPM_L2].adaptive_way_num-1)
 	{
-		int new_pos = mosaic_cache_info[LPM_L1].current_way_end_pos 
-			+ mosaic_cache_info[LPM_L1].ratio_of_lower_level / 2;
-		if(new_pos < mosaic_cache_info[LPM_L1].max_way_num)
+		int new_pos = cache_info[LPM_L1].current_way_end_pos 
+			+ cache_info[LPM_L1].ratio_of_lower_level / 2;
+		if(new_pos < cache_info[LPM_L1].max_way_num)
 		{
-			// create rollback information
-			_snapshot();
-			last_operation = 2;
-
-			mosaic_cache_info[LPM_L1].current_way_end_pos = new_pos;
-			mosaic_cache_info[LPM_L2].current_way_start_pos++;
+			for(int core_idx = first_core; core_idx < last_core; core_idx++)
+			{
+				// create rollback information
+				_snapshot(core_idx);
+				last_operation[core_idx] = 2;
+				_l2_to_l1_counter++;
+				_total_reconfig_counter++;
+
+				mosaic_cache_info[core_idx][LPM_L1].current_way_end_pos = new_pos;
+				mosaic_cache_info[core_idx][LPM_L2].current_way_start_pos++;
+			}
 			return true;
 		} 
 		else
@@ -560,47 +763,32 @@ bool Mosaic_Cache::_reconfig_l2_to_l1()
 	}
 }
 
-bool Mosaic_Cache::_reconfig_l2_to_l3()
+// L3 ways are counted per core: a core's L3 window is the part of the shared LLC it fills
+bool Mosaic_Cache::_reconfig_l2_to_l3(int first_core, int last_core)
 {
-	if(mosaic_cache_info[LPM_L2].current_way_end_pos > mosaic_cache_info[LPM_L2].origin_way_num) 
+	struct mosaic_cache_info_t *cache_info = mosaic_cache_info[first_core];
+	int new_l2_start_pos = cache_info[LPM_L2].current_way_start_pos;
+	int new_l2_end_pos = cache_info[LPM_L2].current_way_end_pos;
+
+	if(cache_info[LPM_L2].current_way_end_pos > cache_info[LPM_L2].origin_way_num) 
 	{
 		// L3 already sent adaptive way to L2, now return to L3
-		int new_pos = mosaic_cache_info[LPM_L2].current_way_end_pos 
-			- mosaic_cache_info[LPM_L2].ratio_of_lower_level * 1 / core_num;
-		if(new_pos >= mosaic_cache_info[LPM_L2].origin_way_num
-			&& mosaic_cache_info[LPM_L3].current_way_end_pos < mosaic_cache_info[LPM_L3].origin_way_num)
-		{
-			// create rollback information
-			_snapshot();
-			last_operation = 3;
-
-			mosaic_cache_info[LPM_L2].current_way_end_pos = new_pos;
-			mosaic_cache_info[LPM_L3].current_way_end_pos++;
-			return true;
-		}
-		else
+		new_l2_end_pos = cache_info[LPM_L2].current_way_end_pos 
+			- cache_info[LPM_L2].ratio_of_lower_level * 1 / core_num;
+		if(!(new_l2_end_pos >= cache_info[LPM_L2].origin_way_num
+			&& cache_info[LPM_L3].current_way_end_pos < cache_info[LPM_L3].origin_way_num))
 		{
 			return false;
 		}
 	}
-	else if(mosaic_cache_info[LPM_L2].current_way_start_pos 
-		< mosaic_cache_info[LPM_L2].adaptive_way_num-1)
+	else if(cache_info[LPM_L2].current_way_start_pos 
+		< cache_info[LPM_L2].adaptive_way_num-1)
 	{
 		// L2's adaptive ways are available, now send to L3
-		int new_pos = mosaic_cache_info[LPM_L2].current_way_start_pos
-			+ mosaic_cache_info[LPM_L2].ratio_of_lower_level / core_num;
-		if(new_pos < mosaic_cache_info[LPM_L2].adaptive_way_num
-			&& mosaic_cache_info[LPM_L3].current_way_end_pos < mosaic_cache_info[LPM_L3].max_way_num)
-		{
-			// create rollback information
-			_snapshot();
-			last_operation = 3;
-
-			mosaic_cache_info[LPM_L2].current_way_start_pos = new_pos;
-			mosaic_cache_info[LPM_L3].current_way_end_pos++;
-			return true;
-		}
-		else
+		new_l2_start_pos = cache_info[LPM_L2].current_way_start_pos
+			+ cache_info[LPM_L2].ratio_of_lower_level / core_num;
+		if(!(new_l2_start_pos < cache_info[LPM_L2].adaptive_way_num
+			&& cache_info[LPM_L3].current_way_end_pos < cache_info[LPM_L3].max_way_num))
 		{
 			return false;
 		}
@@ -609,48 +797,46 @@ bool Mosaic_Cache::_reconfig_l2_to_l3()
 	{
 		return false;
 	}
+
+	for(int core_idx = first_core; core_idx < last_core; core_idx++)
+	{
+		// create rollback information
+		_snapshot(core_idx);
+		last_operation[core_idx] = 3;
+		_l2_to_l3_counter++;
+		_total_reconfig_counter++;
+
+		mosaic_cache_info[core_idx][LPM_L2].current_way_start_pos = new_l2_start_pos;
+		mosaic_cache_info[core_idx][LPM_L2].current_way_end_pos = new_l2_end_pos;
+		mosaic_cache_info[core_idx][LPM_L3].current_way_end_pos++;
+	}
+	return true;
 }
 
-bool Mosaic_Cache::_reconfig_l3_to_l2()
+bool Mosaic_Cache::_reconfig_l3_to_l2(int first_core, int last_core)
 {
-	if(mosaic_cache_info[LPM_L3].current_way_end_pos > mosaic_cache_info[LPM_L3].origin_way_num)
+	struct mosaic_cache_info_t *cache_info = mosaic_cache_info[first_core];
+	int new_l2_start_pos = cache_info[LPM_L2].current_way_start_pos;
+	int new_l2_end_pos = cache_info[LPM_L2].current_way_end_pos;
+
+	if(cache_info[LPM_L3].current_way_end_pos > cache_info[LPM_L3].origin_way_num)
 	{
 		// L2 already sent its block to L3, now return to L2
-		int new_pos = mosaic_cache_info[LPM_L2].current_way_start_pos 
-			- mosaic_cache_info[LPM_L2].ratio_of_lower_level / core_num;
-		if(new_pos >=0)
-		{
-			// create rollback information
-			_snapshot();
-			last_operation = 4;
-
-			mosaic_cache_info[LPM_L2].current_way_start_pos = new_pos;
-			mosaic_cache_info[LPM_L3].current_way_end_pos--;
-			return true;
-		}
-		else
+		new_l2_start_pos = cache_info[LPM_L2].current_way_start_pos 
+			- cache_info[LPM_L2].ratio_of_lower_level / core_num;
+		if(new_l2_start_pos < 0)
 		{
 			return false;
 		}
 	}
-	else if(mosaic_cache_info[LPM_L3].current_way_end_pos <= mosaic_cache_info[LPM_L3].origin_way_num
-		&& mosaic_cache_info[LPM_L3].current_way_end_pos >= (mosaic_cache_info[LPM_L3].origin_way_num 
-			- mosaic_cache_info[LPM_L3].adaptive_way_num))
+	else if(cache_info[LPM_L3].current_way_end_pos <= cache_info[LPM_L3].origin_way_num
+		&& cache_info[LPM_L3].current_way_end_pos >= (cache_info[LPM_L3].origin_way_num 
+			- cache_info[LPM_L3].adaptive_way_num))
 	{
 		// L3 has adaptive block for sending to L2
-		int new_pos = mosaic_cache_info[LPM_L2].current_way_end_pos
-			+ mosaic_cache_info[LPM_L2].ratio_of_lower_level / core_num;
-		if(new_pos < mosaic_cache_info[LPM_L2].max_way_num)
-		{
-			// create rollback information
-			_snapshot();
-			last_operation = 4;
-
-			mosaic_cache_info[LPM_L2].current_way_end_pos = new_pos;
-			mosaic_cache_info[LPM_L3].current_way_end_pos--;
-			return true;
-		}
-		else
+		new_l2_end_pos = cache_info[LPM_L2].current_way_end_pos
+			+ cache_info[LPM_L2].ratio_of_lower_level / core_num;
+		if(new_l2_end_pos >= cache_info[LPM_L2].max_way_num)
 		{
 			return false;
 		}
@@ -659,27 +845,32 @@ bool Mosaic_Cache::_reconfig_l3_to_l2()
 	{
 		return false;
 	}
+
+	for(int core_idx = first_core; core_idx < last_core; core_idx++)
+	{
+		// create rollback information
+		_snapshot(core_idx);
+		last_operation[core_idx] = 4;
+		_l3_to_l2_counter++;
+		_total_reconfig_counter++;
+
+		mosaic_cache_info[core_idx][LPM_L2].current_way_start_pos = new_l2_start_pos;
+		mosaic_cache_info[core_idx][LPM_L2].current_way_end_pos = new_l2_end_pos;
+		mosaic_cache_info[core_idx][LPM_L3].current_way_end_pos--;
+	}
+	return true;
 }
 
-void Mosaic_Cache::_snapshot()
+void Mosaic_Cache::_snapshot(int core_id)
 {
-	if(cache_info_snapshot != NULL)
-		delete[] cache_info_snapshot;
+	if(cache_info_snapshot[core_id] != NULL)
+		delete[] cache_info_snapshot[core_id];
 
-	cache_info_snapshot = new struct mosaic_cache_info_t[cache_level_count];
+	cache_info_snapshot[core_id] = new struct mosaic_cache_info_t[cache_level_count];
 
 	for(int cache_idx = 0; cache_idx < cache_level_count; ++cache_idx)
 	{
-		cache_info_snapshot[cache_idx].need_set = mosaic_cache_info[cache_idx].need_set;
-		cache_info_snapshot[cache_idx].need_init = mosaic_cache_info[cache_idx].need_init;
-		cache_info_snapshot[cache_idx].origin_way_num = mosaic_cache_info[cache_idx].origin_way_num;
-		cache_info_snapshot[cache_idx].current_way_start_pos = mosaic_cache_info[cache_idx].current_way_start_pos;
-		cache_info_snapshot[cache_idx].current_way_end_pos = mosaic_cache_info[cache_idx].current_way_end_pos;
-		cache_info_snapshot[cache_idx].max_way_num = mosaic_cache_info[cache_idx].max_way_num;
-		cache_info_snapshot[cache_idx].adaptive_way_num = mosaic_cache_info[cache_idx].adaptive_way_num;
-		cache_info_snapshot[cache_idx].ratio_of_lower_level = mosaic_cache_info[cache_idx].ratio_of_lower_level;
-		cache_info_snapshot[cache_idx].reconfig_threshold = mosaic_cache_info[cache_idx].reconfig_threshold;
-		cache_info_snapshot[cache_idx].latency = mosaic_cache_info[cache_idx].latency;
+		cache_info_snapshot[core_id][cache_idx] = mosaic_cache_info[core_id][cache_idx];
 	}
 }
 
@@ -698,27 +889,19 @@ void Mosaic_Cache::set_last_inst_num(int core_id, uint64_t inst_num)
 	lpm_monitor[core_id].set_last_inst_num(inst_num);
 }
 
-bool Mosaic_Cache::RollBack()
+// undo the last operation of core_id
+bool Mosaic_Cache::RollBack(int core_id)
 {
-	if(cache_info_snapshot == NULL || last_operation < 1 || last_operation > 4)
+	if(cache_info_snapshot[core_id] == NULL || last_operation[core_id] < 1 || last_operation[core_id] > 4)
 		return false;
 
 	for(int cache_idx = 0; cache_idx < cache_level_count; cache_idx++)
 	{
-		mosaic_cache_info[cache_idx].need_set = cache_info_snapshot[cache_idx].need_set;
-		mosaic_cache_info[cache_idx].need_init =cache_info_snapshot[cache_idx].need_init;
-		mosaic_cache_info[cache_idx].origin_way_num = cache_info_snapshot[cache_idx].origin_way_num;
-		mosaic_cache_info[cache_idx].current_way_start_pos = cache_info_snapshot[cache_idx].current_way_start_pos;
-		mosaic_cache_info[cache_idx].current_way_end_pos = cache_info_snapshot[cache_idx].current_way_end_pos;
-		mosaic_cache_info[cache_idx].max_way_num = cache_info_snapshot[cache_idx].max_way_num;
-		mosaic_cache_info[cache_idx].adaptive_way_num = cache_info_snapshot[cache_idx].adaptive_way_num;
-		mosaic_cache_info[cache_idx].ratio_of_lower_level = cache_info_snapshot[cache_idx].ratio_of_lower_level;
-		mosaic_cache_info[cache_idx].reconfig_threshold = cache_info_snapshot[cache_idx].reconfig_threshold;
-		mosaic_cache_info[cache_idx].latency = cache_info_snapshot[cache_idx].latency;
+		mosaic_cache_info[core_id][cache_idx] = cache_info_snapshot[core_id][cache_idx];
 	}
 
 	_total_reconfig_counter--;
-	switch (last_operation)
+	switch (last_operation[core_id])
 	{
 		case 1:
 			_l1_to_l2_counter--;
@@ -735,8 +918,86 @@ bool Mosaic_Cache::RollBack()
 		default:
 			return false;
 	}
+	last_operation[core_id] = 0;
 
-	delete[] cache_info_snapshot;
-	cache_info_snapshot = NULL;
+	delete[] cache_info_snapshot[core_id];
+	cache_info_snapshot[core_id] = NULL;
+	return true;
+}
+
+void Mosaic_Cache::clear_last_operation()
+{
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
+	{
+		last_operation[core_idx] = 0;
+	}
+}
+
+bool Mosaic_Cache::has_pending()
+{
+	for(int core_idx = 0; core_idx < core_num; core_idx++)
+	{
+		if(pending_operation[core_idx] != 0)
+			return true;
+	}
+	return false;
+}
+
+// undoes the last reconfig of the core like RollBack(), Commit() applies it again once its ways are clean
+bool Mosaic_Cache::Defer(int core_id)
+{
+	int op = last_operation[core_id];
+
+	for(int cache_idx = 0; cache_idx < cache_level_count; cache_idx++)
+	{
+		pending_cache_info[core_id][cache_idx] = mosaic_cache_info[core_id][cache_idx];
+	}
+	if(!RollBack(core_id))
+		return false;
+
+	pending_operation[core_id] = op;
 	return true;
-}
\ No newline at end of file
+}
+
+bool Mosaic_Cache::Commit(int core_id)
+{
+	if(pending_operation[core_id] < 1 || pending_operation[core_id] > 4)
+		return false;
+
+	_snapshot(core_id);
+	for(int cache_idx = 0; cache_idx < cache_level_count; cache_idx++)
+	{
+		mosaic_cache_info[core_id][cache_idx] = pending_cache_info[core_id][cache_idx];
+	}
+
+	_total_reconfig_counter++;
+	switch (pending_operation[core_id])
+	{
+		case 1:
+			_l1_to_l2_counter++;
+			break;
+		case 2:
+			_l2_to_l1_counter++;
+			break;
+		case 3:
+			_l2_to_l3_counter++;
+			break;
+		case 4:
+			_l3_to_l2_counter++;
+			break;
+	}
+	_drained_reconfig_counter++;
+
+	last_operation[core_id] = pending_operation[core_id];
+	pending_operation[core_id] = 0;
+	return true;
+}
+
+void Mosaic_Cache::CancelPending(int core_id)
+{
+	if(pending_operation[core_id] == 0)
+		return;
+
+	pending_operation[core_id] = 0;
+	_cancelled_reconfig_counter++;
+}
@@ -5,12 +5,154 @@
 O3_CPU ooo_cpu[NUM_CPUS]; 
 uint64_t current_core_cycle[NUM_CPUS], stall_cycle[NUM_CPUS];
 uint32_t SCHEDULING_LATENCY = 0, EXEC_LATENCY = 0, DECODE_LATENCY = 0;
+uint32_t FETCH_WIDTH = 12, DECODE_WIDTH = 6, EXEC_WIDTH = 6, LQ_WIDTH = 42, SQ_WIDTH = 2, RETIRE_WIDTH = 4,
+         SCHEDULER_SIZE = 128, BRANCH_MISPREDICT_PENALTY = 4;
 
 void O3_CPU::initialize_core()
 {
 
 }
 
+// one cycle of the pipeline and the private caches
+void O3_CPU::operate()
+{
+    // core might be stalled due to page fault or branch misprediction
+    if (stall_cycle[cpu] <= current_core_cycle[cpu]) 
+    {
+        // retire
+        if ((ROB.entry[ROB.head].executed == COMPLETED) && (ROB.entry[ROB.head].event_cycle <= current_core_cycle[cpu]))
+          retire_rob();
+
+        // complete 
+        update_rob();
+
+        // schedule
+        uint32_t schedule_index = ROB.next_schedule;
+        if ((ROB.entry[schedule_index].scheduled == 0) && (ROB.entry[schedule_index].event_cycle <= current_core_cycle[cpu]))
+            schedule_instruction();
+        // execute
+        execute_instruction();
+
+        update_rob();
+
+        // memory operation
+        schedule_memory_instruction();
+        execute_memory_instruction();
+
+        update_rob();
+
+        // decode
+        if(DECODE_BUFFER.occupancy > 0)
+        {
+            decode_and_dispatch();
+        }
+      
+        // fetch
+        fetch_instruction();
+      
+        // read from trace
+        if ((IFETCH_BUFFER.occupancy < IFETCH_BUFFER.SIZE) && (fetch_stall == 0))
+        {
+            read_from_trace();
+        }
+    }
+}
+
+// x86 traces do not record the branch type, so derive it from the registers the instruction uses
+static void decode_branch_type(ooo_model_instr *arch_instr)
+{
+    bool reads_sp = false;
+    bool writes_sp = false;
+    bool reads_flags = false;
+    bool reads_ip = false;
+    bool writes_ip = false;
+    bool reads_other = false;
+
+    for (uint32_t i=0; i<MAX_INSTR_DESTINATIONS; i++) {
+        switch(arch_instr->destination_registers[i])
+          {
+          case 0:
+            break;
+          case REG_STACK_POINTER:
+            writes_sp = true;
+            break;
+          case REG_INSTRUCTION_POINTER:
+            writes_ip = true;
+            break;
+          default:
+            break;
+          }
+    }
+
+    for (uint32_t i=0; i<NUM_INSTR_SOURCES; i++) {
+        switch(arch_instr->source_registers[i])
+          {
+          case 0:
+            break;
+          case REG_STACK_POINTER:
+            reads_sp = true;
+            break;
+          case REG_FLAGS:
+            reads_flags = true;
+            break;
+          case REG_INSTRUCTION_POINTER:
+            reads_ip = true;
+            break;
+          default:
+            reads_other = true;
+            break;
+          }
+    }
+
+    if(!reads_sp && !reads_flags && writes_ip && !reads_other)
+      {
+        // direct jump
+        arch_instr->is_branch = 1;
+        arch_instr->branch_taken = 1;
+        arch_instr->branch_type = BRANCH_DIRECT_JUMP;
+      }
+    else if(!reads_sp && !reads_flags && writes_ip && reads_other)
+      {
+        // indirect branch
+        arch_instr->is_branch = 1;
+        arch_instr->branch_taken = 1;
+        arch_instr->branch_type = BRANCH_INDIRECT;
+      }
+    else if(!reads_sp && reads_ip && !writes_sp && writes_ip && reads_flags && !reads_other)
+      {
+        // conditional branch
+        arch_instr->is_branch = 1;
+        arch_instr->branch_type = BRANCH_CONDITIONAL; // branch_taken comes from the trace
+      }
+    else if(reads_sp && reads_ip && writes_sp && writes_ip && !reads_flags && !reads_other)
+      {
+        // direct call
+        arch_instr->is_branch = 1;
+        arch_instr->branch_taken = 1;
+        arch_instr->branch_type = BRANCH_DIRECT_CALL;
+      }
+    else if(reads_sp && reads_ip && writes_sp && writes_ip && !reads_flags && reads_other)
+      {
+        // indirect call
+        arch_instr->is_branch = 1;
+        arch_instr->branch_taken = 1;
+        arch_instr->branch_type = BRANCH_INDIRECT_CALL;
+      }
+    else if(reads_sp && !reads_ip && writes_sp && writes_ip)
+      {
+        // return
+        arch_instr->is_branch = 1;
+        arch_instr->branch_taken = 1;
+        arch_instr->branch_type = BRANCH_RETURN;
+      }
+    else if(writes_ip)
+      {
+        // some other branch type that doesn't fit the above categories
+        arch_instr->is_branch = 1;
+        arch_instr->branch_type = BRANCH_OTHER; // branch_taken comes from the trace
+      }
+}
+
 void O3_CPU::read_from_trace()
 {
     // actual processors do not work like this but for easier implementation,
@@ -27,19 +169,23 @@ void O3_CPU::read_from_trace()
         size_t instr_size = knob_cloudsuite ? sizeof(cloudsuite_instr) : sizeof(input_instr);
 
         if (knob_cloudsuite) {
-            if (!fread(&current_cloudsuite_instr, instr_size, 1, trace_file)) {
+            if ((cloudsuite_held == 0) && !trace_reader.read(&current_cloudsuite_instr, instr_size, 1)) {
                 // reached end of file for this trace
                 cout << "*** Reached end of trace for Core: " << cpu << " Repeating trace: " << trace_string << endl; 
 
-                // close the trace file and re-open it
-                pclose(trace_file);
-                trace_file = popen(gunzip_command, "r");
-                if (trace_file == NULL) {
+                // rewind the trace, no need to restart the decompressor process
+                if (trace_reader.rewind()) {
                     cerr << endl << "*** CANNOT REOPEN TRACE FILE: " << trace_string << " ***" << endl;
                     assert(0);
                 }
             } else { // successfully read the trace
 
+                // the record functional warmup read ahead comes first
+                if (cloudsuite_held) {
+                    current_cloudsuite_instr = next_cloudsuite_instr;
+                    cloudsuite_held = 0;
+                }
+
                 // copy the instruction into the performance model's instruction format
                 ooo_model_instr arch_instr;
                 int num_reg_ops = 0, num_mem_ops = 0;
@@ -143,15 +289,13 @@ void O3_CPU::read_from_trace()
 	else
 	  {
 	    input_instr trace_read_instr;
-            if (!fread(&trace_read_instr, instr_size, 1, trace_file))
+            if (!trace_reader.read(&trace_read_instr, instr_size, 1))
 	      {
                 // reached end of file for this trace
                 cout << "*** Reached end of trace for Core: " << cpu << " Repeating trace: " << trace_string << endl; 
 		
-                // close the trace file and re-open it
-                pclose(trace_file);
-                trace_file = popen(gunzip_command, "r");
-                if (trace_file == NULL) {
+                // rewind the trace, no need to restart the decompressor process
+                if (trace_reader.rewind()) {
 		  cerr << endl << "*** CANNOT REOPEN TRACE FILE: " << trace_string << " ***" << endl;
                     assert(0);
                 }
@@ -181,32 +325,11 @@ void O3_CPU::read_from_trace()
                 arch_instr.asid[0] = cpu;
                 arch_instr.asid[1] = cpu;
 
-		bool reads_sp = false;
-		bool writes_sp = false;
-		bool reads_flags = false;
-		bool reads_ip = false;
-		bool writes_ip = false;
-		bool reads_other = false;
-
                 for (uint32_t i=0; i<MAX_INSTR_DESTINATIONS; i++) {
                     arch_instr.destination_registers[i] = current_instr.destination_registers[i];
                     arch_instr.destination_memory[i] = current_instr.destination_memory[i];
                     arch_instr.destination_virtual_address[i] = current_instr.destination_memory[i];
 
-		    switch(arch_instr.destination_registers[i])
-		      {
-		      case 0:
-			break;
-		      case REG_STACK_POINTER:
-			writes_sp = true;
-			break;
-		      case REG_INSTRUCTION_POINTER:
-			writes_ip = true;
-			break;
-		      default:
-			break;
-		      }
-
 		    /*
 		    if((arch_instr.is_branch) && (arch_instr.destination_registers[i] > 24) && (arch_instr.destination_registers[i] < 28))
 		      {
@@ -241,24 +364,6 @@ void O3_CPU::read_from_trace()
                     arch_instr.source_memory[i] = current_instr.source_memory[i];
                     arch_instr.source_virtual_address[i] = current_instr.source_memory[i];
 
-		    switch(arch_instr.source_registers[i])
-                      {
-                      case 0:
-                        break;
-                      case REG_STACK_POINTER:
-                        reads_sp = true;
-                        break;
-                      case REG_FLAGS:
-                        reads_flags = true;
-                        break;
-                      case REG_INSTRUCTION_POINTER:
-                        reads_ip = true;
-                        break;
-                      default:
-                        reads_other = true;
-                        break;
-                      }
-		    
 		    /*
 		    if((!arch_instr.is_branch) && (arch_instr.source_registers[i] > 25) && (arch_instr.source_registers[i] < 28))
 		      {
@@ -278,55 +383,7 @@ void O3_CPU::read_from_trace()
                     arch_instr.is_memory = 1;
 
 		// determine what kind of branch this is, if any
-		if(!reads_sp && !reads_flags && writes_ip && !reads_other)
-		  {
-		    // direct jump
-		    arch_instr.is_branch = 1;
-                    arch_instr.branch_taken = 1;
-                    arch_instr.branch_type = BRANCH_DIRECT_JUMP;
-		  }
-		else if(!reads_sp && !reads_flags && writes_ip && reads_other)
-		  {
-		    // indirect branch
-		    arch_instr.is_branch = 1;
-                    arch_instr.branch_taken = 1;
-                    arch_instr.branch_type = BRANCH_INDIRECT;
-		  }
-		else if(!reads_sp && reads_ip && !writes_sp && writes_ip && reads_flags && !reads_other)
-		  {
-		    // conditional branch
-		    arch_instr.is_branch = 1;
-		    arch_instr.branch_taken = arch_instr.branch_taken; // don't change this
-		    arch_instr.branch_type = BRANCH_CONDITIONAL;
-		  }
-		else if(reads_sp && reads_ip && writes_sp && writes_ip && !reads_flags && !reads_other)
-		  {
-		    // direct call
-		    arch_instr.is_branch = 1;
-		    arch_instr.branch_taken = 1;
-		    arch_instr.branch_type = BRANCH_DIRECT_CALL;
-		  }
-		else if(reads_sp && reads_ip && writes_sp && writes_ip && !reads_flags && reads_other)
-		  {
-		    // indirect call
-		    arch_instr.is_branch = 1;
-		    arch_instr.branch_taken = 1;
-		    arch_instr.branch_type = BRANCH_INDIRECT_CALL;
-		  }
-		else if(reads_sp && !reads_ip && writes_sp && writes_ip)
-		  {
-		    // return
-		    arch_instr.is_branch = 1;
-		    arch_instr.branch_taken = 1;
-		    arch_instr.branch_type = BRANCH_RETURN;
-		  }
-		else if(writes_ip)
-		  {
-		    // some other branch type that doesn't fit the above categories
-		    arch_instr.is_branch = 1;
-                    arch_instr.branch_taken = arch_instr.branch_taken; // don't change this
-                    arch_instr.branch_type = BRANCH_OTHER;
-		  }
+		decode_branch_type(&arch_instr);
 
 		total_branch_types[arch_instr.branch_type]++;
 		
@@ -395,6 +452,237 @@ void O3_CPU::read_from_trace()
     //instrs_to_fetch_this_cycle = num_reads;
 }
 
+void O3_CPU::functional_step()
+{
+    // functional warmup: read one instruction and walk its fetch, branch and memory
+    // accesses through the predictors and the cache hierarchy without any timing
+    size_t instr_size = knob_cloudsuite ? sizeof(cloudsuite_instr) : sizeof(input_instr);
+    ooo_model_instr arch_instr;
+
+    if (knob_cloudsuite) {
+        cloudsuite_instr trace_read_instr;
+        while (!trace_reader.read(&trace_read_instr, instr_size, 1)) {
+            cout << "*** Reached end of trace for Core: " << cpu << " Repeating trace: " << trace_string << endl; 
+
+            if (trace_reader.rewind()) {
+                cerr << endl << "*** CANNOT REOPEN TRACE FILE: " << trace_string << " ***" << endl;
+                assert(0);
+            }
+        }
+
+        // same one-record lag as below, the branch target is the next ip
+        if (cloudsuite_held == 0)
+            current_cloudsuite_instr = next_cloudsuite_instr = trace_read_instr;
+        else {
+            current_cloudsuite_instr = next_cloudsuite_instr;
+            next_cloudsuite_instr = trace_read_instr;
+        }
+        cloudsuite_held = 1;
+
+        arch_instr.ip = current_cloudsuite_instr.ip;
+        arch_instr.is_branch = current_cloudsuite_instr.is_branch;
+        arch_instr.branch_taken = current_cloudsuite_instr.branch_taken;
+        arch_instr.asid[0] = current_cloudsuite_instr.asid[0];
+        arch_instr.asid[1] = current_cloudsuite_instr.asid[1];
+        for (uint32_t i=0; i<MAX_INSTR_DESTINATIONS; i++) {
+            arch_instr.destination_registers[i] = current_cloudsuite_instr.destination_registers[i];
+            arch_instr.destination_virtual_address[i] = current_cloudsuite_instr.destination_memory[i];
+        }
+        for (uint32_t i=0; i<NUM_INSTR_SOURCES; i++) {
+            arch_instr.source_registers[i] = current_cloudsuite_instr.source_registers[i];
+            arch_instr.source_virtual_address[i] = current_cloudsuite_instr.source_memory[i];
+        }
+
+        decode_branch_type(&arch_instr);
+        total_branch_types[arch_instr.branch_type]++;
+
+        if ((arch_instr.is_branch == 1) && (arch_instr.branch_taken == 1))
+            arch_instr.branch_target = next_cloudsuite_instr.ip;
+    }
+    else {
+        input_instr trace_read_instr;
+        while (!trace_reader.read(&trace_read_instr, instr_size, 1)) {
+            cout << "*** Reached end of trace for Core: " << cpu << " Repeating trace: " << trace_string << endl; 
+
+            if (trace_reader.rewind()) {
+                cerr << endl << "*** CANNOT REOPEN TRACE FILE: " << trace_string << " ***" << endl;
+                assert(0);
+            }
+        }
+
+        // same one-record lag as read_from_trace(), the branch target is the next ip
+        if (instr_unique_id == 0)
+            current_instr = next_instr = trace_read_instr;
+        else {
+            current_instr = next_instr;
+            next_instr = trace_read_instr;
+        }
+
+        arch_instr.ip = current_instr.ip;
+        arch_instr.is_branch = current_instr.is_branch;
+        arch_instr.branch_taken = current_instr.branch_taken;
+        arch_instr.asid[0] = cpu;
+        arch_instr.asid[1] = cpu;
+        for (uint32_t i=0; i<MAX_INSTR_DESTINATIONS; i++) {
+            arch_instr.destination_registers[i] = current_instr.destination_registers[i];
+            arch_instr.destination_virtual_address[i] = current_instr.destination_memory[i];
+        }
+        for (uint32_t i=0; i<NUM_INSTR_SOURCES; i++) {
+            arch_instr.source_registers[i] = current_instr.source_registers[i];
+            arch_instr.source_virtual_address[i] = current_instr.source_memory[i];
+        }
+
+        decode_branch_type(&arch_instr);
+        total_branch_types[arch_instr.branch_type]++;
+
+        if ((arch_instr.is_branch == 1) && (arch_instr.branch_taken == 1))
+            arch_instr.branch_target = next_instr.ip;
+    }
+    arch_instr.instr_id = instr_unique_id;
+
+    // instruction fetch, once per cache line like the timed frontend
+    if ((arch_instr.ip >> LOG2_BLOCK_SIZE) != (last_functional_fetch >> LOG2_BLOCK_SIZE)) {
+        last_functional_fetch = arch_instr.ip;
+
+        PACKET trace_packet;
+        trace_packet.instruction = 1;
+        trace_packet.tlb_access = 1;
+        trace_packet.fill_level = FILL_L1;
+        trace_packet.fill_l1i = 1;
+        trace_packet.cpu = cpu;
+        trace_packet.address = arch_instr.ip >> LOG2_PAGE_SIZE;
+        trace_packet.full_addr = arch_instr.ip;
+        trace_packet.instr_id = arch_instr.instr_id;
+        trace_packet.ip = arch_instr.ip;
+        trace_packet.type = LOAD;
+        ITLB.functional_access(&trace_packet);
+
+        uint64_t instruction_pa = (trace_packet.data << LOG2_PAGE_SIZE) | (arch_instr.ip & ((1 << LOG2_PAGE_SIZE) - 1));
+
+        PACKET fetch_packet;
+        fetch_packet.instruction = 1;
+        fetch_packet.fill_level = FILL_L1;
+        fetch_packet.fill_l1i = 1;
+        fetch_packet.cpu = cpu;
+        fetch_packet.address = instruction_pa >> LOG2_BLOCK_SIZE;
+        fetch_packet.instruction_pa = instruction_pa;
+        fetch_packet.full_addr = instruction_pa;
+        fetch_packet.instr_id = arch_instr.instr_id;
+        fetch_packet.ip = arch_instr.ip;
+        fetch_packet.type = LOAD;
+        L1I.functional_access(&fetch_packet);
+    }
+
+    // branch predictor and code prefetcher training
+    if (arch_instr.is_branch) {
+        num_branch++;
+
+        uint8_t branch_prediction = predict_branch(arch_instr.ip);
+        uint64_t predicted_branch_target = branch_prediction ? arch_instr.branch_target : 0;
+        l1i_prefetcher_branch_operate(arch_instr.ip, arch_instr.branch_type, predicted_branch_target);
+
+        if (arch_instr.branch_taken != branch_prediction)
+            branch_mispredictions++;
+
+        last_branch_result(arch_instr.ip, arch_instr.branch_taken);
+    }
+
+    // loads first, then stores, in program order within the instruction
+    for (uint32_t i=0; i<NUM_INSTR_SOURCES; i++) {
+        if (arch_instr.source_virtual_address[i])
+            functional_data_access(&arch_instr, arch_instr.source_virtual_address[i], LOAD);
+    }
+    for (uint32_t i=0; i<MAX_INSTR_DESTINATIONS; i++) {
+        if (arch_instr.destination_virtual_address[i])
+            functional_data_access(&arch_instr, arch_instr.destination_virtual_address[i], RFO);
+    }
+
+    instr_unique_id++;
+    num_retired++;
+}
+
+void O3_CPU::functional_data_access(ooo_model_instr *arch_instr, uint64_t virtual_address, uint8_t type)
+{
+    PACKET tlb_packet;
+    tlb_packet.tlb_access = 1;
+    tlb_packet.fill_level = FILL_L1;
+    tlb_packet.fill_l1d = 1;
+    tlb_packet.cpu = cpu;
+    if (knob_cloudsuite)
+        tlb_packet.address = ((virtual_address >> LOG2_PAGE_SIZE) << 9) | arch_instr->asid[1];
+    else
+        tlb_packet.address = virtual_address >> LOG2_PAGE_SIZE;
+    tlb_packet.full_addr = virtual_address;
+    tlb_packet.instr_id = arch_instr->instr_id;
+    tlb_packet.ip = arch_instr->ip;
+    tlb_packet.type = type;
+    tlb_packet.asid[0] = arch_instr->asid[0];
+    tlb_packet.asid[1] = arch_instr->asid[1];
+    DTLB.functional_access(&tlb_packet);
+
+    uint64_t physical_address = (tlb_packet.data << LOG2_PAGE_SIZE) | (virtual_address & ((1 << LOG2_PAGE_SIZE) - 1));
+
+    PACKET data_packet;
+    data_packet.fill_level = FILL_L1;
+    data_packet.fill_l1d = 1;
+    data_packet.cpu = cpu;
+    data_packet.address = physical_address >> LOG2_BLOCK_SIZE;
+    data_packet.full_addr = physical_address;
+    data_packet.instr_id = arch_instr->instr_id;
+    data_packet.ip = arch_instr->ip;
+    data_packet.type = type;
+    data_packet.asid[0] = arch_instr->asid[0];
+    data_packet.asid[1] = arch_instr->asid[1];
+    L1D.functional_access(&data_packet);
+}
+
+void O3_CPU::checkpoint()
+{
+    string prefix = "cpu" + to_string(cpu) + ".";
+
+    // instructions still in flight are not saved, a restored core fetches again from the oldest one
+    uint64_t trace_position = 0;
+    if (checkpoint_restore == 0) {
+        uint64_t in_flight = instr_unique_id - num_retired;
+        if (trace_reader.records_read > in_flight)
+            trace_position = trace_reader.records_read - in_flight;
+    }
+
+    checkpoint_data(prefix + "cycle", &current_core_cycle[cpu], sizeof(current_core_cycle[cpu]));
+    checkpoint_data(prefix + "num_retired", &num_retired, sizeof(num_retired));
+    checkpoint_data(prefix + "trace_position", &trace_position, sizeof(trace_position));
+
+    if (checkpoint_restore) {
+        size_t instr_size = knob_cloudsuite ? sizeof(cloudsuite_instr) : sizeof(input_instr);
+
+        // read_from_trace() runs one record behind, so the record before the position goes to next_instr
+        uint8_t lag = ((knob_cloudsuite == 0) && num_retired) ? 1 : 0;
+        uint64_t seek_position = (trace_position > lag) ? (trace_position - lag) : 0;
+        if (trace_reader.seek(seek_position, instr_size)) {
+            cerr << "*** CANNOT SEEK TRACE FILE: " << trace_string << " TO THE CHECKPOINT ***" << endl;
+            assert(0);
+        }
+        if (lag && (trace_reader.read(&next_instr, instr_size, 1) == 0)) {
+            cerr << "*** CANNOT READ TRACE FILE: " << trace_string << " AT THE CHECKPOINT ***" << endl;
+            assert(0);
+        }
+
+        instr_unique_id = num_retired;
+        last_sim_cycle = current_core_cycle[cpu];
+        last_sim_instr = num_retired;
+    }
+
+    branch_predictor_checkpoint();
+    l1i_prefetcher_checkpoint();
+
+    ITLB.checkpoint();
+    DTLB.checkpoint();
+    STLB.checkpoint();
+    L1I.checkpoint();
+    L1D.checkpoint();
+    L2C.checkpoint();
+}
+
 uint32_t O3_CPU::add_to_rob(ooo_model_instr *arch_instr)
 {
     uint32_t index = ROB.tail;    
@@ -827,7 +1115,10 @@ int O3_CPU::prefetch_code_line(uint64_t pf_v_addr)
       pf_packet.type = PREFETCH;
       pf_packet.event_cycle = current_core_cycle[cpu];
 
-      L1I.add_pq(&pf_packet);    
+      if (functional_warmup)
+        L1I.functional_access(&pf_packet);
+      else
+        L1I.add_pq(&pf_packet);    
       L1I.pf_issued++;
     
       return 1;
@@ -2310,3 +2601,191 @@ void O3_CPU::retire_rob()
         num_retired++;
     }
 }
+
+// earliest cycle at which any pipeline stage or private cache of this core may change state,
+// mirrors the conditions checked by the per-cycle stages called from main()
+uint64_t O3_CPU::get_next_event_cycle()
+{
+    uint64_t next_cycle = UINT64_MAX, soon = current_core_cycle[cpu] + 1;
+
+    // nothing in the core (including the private caches) runs until the stall is over
+    if (stall_cycle[cpu] > soon)
+        return stall_cycle[cpu];
+
+    // read from trace
+    if ((IFETCH_BUFFER.occupancy < IFETCH_BUFFER.SIZE) && (fetch_stall == 0))
+        return 0;
+
+    // fetch
+    if ((fetch_stall == 1) && (fetch_resume_cycle != 0) && (fetch_resume_cycle < next_cycle))
+        next_cycle = fetch_resume_cycle;
+
+    uint32_t index = IFETCH_BUFFER.head;
+    for (uint32_t i=0; i<IFETCH_BUFFER.SIZE; i++) {
+        if (IFETCH_BUFFER.entry[index].ip == 0)
+            break;
+        if (IFETCH_BUFFER.entry[index].translated == 0)
+            return 0;
+        if ((IFETCH_BUFFER.entry[index].translated == COMPLETED) && (IFETCH_BUFFER.entry[index].fetched == 0))
+            return 0;
+
+        index++;
+        if (index >= IFETCH_BUFFER.SIZE)
+            index = 0;
+        if (index == IFETCH_BUFFER.head)
+            break;
+    }
+
+    if (IFETCH_BUFFER.entry[IFETCH_BUFFER.head].ip && (IFETCH_BUFFER.entry[IFETCH_BUFFER.head].translated == COMPLETED)
+        && (IFETCH_BUFFER.entry[IFETCH_BUFFER.head].fetched == COMPLETED) && (DECODE_BUFFER.occupancy < DECODE_BUFFER.SIZE))
+        return 0;
+
+    // decode
+    if (DECODE_BUFFER.occupancy > 0) {
+        ooo_model_instr *decode_head = &DECODE_BUFFER.entry[DECODE_BUFFER.head];
+        if (decode_head->ip && (ROB.occupancy < ROB.SIZE)) {
+            if (!warmup_complete[cpu])
+                return 0;
+            if ((decode_head->event_cycle != 0) && ((decode_head->event_cycle + 1) < next_cycle))
+                next_cycle = decode_head->event_cycle + 1;
+        }
+
+        // decode latency is assigned to the same window decode_and_dispatch() looks at
+        uint32_t decode_index = DECODE_BUFFER.head, count_decodes = 0;
+        for (uint32_t i=0; i<DECODE_BUFFER.SIZE; i++) {
+            if (decode_head->ip == 0)
+                break;
+            if (DECODE_BUFFER.entry[decode_index].event_cycle == 0)
+                return 0;
+            if (decode_index == DECODE_BUFFER.tail)
+                break;
+            decode_index++;
+            if (decode_index >= DECODE_BUFFER.SIZE)
+                decode_index = 0;
+            count_decodes++;
+            if (count_decodes > DECODE_WIDTH)
+                break;
+        }
+    }
+
+    // PROCESSED queues drained by update_rob()
+    PACKET_QUEUE *processed[4] = {&ITLB.PROCESSED, &L1I.PROCESSED, &DTLB.PROCESSED, &L1D.PROCESSED};
+    for (uint32_t i=0; i<4; i++) {
+        if (processed[i]->occupancy && (processed[i]->entry[processed[i]->head].event_cycle < next_cycle))
+            next_cycle = processed[i]->entry[processed[i]->head].event_cycle;
+    }
+
+    // private caches, l1i_prefetcher_cycle_operate() is assumed to be idle when nothing else is
+    CACHE *cache[6] = {&ITLB, &DTLB, &STLB, &L1I, &L1D, &L2C};
+    for (uint32_t i=0; i<6; i++) {
+        uint64_t cache_cycle = cache[i]->get_next_event_cycle();
+        if (cache_cycle < next_cycle)
+            next_cycle = cache_cycle;
+    }
+
+    if ((ROB.head == ROB.tail) && (ROB.occupancy == 0))
+        return next_cycle;
+
+    // retire
+    if ((ROB.entry[ROB.head].executed == COMPLETED) && (ROB.entry[ROB.head].event_cycle < next_cycle))
+        next_cycle = ROB.entry[ROB.head].event_cycle;
+
+    // execute
+    if ((RTE0[RTE0_head] < ROB_SIZE) && (ROB.entry[RTE0[RTE0_head]].event_cycle < next_cycle))
+        next_cycle = ROB.entry[RTE0[RTE0_head]].event_cycle;
+    if ((RTE1[RTE1_head] < ROB_SIZE) && (ROB.entry[RTE1[RTE1_head]].event_cycle < next_cycle))
+        next_cycle = ROB.entry[RTE1[RTE1_head]].event_cycle;
+
+    // load/store queue
+    if ((RTS0[RTS0_head] < SQ_SIZE) && (SQ.entry[RTS0[RTS0_head]].event_cycle < next_cycle))
+        next_cycle = SQ.entry[RTS0[RTS0_head]].event_cycle;
+    if ((RTS1[RTS1_head] < SQ_SIZE) && (SQ.entry[RTS1[RTS1_head]].event_cycle < next_cycle))
+        next_cycle = SQ.entry[RTS1[RTS1_head]].event_cycle;
+    if ((RTL0[RTL0_head] < LQ_SIZE) && (LQ.entry[RTL0[RTL0_head]].event_cycle < next_cycle))
+        next_cycle = LQ.entry[RTL0[RTL0_head]].event_cycle;
+    if ((RTL1[RTL1_head] < LQ_SIZE) && (LQ.entry[RTL1[RTL1_head]].event_cycle < next_cycle))
+        next_cycle = LQ.entry[RTL1[RTL1_head]].event_cycle;
+
+    // the ROB scans below are the expensive part, skip them if we already know the answer
+    if (next_cycle <= soon)
+        return next_cycle;
+
+    // schedule, an in-order scan from the head that stops at the first entry that is not ready yet
+    if (ROB.entry[ROB.next_schedule].scheduled == 0) {
+        uint32_t limit = ROB.next_fetch[1],
+                 count = (ROB.head < limit) ? (limit - ROB.head) : (ROB.SIZE - ROB.head + limit),
+                 searched = 0;
+        uint64_t ready_cycle = ROB.entry[ROB.next_schedule].event_cycle;
+        for (uint32_t n=0, i=ROB.head; n<count; n++, i=((i+1) == ROB.SIZE) ? 0 : (i+1)) {
+            if ((ROB.entry[i].fetched != COMPLETED) || (searched >= SCHEDULER_SIZE) || (ready_cycle >= next_cycle))
+                break;
+            if (ROB.entry[i].event_cycle > ready_cycle)
+                ready_cycle = ROB.entry[i].event_cycle;
+            if (ROB.entry[i].scheduled == 0) {
+                if (ready_cycle < next_cycle)
+                    next_cycle = ready_cycle;
+                break;
+            }
+            searched++;
+        }
+        if (next_cycle <= soon)
+            return next_cycle;
+    }
+
+    // memory scheduling, only entries that can actually make progress in the LSQ count
+    uint32_t limit = ROB.next_schedule,
+             count = (ROB.head < limit) ? (limit - ROB.head) : (ROB.SIZE - ROB.head + limit);
+    uint64_t ready_cycle = 0;
+    for (uint32_t n=0, i=ROB.head; n<count; n++, i=((i+1) == ROB.SIZE) ? 0 : (i+1)) {
+        ooo_model_instr *rob_entry = &ROB.entry[i];
+
+        if (rob_entry->is_memory == 0)
+            continue;
+        if ((rob_entry->fetched != COMPLETED) || (ready_cycle >= next_cycle))
+            break;
+        if (rob_entry->event_cycle > ready_cycle)
+            ready_cycle = rob_entry->event_cycle;
+        if ((rob_entry->reg_ready == 0) || (rob_entry->scheduled != INFLIGHT))
+            continue;
+
+        uint32_t num_mem_ops = 0, num_added = 0, num_addable = 0;
+        for (uint32_t j=0; j<NUM_INSTR_SOURCES; j++) {
+            if (rob_entry->source_memory[j]) {
+                num_mem_ops++;
+                if (rob_entry->source_added[j])
+                    num_added++;
+                else if (LQ.occupancy < LQ.SIZE)
+                    num_addable++;
+            }
+        }
+        for (uint32_t j=0; j<MAX_INSTR_DESTINATIONS; j++) {
+            if (rob_entry->destination_memory[j]) {
+                num_mem_ops++;
+                if (rob_entry->destination_added[j])
+                    num_added++;
+                else if ((SQ.occupancy < SQ.SIZE) && (STA[STA_head] == rob_entry->instr_id))
+                    num_addable++;
+            }
+        }
+
+        if (num_addable || (num_added == num_mem_ops)) {
+            if (ready_cycle < next_cycle)
+                next_cycle = ready_cycle;
+            break;
+        }
+    }
+    if (next_cycle <= soon)
+        return next_cycle;
+
+    // complete
+    for (uint32_t n=0, i=ROB.head; n<ROB.occupancy; n++, i=((i+1) == ROB.SIZE) ? 0 : (i+1)) {
+        if ((ROB.entry[i].executed == INFLIGHT) && ((ROB.entry[i].is_memory == 0) || (ROB.entry[i].num_mem_ops == 0))
+            && (ROB.entry[i].event_cycle < next_cycle)) {
+            next_cycle = ROB.entry[i].event_cycle;
+            if (next_cycle <= soon)
+                break;
+        }
+    }
+
+    return next_cycle;
+}
@@ -0,0 +1,15 @@
+#include "page_table.h"
+
+uint64_t find_victim_frame()
+{
+    // a referenced page gets a second chance, so this takes at most one lap
+    while (page_frames[clock_hand].referenced) {
+        page_frames[clock_hand].referenced = 0;
+        clock_hand = (clock_hand + 1) % page_frames.size();
+    }
+
+    uint64_t victim = clock_hand;
+    clock_hand = (clock_hand + 1) % page_frames.size();
+
+    return victim;
+}
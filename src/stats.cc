@@ -0,0 +1,459 @@
+#include "stats.h"
+#include "ooo_cpu.h"
+#include "uncore.h"
+
+#include <fstream>
+#include <sstream>
+
+uint64_t stats_interval = 1000000;
+uint8_t stats_instructions = 0;
+
+static ofstream stats_file;
+static uint64_t next_sample = 0;
+static uint8_t header_written = 0,
+               in_warmup = 1;
+
+// one entry per CSV column after cycle, instructions and warmup, in the order collect_stats() adds them
+static vector <string> column_name;
+static vector <uint8_t> column_gauge;
+static vector <uint64_t> column_last, column_value;
+
+static void add_column(string name, uint64_t value, uint8_t gauge)
+{
+    if (column_value.size() == column_name.size()) {
+        column_name.push_back(name);
+        column_gauge.push_back(gauge);
+        column_last.push_back(0);
+    }
+    column_value.push_back(value);
+}
+
+static void collect_cache(string prefix, CACHE *cache)
+{
+    uint64_t access = 0, hit = 0, miss = 0;
+    for (uint32_t i=0; i<NUM_CPUS; i++) {
+        for (uint32_t j=0; j<NUM_TYPES; j++) {
+            access += cache->sim_access[i][j];
+            hit += cache->sim_hit[i][j];
+            miss += cache->sim_miss[i][j];
+        }
+    }
+
+    add_column(prefix + cache->NAME + ".access", access, 0);
+    add_column(prefix + cache->NAME + ".hit", hit, 0);
+    add_column(prefix + cache->NAME + ".miss", miss, 0);
+    add_column(prefix + cache->NAME + ".miss_latency", cache->total_miss_latency, 0);
+    add_column(prefix + cache->NAME + ".pf_issued", cache->pf_issued, 0);
+    add_column(prefix + cache->NAME + ".pf_useful", cache->pf_useful, 0);
+}
+
+static void collect_stats()
+{
+    column_value.clear();
+
+    for (uint32_t i=0; i<NUM_CPUS; i++) {
+        string prefix = "cpu" + to_string(i) + ".";
+
+        add_column(prefix + "cycles", current_core_cycle[i], 0);
+        add_column(prefix + "instructions", ooo_cpu[i].num_retired, 0);
+        add_column(prefix + "branches", ooo_cpu[i].num_branch, 0);
+        add_column(prefix + "mispredictions", ooo_cpu[i].branch_mispredictions, 0);
+
+        collect_cache(prefix, &ooo_cpu[i].ITLB);
+        collect_cache(prefix, &ooo_cpu[i].DTLB);
+        collect_cache(prefix, &ooo_cpu[i].STLB);
+        collect_cache(prefix, &ooo_cpu[i].L1I);
+        collect_cache(prefix, &ooo_cpu[i].L1D);
+        collect_cache(prefix, &ooo_cpu[i].L2C);
+    }
+    collect_cache("", &uncore.LLC);
+
+    for (uint32_t i=0; i<DRAM_CHANNELS; i++) {
+        string prefix = "dram" + to_string(i) + ".";
+
+        add_column(prefix + "rq_row_hit", uncore.DRAM.RQ[i].ROW_BUFFER_HIT, 0);
+        add_column(prefix + "rq_row_miss", uncore.DRAM.RQ[i].ROW_BUFFER_MISS, 0);
+        add_column(prefix + "wq_row_hit", uncore.DRAM.WQ[i].ROW_BUFFER_HIT, 0);
+        add_column(prefix + "wq_row_miss", uncore.DRAM.WQ[i].ROW_BUFFER_MISS, 0);
+        add_column(prefix + "wq_full", uncore.DRAM.WQ[i].FULL, 0);
+    }
+    add_column("dram.dbus_congested", uncore.DRAM.dbus_congested[NUM_TYPES][NUM_TYPES], 0);
+
+    if (uncore.NOC.topology != NOC_NONE) {
+        uint64_t stall = 0;
+        for (uint32_t i=0; i<uncore.NOC.link.size(); i++)
+            stall += uncore.NOC.link[i].stall;
+
+        add_column("noc.request_packets", uncore.NOC.packets[NOC_REQUEST], 0);
+        add_column("noc.request_latency", uncore.NOC.total_latency[NOC_REQUEST], 0);
+        add_column("noc.response_packets", uncore.NOC.packets[NOC_RESPONSE], 0);
+        add_column("noc.response_latency", uncore.NOC.total_latency[NOC_RESPONSE], 0);
+        add_column("noc.link_stall", stall, 0);
+    }
+
+    // zmz modify
+    // the ways of every core, its share of the LLC for L3
+    if (Mosaic_Cache_Monitor.get_work_mode() != 0) {
+        for (uint32_t i=0; i<NUM_CPUS; i++) {
+            for (int level=LPM_L1; level<=LPM_L3; level++) {
+                int ways = Mosaic_Cache_Monitor.get_current_way_end_pos(i, level) - Mosaic_Cache_Monitor.get_current_way_start_pos(i, level);
+                add_column("cpu" + to_string(i) + ".mosaic.l" + to_string(level+1) + "_ways", ways, 1);
+            }
+        }
+    }
+}
+
+static uint64_t total_instructions()
+{
+    uint64_t instructions = 0;
+    for (uint32_t i=0; i<NUM_CPUS; i++)
+        instructions += ooo_cpu[i].num_retired;
+
+    return instructions;
+}
+
+void open_stats(const char *name)
+{
+    if (stats_interval == 0) {
+        cerr << "[STATS] -stats_interval must not be 0" << endl;
+        assert(0);
+    }
+
+    stats_file.open(name);
+    if (!stats_file.good()) {
+        cerr << "[STATS] cannot create " << name << endl;
+        assert(0);
+    }
+
+    next_sample = stats_interval;
+}
+
+void sample_stats(uint8_t force)
+{
+    if (!stats_file.is_open())
+        return;
+
+    uint64_t now = stats_instructions ? total_instructions() : current_core_cycle[0];
+    if ((force == 0) && (now < next_sample))
+        return;
+    while (next_sample <= now)
+        next_sample += stats_interval;
+
+    collect_stats();
+
+    if (header_written == 0) {
+        header_written = 1;
+        stats_file << "cycle,instructions,warmup";
+        for (uint32_t i=0; i<column_name.size(); i++)
+            stats_file << "," << column_name[i];
+        stats_file << "\n";
+    }
+
+    stats_file << current_core_cycle[0] << "," << total_instructions() << "," << +in_warmup;
+    for (uint32_t i=0; i<column_value.size(); i++) {
+        uint64_t value = column_value[i];
+        if (column_gauge[i] == 0)
+            value -= (value >= column_last[i]) ? column_last[i] : 0;
+        stats_file << "," << value;
+
+        column_last[i] = column_value[i];
+    }
+    stats_file << "\n";
+}
+
+// warmup zeroes most counters, the next row counts from there
+void rebase_stats()
+{
+    if (!stats_file.is_open())
+        return;
+
+    collect_stats();
+    column_last = column_value;
+    in_warmup = 0;
+}
+
+void close_stats()
+{
+    if (!stats_file.is_open())
+        return;
+
+    sample_stats(1);
+    stats_file.close();
+}
+
+// -json_stats: everything the end-of-run text report has, as one JSON document
+static string json_string(string value)
+{
+    string out = "\"";
+    for (uint32_t i=0; i<value.size(); i++) {
+        char c = value[i];
+        if ((c == '"') || (c == '\\'))
+            out += string("\\") + c;
+        else if ((unsigned char) c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else
+            out += c;
+    }
+
+    return out + "\"";
+}
+
+static string json_number(uint64_t value)
+{
+    return to_string(value);
+}
+
+// null instead of the nan/inf the text report prints
+static string json_ratio(double numerator, double denominator)
+{
+    if (denominator == 0)
+        return "null";
+
+    ostringstream out;
+    out << numerator / denominator;
+    return out.str();
+}
+
+static string json_field(string key, string value)
+{
+    return json_string(key) + ": " + value;
+}
+
+static string json_join(vector<string> items, string open, string close)
+{
+    string out = open;
+    for (uint32_t i=0; i<items.size(); i++)
+        out += (i ? ", " : "") + items[i];
+
+    return out + close;
+}
+
+static string json_object(vector<string> fields)
+{
+    return json_join(fields, "{", "}");
+}
+
+static string json_array(vector<string> items)
+{
+    return json_join(items, "[", "]");
+}
+
+static const char *type_name[NUM_TYPES] = {"LOAD", "RFO", "PREFETCH", "WRITEBACK"};
+
+static string json_latency(LATENCY_HISTOGRAM *latency)
+{
+    vector<string> types;
+    for (uint32_t i=0; i<NUM_TYPES; i++) {
+        types.push_back(json_field(type_name[i], json_object({
+            json_field("count", json_number(latency[i].count)),
+            json_field("p50", json_number(latency[i].percentile(0.5))),
+            json_field("p90", json_number(latency[i].percentile(0.9))),
+            json_field("p99", json_number(latency[i].percentile(0.99))),
+            json_field("p999", json_number(latency[i].percentile(0.999)))})));
+    }
+
+    return json_object(types);
+}
+
+static string json_cache_config(CACHE *cache)
+{
+    const char *inclusion_name[3] = {"nine", "inclusive", "exclusive"};
+
+    return json_field(cache->NAME, json_object({
+        json_field("sets", json_number(cache->NUM_SET)),
+        json_field("ways", json_number(cache->num_allocated_way)),
+        json_field("rq_size", json_number(cache->RQ_SIZE)),
+        json_field("wq_size", json_number(cache->WQ_SIZE)),
+        json_field("pq_size", json_number(cache->PQ_SIZE)),
+        json_field("mshr_size", json_number(cache->MSHR_SIZE)),
+        json_field("latency", json_number(cache->LATENCY)),
+        json_field("inclusion", json_string(inclusion_name[cache->inclusion])),
+        json_field("slices", json_number(cache->num_slices))}));
+}
+
+static string json_config()
+{
+    vector<string> traces;
+    for (uint32_t i=0; i<NUM_CPUS; i++)
+        traces.push_back(json_string(ooo_cpu[i].trace_string));
+
+    return json_object({
+        json_field("num_cpus", json_number(NUM_CPUS)),
+        json_field("warmup_instructions", json_number(ooo_cpu[0].warmup_instructions)),
+        json_field("simulation_instructions", json_number(ooo_cpu[0].simulation_instructions)),
+        json_field("traces", json_array(traces)),
+        json_field("caches", json_object({
+            json_cache_config(&ooo_cpu[0].ITLB),
+            json_cache_config(&ooo_cpu[0].DTLB),
+            json_cache_config(&ooo_cpu[0].STLB),
+            json_cache_config(&ooo_cpu[0].L1I),
+            json_cache_config(&ooo_cpu[0].L1D),
+            json_cache_config(&ooo_cpu[0].L2C),
+            json_cache_config(&uncore.LLC)})),
+        json_field("core", json_object({
+            json_field("fetch_width", json_number(FETCH_WIDTH)),
+            json_field("decode_width", json_number(DECODE_WIDTH)),
+            json_field("exec_width", json_number(EXEC_WIDTH)),
+            json_field("lq_width", json_number(LQ_WIDTH)),
+            json_field("sq_width", json_number(SQ_WIDTH)),
+            json_field("retire_width", json_number(RETIRE_WIDTH)),
+            json_field("scheduler_size", json_number(SCHEDULER_SIZE)),
+            json_field("branch_mispredict_penalty", json_number(BRANCH_MISPREDICT_PENALTY)),
+            json_field("rob_size", json_number(ROB_SIZE)),
+            json_field("lq_size", json_number(LQ_SIZE)),
+            json_field("sq_size", json_number(SQ_SIZE))})),
+        json_field("dram", json_object({
+            json_field("channels", json_number(DRAM_CHANNELS)),
+            json_field("ranks", json_number(DRAM_RANKS)),
+            json_field("banks", json_number(DRAM_BANKS)),
+            json_field("rq_size", json_number(DRAM_RQ_SIZE)),
+            json_field("wq_size", json_number(DRAM_WQ_SIZE)),
+            json_field("data_rate", json_number(DRAM_DATA_RATE)),
+            json_field("tRP_ns", json_ratio(tRP_DRAM_NANOSECONDS, 1)),
+            json_field("tRCD_ns", json_ratio(tRCD_DRAM_NANOSECONDS, 1)),
+            json_field("tCAS_ns", json_ratio(tCAS_DRAM_NANOSECONDS, 1))})),
+        json_field("mosaic_work_mode", json_number(Mosaic_Cache_Monitor.get_work_mode()))});
+}
+
+// the region of interest counters of one core, as print_roi_stats() reports them
+static string json_cache(uint32_t cpu, CACHE *cache)
+{
+    uint64_t total_access = 0, total_hit = 0, total_miss = 0;
+    vector<string> types;
+    for (uint32_t i=0; i<NUM_TYPES; i++) {
+        total_access += cache->roi_access[cpu][i];
+        total_hit += cache->roi_hit[cpu][i];
+        total_miss += cache->roi_miss[cpu][i];
+
+        types.push_back(json_field(type_name[i], json_object({
+            json_field("access", json_number(cache->roi_access[cpu][i])),
+            json_field("hit", json_number(cache->roi_hit[cpu][i])),
+            json_field("miss", json_number(cache->roi_miss[cpu][i]))})));
+    }
+    types.push_back(json_field("TOTAL", json_object({
+        json_field("access", json_number(total_access)),
+        json_field("hit", json_number(total_hit)),
+        json_field("miss", json_number(total_miss))})));
+
+    return json_field(cache->NAME, json_object({
+        json_field("types", json_object(types)),
+        json_field("prefetch", json_object({
+            json_field("requested", json_number(cache->pf_requested)),
+            json_field("issued", json_number(cache->pf_issued)),
+            json_field("useful", json_number(cache->pf_useful)),
+            json_field("useless", json_number(cache->pf_useless)),
+            json_field("fill", json_number(cache->pf_fill))})),
+        json_field("back_invalidated", json_number(cache->back_invalidated)),
+        json_field("average_miss_latency", json_ratio(cache->total_miss_latency, total_miss)),
+        json_field("latency", json_latency(cache->roi_latency[cpu]))}));
+}
+
+static string json_core(uint32_t cpu)
+{
+    O3_CPU *core = &ooo_cpu[cpu];
+
+    const char *branch_type_name[8] = {"NOT_BRANCH", "BRANCH_DIRECT_JUMP", "BRANCH_INDIRECT", "BRANCH_CONDITIONAL",
+                                       "BRANCH_DIRECT_CALL", "BRANCH_INDIRECT_CALL", "BRANCH_RETURN", "BRANCH_OTHER"};
+    vector<string> branch_types;
+    for (uint32_t i=0; i<8; i++)
+        branch_types.push_back(json_field(branch_type_name[i], json_number(core->total_branch_types[i])));
+
+    return json_object({
+        json_field("cpu", json_number(cpu)),
+        json_field("instructions", json_number(core->finish_sim_instr)),
+        json_field("cycles", json_number(core->finish_sim_cycle)),
+        json_field("ipc", json_ratio(core->finish_sim_instr, core->finish_sim_cycle)),
+        json_field("major_faults", json_number(major_fault[cpu])),
+        json_field("minor_faults", json_number(minor_fault[cpu])),
+        json_field("branch", json_object({
+            json_field("branches", json_number(core->num_branch)),
+            json_field("mispredictions", json_number(core->branch_mispredictions)),
+            json_field("accuracy", json_ratio(100.0*(core->num_branch - core->branch_mispredictions), core->num_branch)),
+            json_field("mpki", json_ratio(1000.0*core->branch_mispredictions, core->num_retired - core->warmup_instructions)),
+            json_field("rob_occupancy_at_mispredict", json_ratio(core->total_rob_occupancy_at_branch_mispredict, core->branch_mispredictions)),
+            json_field("types", json_object(branch_types))})),
+        json_field("caches", json_object({
+            json_cache(cpu, &core->L1D),
+            json_cache(cpu, &core->L1I),
+            json_cache(cpu, &core->L2C),
+            json_cache(cpu, &uncore.LLC)})),
+        json_field("dram_latency", json_latency(uncore.DRAM.roi_latency[cpu]))});
+}
+
+static string json_dram()
+{
+    vector<string> channels;
+    uint64_t total_congested_cycle = 0;
+    for (uint32_t i=0; i<DRAM_CHANNELS; i++) {
+        total_congested_cycle += uncore.DRAM.dbus_cycle_congested[i];
+
+        channels.push_back(json_object({
+            json_field("rq_row_buffer_hit", json_number(uncore.DRAM.RQ[i].ROW_BUFFER_HIT)),
+            json_field("rq_row_buffer_miss", json_number(uncore.DRAM.RQ[i].ROW_BUFFER_MISS)),
+            json_field("wq_row_buffer_hit", json_number(uncore.DRAM.WQ[i].ROW_BUFFER_HIT)),
+            json_field("wq_row_buffer_miss", json_number(uncore.DRAM.WQ[i].ROW_BUFFER_MISS)),
+            json_field("wq_full", json_number(uncore.DRAM.WQ[i].FULL))}));
+    }
+
+    uint64_t congested = uncore.DRAM.dbus_congested[NUM_TYPES][NUM_TYPES];
+    return json_object({
+        json_field("channels", json_array(channels)),
+        json_field("dbus_congested", json_number(congested)),
+        json_field("avg_congested_cycle", congested ? json_number(total_congested_cycle / congested) : "null")});
+}
+
+static string json_noc()
+{
+    const char *topology_name[3] = {"none", "ring", "mesh"};
+    const char *class_name[NOC_CLASSES] = {"request", "response"};
+    INTERCONNECT *noc = &uncore.NOC;
+
+    uint64_t busiest = 0, stall = 0;
+    for (uint32_t i=0; i<noc->link.size(); i++) {
+        if (noc->link[i].flits > busiest)
+            busiest = noc->link[i].flits;
+        stall += noc->link[i].stall;
+    }
+
+    vector<string> fields = {
+        json_field("topology", json_string(topology_name[noc->topology])),
+        json_field("nodes", json_number(noc->num_nodes)),
+        json_field("hop_latency", json_number(noc->hop_latency)),
+        json_field("link_width", json_number(noc->link_width)),
+        json_field("link_queue", json_number(noc->link_queue))};
+    for (uint32_t i=0; i<NOC_CLASSES; i++) {
+        fields.push_back(json_field(class_name[i], json_object({
+            json_field("packets", json_number(noc->packets[i])),
+            json_field("flits", json_number(noc->flits[i])),
+            json_field("average_hops", json_ratio(noc->hops[i], noc->packets[i])),
+            json_field("average_latency", json_ratio(noc->total_latency[i], noc->packets[i]))})));
+    }
+    fields.push_back(json_field("max_link_flits", json_number(busiest)));
+    fields.push_back(json_field("link_stall", json_number(stall)));
+
+    return json_object(fields);
+}
+
+void write_json_stats(const char *name)
+{
+    ofstream file(name);
+    if (!file.good()) {
+        cerr << "[STATS] cannot create " << name << endl;
+        assert(0);
+    }
+
+    vector<string> cores;
+    for (uint32_t i=0; i<NUM_CPUS; i++)
+        cores.push_back(json_core(i));
+
+    file << "{" << endl;
+    file << "  " << json_field("config", json_config()) << "," << endl;
+    file << "  " << json_field("cores", json_array(cores)) << "," << endl;
+    file << "  " << json_field("dram", json_dram()) << "," << endl;
+    file << "  " << json_field("noc", json_noc()) << "," << endl;
+    file << "  " << json_field("mosaic", Mosaic_Cache_Monitor.json_statistics()) << endl;
+    file << "}" << endl;
+}
@@ -0,0 +1,505 @@
+#include "trace_reader.h"
+
+int TRACE_READER::open(const char *name)
+{
+    close();
+
+    snprintf(file_name, sizeof(file_name), "%s", name);
+    file = fopen(file_name, "rb");
+    if (file == NULL)
+        return -1;
+
+    format = detect_format();
+    if (format == TRACE_FORMAT_NONE) {
+        close();
+        return -2;
+    }
+
+    read_buffer = out_buffer;
+    out_head = 0;
+    out_tail = 0;
+    records_read = 0;
+
+    if (format == TRACE_FORMAT_BIN)
+        return map_file();
+
+    return init_stream();
+}
+
+int TRACE_READER::rewind()
+{
+    if (file == NULL)
+        return -1;
+
+    records_read = 0;
+
+    // the producer has already started over after the end of trace marker
+    if (prefetch)
+        return 0;
+
+    // the whole trace is mapped, just start over at the first record
+    if (format == TRACE_FORMAT_BIN) {
+        out_head = 0;
+        return 0;
+    }
+
+    out_head = 0;
+    out_tail = 0;
+
+    return restart_stream();
+}
+
+void TRACE_READER::close()
+{
+    if (file == NULL)
+        return;
+
+    stop_prefetch();
+    end_stream();
+    if (map_base) {
+        munmap(map_base, map_size);
+        map_base = NULL;
+        map_size = 0;
+    }
+    fclose(file);
+    file = NULL;
+}
+
+void TRACE_READER::start_prefetch()
+{
+    // nothing to decode ahead for a mapped trace
+    if ((file == NULL) || prefetch || (format == TRACE_FORMAT_BIN))
+        return;
+
+    for (uint32_t i=0; i<TRACE_PREFETCH_BLOCKS; i++) {
+        if (block_data[i] == NULL)
+            block_data[i] = new uint8_t[TRACE_OUTPUT_SIZE];
+        block_size[i] = 0;
+    }
+
+    holding_block = 0;
+    block_head = 0;
+    block_tail = 0;
+    stop_producer = false;
+
+    // bytes already decoded (e.g. after a seek) go out first
+    if (out_tail > out_head) {
+        memcpy(block_data[0], out_buffer + out_head, out_tail - out_head);
+        block_size[0] = out_tail - out_head;
+        block_tail = 1;
+    }
+    out_head = 0;
+    out_tail = 0;
+
+    prefetch = 1;
+    producer = thread(&TRACE_READER::produce, this);
+}
+
+void TRACE_READER::stop_prefetch()
+{
+    if (prefetch == 0)
+        return;
+
+    stop_producer = true;
+    producer.join();
+
+    prefetch = 0;
+    read_buffer = out_buffer;
+    out_head = 0;
+    out_tail = 0;
+}
+
+size_t TRACE_READER::read(void *buffer, size_t record_size, size_t count)
+{
+    uint8_t *dst = (uint8_t *)buffer;
+    size_t wanted = count*record_size, copied = 0;
+
+    // records may straddle two blocks, so copy bytes and count whole records at the end
+    while (copied < wanted) {
+        if (out_head == out_tail) {
+            if (next_block())
+                break;
+            continue;
+        }
+
+        size_t available = out_tail - out_head;
+        if (available > (wanted - copied))
+            available = wanted - copied;
+
+        memcpy(dst + copied, read_buffer + out_head, available);
+        out_head += available;
+        copied += available;
+    }
+
+    // a partial record left at the very end of the trace is dropped, same as fread()
+    records_read += copied / record_size;
+    return copied / record_size;
+}
+
+int TRACE_READER::seek(uint64_t instr, size_t record_size)
+{
+    if ((file == NULL) || prefetch)
+        return -1;
+
+    if (format == TRACE_FORMAT_BIN) {
+        if (instr >= bin_header.instr_count)
+            return -1;
+        out_head = instr * record_size;
+        records_read = instr;
+        return 0;
+    }
+
+    // start decoding at the closest block boundary before instr
+    uint64_t block_start = 0, block_offset = 0;
+    if (find_block(instr, record_size, &block_start, &block_offset))
+        block_start = block_offset = 0;
+
+    end_stream();
+    fseek(file, block_offset, SEEK_SET);
+    if (init_stream())
+        return -1;
+    out_head = 0;
+    out_tail = 0;
+
+    // drop the records in front of instr within that block
+    uint64_t remain = instr - block_start;
+    uint8_t *scratch = new uint8_t[TRACE_OUTPUT_SIZE];
+    size_t batch = TRACE_OUTPUT_SIZE / record_size;
+    while (remain) {
+        size_t count = (remain < batch) ? remain : batch;
+        size_t num_read = read(scratch, record_size, count);
+        if (num_read == 0)
+            break;
+        remain -= num_read;
+    }
+    delete[] scratch;
+    records_read = instr;
+
+    return remain ? -1 : 0;
+}
+
+// looks up the block that holds instr in <trace>.idx, returns -1 if there is no usable index
+int TRACE_READER::find_block(uint64_t instr, size_t record_size, uint64_t *block_start, uint64_t *block_offset)
+{
+    char index_name[1024+4];
+    snprintf(index_name, sizeof(index_name), "%s.idx", file_name);
+
+    FILE *index_file = fopen(index_name, "rb");
+    if (index_file == NULL)
+        return -1;
+
+    trace_index_header header;
+    if ((fread(&header, sizeof(header), 1, index_file) != 1) || memcmp(header.magic, TRACE_INDEX_MAGIC, 8)
+        || (header.version != TRACE_INDEX_VERSION) || (header.record_size != record_size) || (header.records_per_block == 0)) {
+        cerr << "[TRACE_READER] " << __func__ << " ignoring " << index_name << ", it does not match this trace" << endl;
+        fclose(index_file);
+        return -1;
+    }
+
+    uint64_t block = instr / header.records_per_block;
+    if (block >= header.num_blocks)
+        block = header.num_blocks - 1;
+
+    int ret = -1;
+    if (header.num_blocks && (fseek(index_file, sizeof(header) + block*sizeof(uint64_t), SEEK_SET) == 0)
+        && (fread(block_offset, sizeof(uint64_t), 1, index_file) == 1)) {
+        *block_start = block * header.records_per_block;
+        ret = 0;
+    }
+    fclose(index_file);
+
+    return ret;
+}
+
+// makes the next chunk of decoded bytes readable, returns -1 at the end of the trace
+int TRACE_READER::next_block()
+{
+    // a mapped trace is one big block, rewind() starts it over
+    if (format == TRACE_FORMAT_BIN)
+        return -1;
+
+    out_head = 0;
+
+    if (prefetch == 0) {
+        out_tail = decode(out_buffer, TRACE_OUTPUT_SIZE);
+        return out_tail ? 0 : -1;
+    }
+
+    // hand the block we are done with back to the producer
+    uint32_t head = block_head.load(memory_order_relaxed);
+    if (holding_block) {
+        head++;
+        block_head.store(head, memory_order_release);
+        holding_block = 0;
+    }
+
+    // the producer is behind, decoding is the bottleneck right now
+    while (block_tail.load(memory_order_acquire) == head)
+        this_thread::yield();
+
+    uint32_t index = head % TRACE_PREFETCH_BLOCKS;
+    read_buffer = block_data[index];
+    out_tail = block_size[index];
+    holding_block = 1;
+
+    return out_tail ? 0 : -1;
+}
+
+void TRACE_READER::produce()
+{
+    uint32_t tail = block_tail.load(memory_order_relaxed);
+
+    while (stop_producer.load(memory_order_acquire) == false) {
+        // all blocks are full or held by the reader
+        if ((tail - block_head.load(memory_order_acquire)) == TRACE_PREFETCH_BLOCKS) {
+            this_thread::sleep_for(chrono::microseconds(100));
+            continue;
+        }
+
+        uint32_t index = tail % TRACE_PREFETCH_BLOCKS;
+        block_size[index] = decode(block_data[index], TRACE_OUTPUT_SIZE);
+
+        // end of trace marker, keep decoding from the beginning for the repeat
+        if ((block_size[index] == 0) && restart_stream()) {
+            cerr << "[TRACE_READER] " << __func__ << " cannot rewind " << file_name << endl;
+            assert(0);
+        }
+
+        tail++;
+        block_tail.store(tail, memory_order_release);
+    }
+}
+
+uint8_t TRACE_READER::detect_format()
+{
+    // look at the magic number instead of trusting the file extension
+    uint8_t magic[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    size_t magic_size = fread(magic, 1, sizeof(magic), file);
+    fseek(file, 0, SEEK_SET);
+
+    if ((magic_size >= 2) && (magic[0] == 0x1f) && (magic[1] == 0x8b))
+        return TRACE_FORMAT_GZIP;
+
+    if ((magic_size >= 6) && (magic[0] == 0xfd) && (magic[1] == '7') && (magic[2] == 'z') && (magic[3] == 'X') && (magic[4] == 'Z') && (magic[5] == 0x00))
+        return TRACE_FORMAT_XZ;
+
+    if ((magic_size >= 8) && (memcmp(magic, TRACE_BIN_MAGIC, 8) == 0))
+        return TRACE_FORMAT_BIN;
+
+#ifdef ZSTD_TRACE
+    if ((magic_size >= 4) && (magic[0] == 0x28) && (magic[1] == 0xb5) && (magic[2] == 0x2f) && (magic[3] == 0xfd))
+        return TRACE_FORMAT_ZSTD;
+#endif
+
+    return TRACE_FORMAT_NONE;
+}
+
+int TRACE_READER::map_file()
+{
+    if (fread(&bin_header, sizeof(bin_header), 1, file) != 1)
+        return -1;
+
+    if ((bin_header.version != TRACE_BIN_VERSION) || (bin_header.record_size == 0)) {
+        cerr << "[TRACE_READER] " << __func__ << " unsupported header in " << file_name;
+        cerr << " version: " << bin_header.version << " record_size: " << bin_header.record_size << endl;
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(fileno(file), &file_stat))
+        return -1;
+
+    uint64_t record_bytes = bin_header.instr_count * bin_header.record_size;
+    if ((uint64_t)file_stat.st_size < (sizeof(bin_header) + record_bytes)) {
+        cerr << "[TRACE_READER] " << __func__ << " " << file_name << " is truncated, expected " << bin_header.instr_count << " records" << endl;
+        return -1;
+    }
+
+    map_size = file_stat.st_size;
+    void *addr = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (addr == MAP_FAILED) {
+        map_size = 0;
+        return -1;
+    }
+    map_base = (uint8_t *)addr;
+    madvise(map_base, map_size, MADV_SEQUENTIAL);
+
+    // records are handed out straight from the mapping
+    read_buffer = map_base + sizeof(bin_header);
+    out_head = 0;
+    out_tail = record_bytes;
+
+    return 0;
+}
+
+int TRACE_READER::restart_stream()
+{
+    end_stream();
+    fseek(file, 0, SEEK_SET);
+
+    return init_stream();
+}
+
+int TRACE_READER::init_stream()
+{
+    end_of_stream = 0;
+    end_of_input = 0;
+    gzip_members = 0;
+
+    switch (format) {
+        case TRACE_FORMAT_GZIP:
+            memset(&gzip_stream, 0, sizeof(gzip_stream));
+            // 16 + MAX_WBITS: expect a gzip header and trailer
+            if (inflateInit2(&gzip_stream, 16 + MAX_WBITS) != Z_OK)
+                return -1;
+            break;
+
+        case TRACE_FORMAT_XZ:
+            memset(&xz_stream, 0, sizeof(xz_stream));
+            if (lzma_stream_decoder(&xz_stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+                return -1;
+            break;
+
+#ifdef ZSTD_TRACE
+        case TRACE_FORMAT_ZSTD:
+            if (zstd_stream == NULL)
+                zstd_stream = ZSTD_createDStream();
+            ZSTD_initDStream(zstd_stream);
+            zstd_in.src = in_buffer;
+            zstd_in.size = 0;
+            zstd_in.pos = 0;
+            break;
+#endif
+
+        case TRACE_FORMAT_BIN:
+            break;
+
+        default:
+            return -1;
+    }
+
+    return 0;
+}
+
+void TRACE_READER::end_stream()
+{
+    switch (format) {
+        case TRACE_FORMAT_GZIP:
+            inflateEnd(&gzip_stream);
+            break;
+
+        case TRACE_FORMAT_XZ:
+            lzma_end(&xz_stream);
+            break;
+
+#ifdef ZSTD_TRACE
+        case TRACE_FORMAT_ZSTD:
+            if (zstd_stream) {
+                ZSTD_freeDStream(zstd_stream);
+                zstd_stream = NULL;
+            }
+            break;
+#endif
+
+        default:
+            break;
+    }
+}
+
+// decode as much as fits into buffer, returns the number of bytes written
+// 0 means the end of the stream has been reached
+size_t TRACE_READER::decode(uint8_t *buffer, size_t size)
+{
+    size_t filled = 0;
+
+    while ((filled < size) && (end_of_stream == 0)) {
+        switch (format) {
+            case TRACE_FORMAT_GZIP:
+            {
+                if ((gzip_stream.avail_in == 0) && (end_of_input == 0)) {
+                    gzip_stream.next_in = in_buffer;
+                    gzip_stream.avail_in = fread(in_buffer, 1, TRACE_INPUT_SIZE, file);
+                    if (gzip_stream.avail_in == 0)
+                        end_of_input = 1;
+                }
+
+                gzip_stream.next_out = buffer + filled;
+                gzip_stream.avail_out = size - filled;
+                int ret = inflate(&gzip_stream, Z_NO_FLUSH);
+                filled = size - gzip_stream.avail_out;
+
+                if (ret == Z_STREAM_END) { // another gzip member may follow
+                    gzip_members++;
+                    inflateReset(&gzip_stream);
+                }
+                else if (ret == Z_BUF_ERROR) { // no progress possible
+                    if (end_of_input)
+                        end_of_stream = 1;
+                }
+                else if ((ret == Z_DATA_ERROR) && gzip_members && (gzip_stream.total_out == 0)) {
+                    // not a gzip header after a complete member (e.g. zero padding), that is the end of the trace
+                    cerr << "[TRACE_READER] " << __func__ << " ignoring trailing data after gzip member " << gzip_members << " in " << file_name << endl;
+                    end_of_stream = 1;
+                }
+                else if (ret != Z_OK) {
+                    cerr << "[TRACE_READER] " << __func__ << " gzip error: " << ret << " in " << file_name << endl;
+                    assert(0);
+                }
+                break;
+            }
+
+            case TRACE_FORMAT_XZ:
+            {
+                if ((xz_stream.avail_in == 0) && (end_of_input == 0)) {
+                    xz_stream.next_in = in_buffer;
+                    xz_stream.avail_in = fread(in_buffer, 1, TRACE_INPUT_SIZE, file);
+                    if (xz_stream.avail_in == 0)
+                        end_of_input = 1;
+                }
+
+                xz_stream.next_out = buffer + filled;
+                xz_stream.avail_out = size - filled;
+                lzma_ret ret = lzma_code(&xz_stream, end_of_input ? LZMA_FINISH : LZMA_RUN);
+                filled = size - xz_stream.avail_out;
+
+                if (ret == LZMA_STREAM_END)
+                    end_of_stream = 1;
+                else if (ret != LZMA_OK) {
+                    cerr << "[TRACE_READER] " << __func__ << " xz error: " << ret << " in " << file_name << endl;
+                    assert(0);
+                }
+                break;
+            }
+
+#ifdef ZSTD_TRACE
+            case TRACE_FORMAT_ZSTD:
+            {
+                if ((zstd_in.pos == zstd_in.size) && (end_of_input == 0)) {
+                    zstd_in.size = fread(in_buffer, 1, TRACE_INPUT_SIZE, file);
+                    zstd_in.pos = 0;
+                    if (zstd_in.size == 0)
+                        end_of_input = 1;
+                }
+
+                ZSTD_outBuffer zstd_out = {buffer + filled, size - filled, 0};
+                size_t ret = ZSTD_decompressStream(zstd_stream, &zstd_out, &zstd_in);
+                if (ZSTD_isError(ret)) {
+                    cerr << "[TRACE_READER] " << __func__ << " zstd error: " << ZSTD_getErrorName(ret) << " in " << file_name << endl;
+                    assert(0);
+                }
+                filled += zstd_out.pos;
+
+                // the decoder may still hold output after the last input byte was consumed
+                if (end_of_input && (zstd_out.pos == 0))
+                    end_of_stream = 1;
+                break;
+            }
+#endif
+
+            default:
+                assert(0);
+        }
+    }
+
+    return filled;
+}
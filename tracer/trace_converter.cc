@@ -0,0 +1,164 @@
+// converts a ChampSim trace into the uncompressed .champsim.bin format, or into a
+// block-compressed xz trace with a sidecar index for -skip_instructions
+// usage: trace_converter [-cloudsuite] [-block_size N] <input trace> <output .champsim.bin or .xz>
+
+#include "trace_reader.h"
+#include "instruction.h"
+
+#define CONVERT_BATCH 16384
+#define DEFAULT_BLOCK_SIZE 1000000
+
+static int write_bin(TRACE_READER *reader, FILE *output, size_t record_size, uint8_t cloudsuite)
+{
+    // the instruction count is only known at the end, the header is written again then
+    trace_bin_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_BIN_MAGIC, sizeof(header.magic));
+    header.version = TRACE_BIN_VERSION;
+    header.record_size = record_size;
+    header.cloudsuite = cloudsuite;
+
+    if (fwrite(&header, sizeof(header), 1, output) != 1)
+        return -1;
+
+    uint8_t *batch = new uint8_t[CONVERT_BATCH * record_size];
+    size_t num_records;
+    while ((num_records = reader->read(batch, record_size, CONVERT_BATCH)) > 0) {
+        if (fwrite(batch, record_size, num_records, output) != num_records) {
+            delete[] batch;
+            return -1;
+        }
+        header.instr_count += num_records;
+    }
+    delete[] batch;
+
+    fseek(output, 0, SEEK_SET);
+    if (fwrite(&header, sizeof(header), 1, output) != 1)
+        return -1;
+
+    cout << "Converted " << header.instr_count << " instructions" << endl;
+
+    return 0;
+}
+
+static int write_blocks(TRACE_READER *reader, FILE *output, FILE *index, size_t record_size, uint64_t block_size)
+{
+    trace_index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = TRACE_INDEX_VERSION;
+    header.record_size = record_size;
+    header.records_per_block = block_size;
+
+    if (fwrite(&header, sizeof(header), 1, index) != 1)
+        return -1;
+
+    // each block becomes its own xz stream, so a reader can start decoding at any of them
+    size_t raw_size = block_size * record_size,
+           xz_size = lzma_stream_buffer_bound(raw_size);
+    uint8_t *raw = new uint8_t[raw_size],
+            *xz = new uint8_t[xz_size];
+    uint64_t offset = 0, num_instr = 0;
+    size_t num_records;
+    int ret = 0;
+
+    while ((num_records = reader->read(raw, record_size, block_size)) > 0) {
+        size_t xz_pos = 0;
+        if (lzma_easy_buffer_encode(LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64, NULL, raw, num_records*record_size, xz, &xz_pos, xz_size) != LZMA_OK) {
+            ret = -1;
+            break;
+        }
+
+        if ((fwrite(xz, 1, xz_pos, output) != xz_pos) || (fwrite(&offset, sizeof(offset), 1, index) != 1)) {
+            ret = -1;
+            break;
+        }
+
+        offset += xz_pos;
+        num_instr += num_records;
+        header.num_blocks++;
+    }
+    delete[] raw;
+    delete[] xz;
+
+    if (ret)
+        return ret;
+
+    fseek(index, 0, SEEK_SET);
+    if (fwrite(&header, sizeof(header), 1, index) != 1)
+        return -1;
+
+    cout << "Converted " << num_instr << " instructions into " << header.num_blocks << " blocks" << endl;
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    uint8_t cloudsuite = 0;
+    uint64_t block_size = DEFAULT_BLOCK_SIZE;
+    int arg = 1;
+
+    while (arg < argc) {
+        if (strcmp(argv[arg], "-cloudsuite") == 0)
+            cloudsuite = 1;
+        else if ((strcmp(argv[arg], "-block_size") == 0) && ((arg + 1) < argc))
+            block_size = atol(argv[++arg]);
+        else
+            break;
+        arg++;
+    }
+
+    if (((argc - arg) != 2) || (block_size == 0)) {
+        cerr << "usage: " << argv[0] << " [-cloudsuite] [-block_size N] <input trace> <output .champsim.bin or .xz>" << endl;
+        return 1;
+    }
+
+    const char *input_name = argv[arg], *output_name = argv[arg+1];
+    size_t record_size = cloudsuite ? sizeof(cloudsuite_instr) : sizeof(input_instr);
+
+    TRACE_READER reader;
+    int open_ret = reader.open(input_name);
+    if (open_ret == -2) {
+        cerr << input_name << " is not a trace, only gz, xz or champsim.bin traces are supported" << endl;
+        return 1;
+    }
+    else if (open_ret) {
+        cerr << "cannot open " << input_name << endl;
+        return 1;
+    }
+
+    FILE *output = fopen(output_name, "wb");
+    if (output == NULL) {
+        cerr << "cannot create " << output_name << endl;
+        return 1;
+    }
+
+    // a .xz output is block-compressed and gets <output>.idx next to it
+    size_t name_len = strlen(output_name);
+    int ret;
+    if ((name_len > 3) && (strcmp(output_name + name_len - 3, ".xz") == 0)) {
+        char index_name[1024+4];
+        snprintf(index_name, sizeof(index_name), "%s.idx", output_name);
+        FILE *index = fopen(index_name, "wb");
+        if (index == NULL) {
+            cerr << "cannot create " << index_name << endl;
+            return 1;
+        }
+        ret = write_blocks(&reader, output, index, record_size, block_size);
+        if (fclose(index))
+            ret = -1;
+    }
+    else
+        ret = write_bin(&reader, output, record_size, cloudsuite);
+
+    if (fclose(output))
+        ret = -1;
+
+    if (ret) {
+        cerr << "cannot write " << output_name << endl;
+        return 1;
+    }
+
+    return 0;
+}